@@ -6,29 +6,32 @@
 
 namespace fuzzing {
 
-  const char* results_dir = "/mnt/pytorch-ivysyn";
+  /* Can be pointed elsewhere, e.g. to a directory shared by several hosts */
+  static const char *get_results_dir()
+  {
+    const char *dir = getenv("IVYSYN_RESULTS_DIR");
+    return dir != NULL ? dir : "/mnt/pytorch-ivysyn";
+  }
+
+  const char* results_dir = get_results_dir();
 
 #if !defined(IVYSYN_VALIDATE) && !defined(IVYSYN_COLLECT_TYPES)
   bool already_fuzzing = false;
   const int TIMEOUT_SECS = 1200;
   const int RAND_SEED = 123;
   const int NMUT_UPPER_BOUND_MID = 1000000;
-  const int CRASHES_BOUND = 1;
-  const int MUTFILE_TRIES = 5;
-  const int MAX_EMPTY_LOG_FILES = 5;
-  const int TIME_THRESH_SECS = 30;
   const at::DeviceType tensor_dev = c10::kCPU;
   std::string cur_fname_glob = {};
 
-  static std::fstream mutations_file;
-  static std::fstream mutations_restore;
-  static std::fstream last_timestamp_file;
-  static std::fstream timestamp_restore;
+  static struct progress_slot *progress = nullptr;
   static std::fstream crashes_file;
   static std::fstream unknown_type_file;
   static std::fstream num_crashes_file;
-  static std::fstream time_file;
-  static std::fstream except_file;
+  static struct mutation_ring *ring = nullptr;
+  static int ring_fd = -1;
+  static std::thread *drain_thread = nullptr;
+  static std::atomic<bool> drain_stop;
+  static char hang_filename[BUFSZ];
   static std::fstream start_file;
   static std::fstream done_file;
   static std::fstream crash_found_file;
@@ -63,6 +66,122 @@ namespace fuzzing {
       /* std::cout << "Created file " << filename << std::endl; */
   }
 
+  /*
+   * The size of the mapping is kept in the page in front of the one that is
+   * handed out, so unmapping only needs the pointer
+   */
+  static void *map_zero_pages(size_t num_bytes)
+  {
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t map_bytes = page_size + ((num_bytes + page_size - 1) / page_size) * page_size;
+    char *base;
+
+    base = (char *) mmap(NULL, map_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+      return nullptr;
+    }
+
+    *(size_t *) base = map_bytes;
+    return base + page_size;
+  }
+
+  static void unmap_zero_pages(void *ptr)
+  {
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    char *base;
+
+    if (ptr == nullptr) {
+      return;
+    }
+
+    base = (char *) ptr - page_size;
+    munmap(base, *(size_t *) base);
+  }
+
+  c10::DataPtr ZeroPageAllocator::allocate(size_t nbytes) const
+  {
+    void *ptr = map_zero_pages(nbytes);
+
+    return {ptr, ptr, &unmap_zero_pages, c10::Device(c10::DeviceType::CPU)};
+  }
+
+  /* Never freed, kernels can hold on to their inputs after the Fuzzer is gone */
+  ZeroPageAllocator *zero_page_allocator()
+  {
+    static ZeroPageAllocator *allocator = new ZeroPageAllocator();
+    return allocator;
+  }
+
+  static void release_guarded(void *ptr)
+  {
+    guard_page_allocator()->release(ptr);
+  }
+
+  c10::DataPtr GuardPageAllocator::allocate(size_t nbytes) const
+  {
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t data_bytes, data_pages;
+    char *base = nullptr;
+    void *ptr;
+
+    data_bytes = ((nbytes + GUARD_PAGE_ALIGN - 1) / GUARD_PAGE_ALIGN) * GUARD_PAGE_ALIGN;
+    data_pages = std::max((data_bytes + page_size - 1) / page_size, (size_t) 1);
+
+    std::lock_guard<std::mutex> lock(mu);
+
+    auto &free_list = free_lists[data_pages];
+    if (!free_list.empty()) {
+      base = free_list.back();
+      free_list.pop_back();
+    } else {
+      base = (char *) mmap(NULL, (data_pages + 1) * page_size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (base == MAP_FAILED) {
+        return c10::GetCPUAllocator()->allocate(nbytes);
+      }
+      if (mprotect(base + data_pages * page_size, page_size, PROT_NONE) != 0) {
+        munmap(base, (data_pages + 1) * page_size);
+        return c10::GetCPUAllocator()->allocate(nbytes);
+      }
+    }
+
+    ptr = base + data_pages * page_size - data_bytes;
+    mappings[ptr] = std::make_pair(base, data_pages);
+
+    return {ptr, ptr, &release_guarded, c10::Device(c10::DeviceType::CPU)};
+  }
+
+  void GuardPageAllocator::release(void *ptr)
+  {
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    char *base;
+    size_t data_pages;
+
+    std::lock_guard<std::mutex> lock(mu);
+
+    auto it = mappings.find(ptr);
+    if (it == mappings.end()) {
+      return;
+    }
+
+    base = it->second.first;
+    data_pages = it->second.second;
+    mappings.erase(it);
+
+    auto &free_list = free_lists[data_pages];
+    if (free_list.size() < GUARD_FREE_LIST_MAX) {
+      free_list.push_back(base);
+    } else {
+      munmap(base, (data_pages + 1) * page_size);
+    }
+  }
+
+  GuardPageAllocator *guard_page_allocator()
+  {
+    static GuardPageAllocator *allocator = new GuardPageAllocator();
+    return allocator;
+  }
+
 #if !defined(IVYSYN_VALIDATE) && !defined(IVYSYN_COLLECT_TYPES)
   struct timespec time_diff(struct timespec start, struct timespec end)
   {
@@ -86,6 +205,64 @@ namespace fuzzing {
     return stat(filename.c_str(), &stat_buffer) == 0;
   }
 
+  static struct kernel_state_table *map_kernel_states()
+  {
+    std::string filename = std::string(results_dir) + "/kernel_states";
+    struct kernel_state_table *table;
+    struct stat stat_buffer = {};
+    int fd;
+
+    fd = open(filename.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd < 0) {
+      return nullptr;
+    }
+
+    /* Only grow it, other processes may have it mapped already */
+    if (fstat(fd, &stat_buffer) != 0 ||
+        (stat_buffer.st_size < (off_t) sizeof(struct kernel_state_table) &&
+         ftruncate(fd, sizeof(struct kernel_state_table)) != 0)) {
+      close(fd);
+      return nullptr;
+    }
+
+    table = (struct kernel_state_table *) mmap(NULL, sizeof(struct kernel_state_table), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (table == MAP_FAILED) {
+      return nullptr;
+    }
+
+    return table;
+  }
+
+  /*
+   * Called on every Compute() of an instrumented kernel. Once the kernel is
+   * known to be done in the current generation this is two loads from the
+   * shared state table, the marker files are only checked while it isn't
+   */
+  bool was_fuzzed(int kernel_id, const char *fname)
+  {
+    /* Mapped on first use, thread safe local static initialization */
+    static struct kernel_state_table *kernel_states = map_kernel_states();
+    unsigned int generation;
+    bool fuzzed;
+
+    if (kernel_states == nullptr || kernel_id <= 0 || kernel_id >= MAX_KERNEL_IDS) {
+      return was_fuzzed(std::string(fname));
+    }
+
+    generation = kernel_states->generation.load(std::memory_order_relaxed);
+    if (kernel_states->done[kernel_id].load(std::memory_order_relaxed) == generation + 1) {
+      return true;
+    }
+
+    fuzzed = was_fuzzed(std::string(fname));
+    if (fuzzed) {
+      kernel_states->done[kernel_id].store(generation + 1, std::memory_order_relaxed);
+    }
+
+    return fuzzed;
+  }
+
   bool zero_muts_crashed(const std::string& fname) {
     struct stat stat_buffer = {};
     std::string zero_mut_filename;
@@ -98,41 +275,467 @@ namespace fuzzing {
   bool was_killed(const std::string& fname)
   {
     struct stat stat_buffer = {};
-    int killed_exists = 0, timeout_exists = 0;
 
     std::string killed_filename = std::string(results_dir) + "/" + fname + ".killed";
-    std::string timeout_filename = std::string(results_dir) + "/" + fname + ".timeout";
 
-    killed_exists = stat(killed_filename.c_str(), &stat_buffer) == 0;
+    return stat(killed_filename.c_str(), &stat_buffer) == 0;
+  }
+
+  /* No iostreams in a signal handler */
+  static char *append_number(char *p, unsigned long long num, int base)
+  {
+    char digits[32];
+    int n = 0;
+
+    do {
+      digits[n++] = "0123456789abcdef"[num % base];
+      num /= base;
+    } while (num != 0);
+
+    while (n > 0) {
+      *p++ = digits[--n];
+    }
+    return p;
+  }
+
+  /*
+   * The watchdog went off, so the mutation in the progress slot hung. Note it
+   * in <kernel>.hang and die, the restart logs it as a hang and goes on from
+   * the next mutation. The kernel can be holding any lock, hence no iostreams.
+   */
+  void handle_hang(int)
+  {
+    char logbuf[LOGBUFSZ];
+    char *p = logbuf;
+    long long mutation;
+    int fd;
+
+    if (progress == nullptr) {
+      _Exit(-SIGALRM);
+    }
+
+    mutation = progress->mutation;
+    if (mutation < 0) {
+      *p++ = '-';
+      mutation = -mutation;
+    }
+    p = append_number(p, mutation, 10);
+    *p++ = '\n';
 
-    stat_buffer = {};
-    timeout_exists = stat(timeout_filename.c_str(), &stat_buffer) == 0;
+    fd = open(hang_filename, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    write(fd, logbuf, p - logbuf);
+    close(fd);
 
-    return killed_exists | timeout_exists;
+    _Exit(-SIGALRM);
   }
 
-  void handle_timeout(int)
+  static uint64_t fnv1a(uint64_t hash, const void *data, size_t len)
   {
+    const unsigned char *bytes = (const unsigned char *) data;
 
-    /* std::cout << "Kernel " << cur_fname_glob << " timed out, stopping fuzzing" << std::endl; */
+    for (size_t i = 0; i < len; i++) {
+      hash ^= bytes[i];
+      hash *= 0x100000001b3ULL;
+    }
 
-    struct timespec ts = {};
-    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return hash;
+  }
+
+  /* Executable segments, so frames hash the same in every process despite ASLR */
+  struct crash_module {
+    uintptr_t start;
+    uintptr_t end;
+    uint64_t name_hash;
+  };
+
+  static struct crash_module crash_modules[CRASH_MAX_MODULES];
+  static int num_crash_modules = 0;
+  static const int crash_signals[] = { SIGSEGV, SIGFPE, SIGABRT };
+  static struct sigaction old_crash_actions[sizeof(crash_signals) / sizeof(crash_signals[0])];
+
+  static int add_crash_modules(struct dl_phdr_info *info, size_t, void *)
+  {
+    const char *name = info->dlpi_name;
+    uint64_t name_hash;
+
+    /* The same library can be installed in different places */
+    if (strrchr(name, '/') != nullptr) {
+      name = strrchr(name, '/') + 1;
+    }
+    name_hash = fnv1a(FNV_OFFSET_BASIS, name, strlen(name));
+
+    for (int i = 0; i < info->dlpi_phnum && num_crash_modules < CRASH_MAX_MODULES; i++) {
+      if (info->dlpi_phdr[i].p_type != PT_LOAD || !(info->dlpi_phdr[i].p_flags & PF_X)) {
+        continue;
+      }
+      crash_modules[num_crash_modules].start = info->dlpi_addr + info->dlpi_phdr[i].p_vaddr;
+      crash_modules[num_crash_modules].end = crash_modules[num_crash_modules].start + info->dlpi_phdr[i].p_memsz;
+      crash_modules[num_crash_modules].name_hash = name_hash;
+      num_crash_modules++;
+    }
+
+    return 0;
+  }
+
+  /*
+   * Hash the top CRASH_HASH_FRAMES frames of the crashing stack into the
+   * progress slot, as offsets into their modules, and let the signal do what
+   * it would have done. The restart buckets the crash by the hash, see
+   * increase_num_crashes(). backtrace() was called once before, so it doesn't
+   * have to load libgcc in here.
+   */
+  static void handle_crash(int sig, siginfo_t *info, void *)
+  {
+    void *frames[CRASH_MAX_FRAMES];
+    uint64_t hash = FNV_OFFSET_BASIS;
+    uintptr_t pc;
+    int num_frames;
+    size_t idx = 0;
+
+    num_frames = backtrace(frames, CRASH_MAX_FRAMES);
+
+    /* Past this handler and the signal trampoline */
+    for (int i = 2; i < num_frames && i < 2 + CRASH_HASH_FRAMES; i++) {
+      pc = (uintptr_t) frames[i];
+      for (int m = 0; m < num_crash_modules; m++) {
+        if (pc >= crash_modules[m].start && pc < crash_modules[m].end) {
+          hash = fnv1a(hash, &crash_modules[m].name_hash, sizeof(crash_modules[m].name_hash));
+          pc -= crash_modules[m].start;
+          break;
+        }
+      }
+      hash = fnv1a(hash, &pc, sizeof(pc));
+    }
+
+    /* Keep the first signal, an abort can follow a fault */
+    if (progress != nullptr && progress->crash_mutation != progress->mutation) {
+      /* 0 is a crash that wasn't hashed */
+      progress->crash_bucket = hash != 0 ? hash : 1;
+      progress->crash_signal = sig;
+      progress->crash_mutation = progress->mutation;
+    }
+
+    while (crash_signals[idx] != sig) {
+      idx++;
+    }
+    sigaction(sig, &old_crash_actions[idx], NULL);
+
+    /* A fault happens again on return, a sent signal has to be sent again */
+    if (info->si_code <= 0) {
+      raise(sig);
+    }
+  }
+
+  static void install_crash_handlers()
+  {
+    struct sigaction crash_sigaction = {};
+    struct sigaction cur_sigaction = {};
+    void *frame;
+
+    if (num_crash_modules == 0) {
+      backtrace(&frame, 1);
+      dl_iterate_phdr(add_crash_modules, NULL);
+    }
+
+    crash_sigaction.sa_sigaction = handle_crash;
+    crash_sigaction.sa_flags = SA_SIGINFO;
+
+    for (size_t i = 0; i < sizeof(crash_signals) / sizeof(crash_signals[0]); i++) {
+      sigaction(crash_signals[i], NULL, &cur_sigaction);
+      /* Already installed by a kernel fuzzed before in this process */
+      if ((cur_sigaction.sa_flags & SA_SIGINFO) && cur_sigaction.sa_sigaction == handle_crash) {
+        continue;
+      }
+      sigaction(crash_signals[i], &crash_sigaction, &old_crash_actions[i]);
+    }
+  }
+
+  struct progress_slot *map_progress_slot(const std::string& filename, const std::string& fname)
+  {
+    struct progress_slot *slot;
+    int fd;
+
+    fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd < 0) {
+      std::cout << "Failed to open " << filename << std::endl;
+      std::cout << "Error: " << strerror(errno) << std::endl;
+      return nullptr;
+    }
+
+    if (ftruncate(fd, sizeof(struct progress_slot)) != 0) {
+      std::cout << "Failed to resize " << filename << std::endl;
+      std::cout << "Error: " << strerror(errno) << std::endl;
+      close(fd);
+      return nullptr;
+    }
+
+    slot = (struct progress_slot *) mmap(NULL, sizeof(struct progress_slot), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (slot == MAP_FAILED) {
+      std::cout << "Failed to map " << filename << std::endl;
+      std::cout << "Error: " << strerror(errno) << std::endl;
+      return nullptr;
+    }
+
+    slot->mutation = -1;
+    slot->timestamp = -1;
+    slot->crash_mutation = -1;
+    slot->last_ok_mutation = -1;
+    strncpy(slot->kernel, fname.c_str(), FILENAME_SZ - 1);
+    /* Set last, a slot without the magic was never initialized */
+    slot->magic = PROGRESS_MAGIC;
+
+    return slot;
+  }
+
+  void unmap_progress_slot(struct progress_slot *slot)
+  {
+    if (slot != nullptr) {
+      munmap(slot, sizeof(struct progress_slot));
+    }
+  }
+
+  bool read_progress_slot(const std::string& filename, long long *mutation, long long *timestamp,
+                          unsigned long long *crash_bucket, int *crash_signal)
+  {
+    struct progress_slot slot = {};
+    ssize_t nread;
+    int fd;
 
-    std::string timeout_filename = std::string(results_dir) + "/" + cur_fname_glob + ".timeout";
+    fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+
+    nread = pread(fd, &slot, sizeof(struct progress_slot), 0);
+    close(fd);
+
+    if (nread != sizeof(struct progress_slot) || slot.magic != PROGRESS_MAGIC) {
+      return false;
+    }
+
+    *mutation = slot.mutation;
+    *timestamp = slot.timestamp;
+    /* Killed without the handler running, or a stale crash */
+    *crash_bucket = 0;
+    *crash_signal = 0;
+    if (slot.crash_mutation == slot.mutation) {
+      *crash_bucket = slot.crash_bucket;
+      *crash_signal = slot.crash_signal;
+    }
+
+    return true;
+  }
+
+  /*
+   * Carry the mutation times and last returned mutation of the run that left
+   * filename over to slot
+   */
+  static void copy_slot_history(const std::string& filename, struct progress_slot *slot)
+  {
+    struct progress_slot old_slot = {};
+    ssize_t nread;
+    int fd;
 
-    /* std::ofstream timeout_file(timeout_filename); */
-    /* timeout_file << ts.tv_sec << std::endl; */
-    /* timeout_file.close(); */
+    fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
 
-    int fd = open(timeout_filename.c_str(), O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-    char logbuf[0x20];
-    memset(logbuf, 0, 0x20);
-    sprintf(logbuf, "%ld", ts.tv_sec);
-    write(fd, logbuf, 0x20);
+    nread = pread(fd, &old_slot, sizeof(struct progress_slot), 0);
     close(fd);
 
-    _Exit(-SIGALRM);
+    if (nread != sizeof(struct progress_slot) || old_slot.magic != PROGRESS_MAGIC) {
+      return;
+    }
+
+    for (int i = 0; i < HANG_NUM_BUCKETS; i++) {
+      slot->hang_buckets[i] = old_slot.hang_buckets[i];
+    }
+    slot->hang_samples = old_slot.hang_samples;
+    slot->last_ok_mutation = old_slot.last_ok_mutation;
+  }
+
+  static struct mutation_ring *map_mutation_ring(const std::string& filename, bool create)
+  {
+    struct mutation_ring *ring;
+    struct stat stat_buffer = {};
+    int fd;
+
+    if (create) {
+      fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    } else {
+      fd = open(filename.c_str(), O_RDWR);
+    }
+    if (fd < 0) {
+      if (create) {
+        std::cout << "Failed to open " << filename << std::endl;
+        std::cout << "Error: " << strerror(errno) << std::endl;
+      }
+      return nullptr;
+    }
+
+    if (create && ftruncate(fd, sizeof(struct mutation_ring)) != 0) {
+      std::cout << "Failed to resize " << filename << std::endl;
+      std::cout << "Error: " << strerror(errno) << std::endl;
+      close(fd);
+      return nullptr;
+    }
+
+    if (!create && (fstat(fd, &stat_buffer) != 0 || stat_buffer.st_size != sizeof(struct mutation_ring))) {
+      close(fd);
+      return nullptr;
+    }
+
+    ring = (struct mutation_ring *) mmap(NULL, sizeof(struct mutation_ring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ring == MAP_FAILED) {
+      std::cout << "Failed to map " << filename << std::endl;
+      std::cout << "Error: " << strerror(errno) << std::endl;
+      return nullptr;
+    }
+
+    if (create) {
+      ring->head.store(0);
+      ring->tail.store(0);
+      ring->magic = RING_MAGIC;
+    } else if (ring->magic != RING_MAGIC) {
+      munmap(ring, sizeof(struct mutation_ring));
+      return nullptr;
+    }
+
+    return ring;
+  }
+
+  /* Write out everything between tail and head, in at most two chunks */
+  static void drain_mutation_ring(struct mutation_ring *ring, int fd)
+  {
+    unsigned long long head, tail, first, count;
+    size_t nbytes;
+    ssize_t written;
+    char *buf;
+
+    head = ring->head.load(std::memory_order_acquire);
+    tail = ring->tail.load(std::memory_order_relaxed);
+
+    while (tail != head) {
+      first = tail % RING_NUM_RECORDS;
+      count = std::min(head - tail, (unsigned long long) RING_NUM_RECORDS - first);
+
+      buf = (char *) &ring->records[first];
+      nbytes = count * sizeof(struct mutation_record);
+      while (nbytes > 0) {
+        written = write(fd, buf, nbytes);
+        if (written < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+          std::cout << "Failed to write mutation records: " << strerror(errno) << std::endl;
+          break;
+        }
+        buf += written;
+        nbytes -= written;
+      }
+
+      tail += count;
+      ring->tail.store(tail, std::memory_order_release);
+    }
+  }
+
+  static void drain_loop()
+  {
+    while (!drain_stop.load()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(RING_DRAIN_MS));
+      drain_mutation_ring(ring, ring_fd);
+    }
+    drain_mutation_ring(ring, ring_fd);
+  }
+
+  bool start_mutation_ring(const std::string& ring_filename, const std::string& time_filename)
+  {
+    ring = map_mutation_ring(ring_filename, true);
+    if (ring == nullptr) {
+      return false;
+    }
+
+    ring_fd = open(time_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (ring_fd < 0) {
+      std::cout << "Failed to open " << time_filename << std::endl;
+      std::cout << "Error: " << strerror(errno) << std::endl;
+      munmap(ring, sizeof(struct mutation_ring));
+      ring = nullptr;
+      return false;
+    }
+
+    /* Not a static std::thread, exit() would abort on it */
+    drain_stop.store(false);
+    drain_thread = new std::thread(drain_loop);
+
+    return true;
+  }
+
+  void stop_mutation_ring(const std::string& ring_filename)
+  {
+    if (ring == nullptr) {
+      return;
+    }
+
+    drain_stop.store(true);
+    drain_thread->join();
+    delete drain_thread;
+    drain_thread = nullptr;
+
+    close(ring_fd);
+    ring_fd = -1;
+    munmap(ring, sizeof(struct mutation_ring));
+    ring = nullptr;
+    std::remove(ring_filename.c_str());
+  }
+
+  /* Write out the records a crashed process left in its ring */
+  void recover_mutation_ring(const std::string& ring_filename, const std::string& time_filename)
+  {
+    struct mutation_ring *old_ring;
+    int fd;
+
+    old_ring = map_mutation_ring(ring_filename, false);
+    if (old_ring == nullptr) {
+      return;
+    }
+
+    fd = open(time_filename.c_str(), O_WRONLY | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd >= 0) {
+      drain_mutation_ring(old_ring, fd);
+      close(fd);
+    }
+
+    munmap(old_ring, sizeof(struct mutation_ring));
+    std::remove(ring_filename.c_str());
+  }
+
+  void log_mutation_record(long long mutation, long long duration, int status, int failing_arg)
+  {
+    struct mutation_record *record;
+    unsigned long long head;
+
+    if (ring == nullptr) {
+      return;
+    }
+
+    head = ring->head.load(std::memory_order_relaxed);
+
+    /* Full, wait for the drain thread to catch up */
+    while (head - ring->tail.load(std::memory_order_acquire) >= RING_NUM_RECORDS) {
+      std::this_thread::yield();
+    }
+
+    record = &ring->records[head % RING_NUM_RECORDS];
+    record->mutation = mutation;
+    record->duration = duration;
+    record->status = status;
+    record->failing_arg = failing_arg;
+
+    ring->head.store(head + 1, std::memory_order_release);
   }
 
 #endif
@@ -152,7 +755,18 @@ Fuzzer::~Fuzzer() {
   /*     num_crashes_file.close(); */
   /* } */
 
-  alarm(0);
+#if !defined(IVYSYN_VALIDATE) && !defined(IVYSYN_COLLECT_TYPES)
+  if (hang_timer_pid == ::getpid()) {
+    timer_delete(hang_timer);
+  }
+  if (owns_ring) {
+    stop_mutation_ring(ring_filename);
+  }
+  /* Releases the kernel */
+  if (lock_fd >= 0) {
+    close(lock_fd);
+  }
+#endif
 
 }
 
@@ -935,14 +1549,10 @@ Fuzzer::Fuzzer(char *fname, std::vector<std::string> types_vec, std::vector<void
       cur_fname_glob.assign(cur_fname);
 
       std::string mut_filename;
-      std::string last_timestamp_filename;
       std::string time_filename;
-      std::string except_filename;
       std::string total_filename;
       std::string start_filename;
       std::string mutfile_pattern;
-      std::string mutfile_prefix;
-      std::string proc_filename;
       std::string nofuzz_filename;
 
       glob_t glob_result = {};
@@ -952,14 +1562,14 @@ Fuzzer::Fuzzer(char *fname, std::vector<std::string> types_vec, std::vector<void
 
       bool restore = false, do_resume = false;
       long long last_mutation = -1, last_timestamp = -1;
+      unsigned long long crash_bucket = 0;
+      int crash_signal = 0;
       bool has_tensor = false, has_intarrayref = false, has_scalar = false,
            has_doublearrayref = false, has_sparse_tensor = false, has_tensor_options = false;
 
       int glob_ret = 0;
       pid_t mypid = 0;
 
-      char *existing_pid;
-
       int total_args, i;
       fuzzing::TorchType type_enum;
       std::string type;
@@ -995,110 +1605,73 @@ Fuzzer::Fuzzer(char *fname, std::vector<std::string> types_vec, std::vector<void
 
       mypid = ::getpid();
 
+      if (!claim_kernel()) {
+        /* Another process is fuzzing this kernel (or all its shards) right now */
+        total_mutations = 0;
+        is_running = true;
+        return;
+      }
+
       mutfile_pattern = std::string(results_dir) + "/" + cur_fname + "_mutations.log.*";
-      mutfile_prefix = std::string(results_dir) + "/" + cur_fname + "_mutations.log";
 
       mut_filename = std::string(results_dir) + "/" + cur_fname + "_mutations.log." + std::to_string(mypid);
-      last_timestamp_filename = std::string(results_dir) + "/" + cur_fname + ".last_timestamp." + std::to_string(mypid);
       time_filename = std::string(results_dir) + "/" + cur_fname + ".time." + std::to_string(mypid);
-      except_filename = std::string(results_dir) + "/" + cur_fname + ".failed." + std::to_string(mypid);
+      ring_filename = std::string(results_dir) + "/" + cur_fname + ".ring." + std::to_string(mypid);
       start_filename = std::string(results_dir) + "/" + cur_fname + ".start";
       total_filename = std::string(results_dir) + "/totals.txt";
       nofuzz_filename = std::string(results_dir) + "/" + cur_fname + ".nofuzz";
+      snprintf(hang_filename, BUFSZ, "%s/%s.hang", results_dir, cur_fname.c_str());
 
       mutations_logger_filename = mut_filename;
-      timestamp_logger_filename = last_timestamp_filename;
 
       std::ios_base::openmode fflags = std::ios::out | std::ios::in | std::ios::trunc;
 
       /*
-       * Seed it with the pid such that two processes will
-       * get different values in the next iterations
+       * We own the kernel, so any mutation file left for it belongs to a process
+       * that crashed or was killed. Restore from the one that got to a mutation,
+       * the rest never ran anything.
        */
-      std::mt19937_64 rng(std::random_device{}());
-      std::uniform_int_distribution<std::mt19937_64::result_type> dist(0, 2000);
-
-      int slp = dist(rng);
-      std::this_thread::sleep_for(std::chrono::milliseconds(slp));
-
       glob_ret = glob(mutfile_pattern.c_str(), 0, NULL, &glob_result);
-      // A mutation file for the same function exists
-      if (glob_ret != GLOB_NOMATCH && !restore) {
-      /* if (glob_ret != GLOB_NOMATCH) { */
-
-        // A lot of empty mutation files, probably deadlock or bug, stop
-        // fuzzing this function
-        if (glob_result.gl_pathc > MAX_EMPTY_LOG_FILES) {
-          mark_fuzzing_done();
-          std::cout << mypid << ": " << cur_fname << "has a lot of empty mutation files, skip" << std::endl;
-          return;
+      if (glob_ret == 0) {
+        for (size_t i = 0; i < glob_result.gl_pathc; ++i) {
+          recover_stale_files(glob_result.gl_pathv[i]);
+          if (!restore && read_progress_slot(glob_result.gl_pathv[i], &last_mutation, &last_timestamp,
+                                             &crash_bucket, &crash_signal)
+              && last_mutation >= 0) {
+            mutations_restore_filename = glob_result.gl_pathv[i];
+            restore = true;
+            /* Killed by the watchdog or timed out, no crash to log */
+            do_resume = was_killed(cur_fname);
+          } else {
+            std::remove(glob_result.gl_pathv[i]);
+          }
         }
-
-        // Check if the existing mutation files belong to a running process
-        for(size_t i = 0; i < glob_result.gl_pathc && !restore; ++i) {
-
-          // Grab the pid suffix from the mutation filename
-          existing_pid = glob_result.gl_pathv[i] + mutfile_prefix.length() + 1;
-          proc_filename = "/proc/" + std::string(existing_pid);
-
-          // Check if a process with that pid exists right now
-          if (stat(proc_filename.c_str(), &stat_buffer) == 0){
-
-            // The mutations file belongs to a running process, skip
-            /* printf("%d: %s belongs to a running process, skipping\n", mypid, glob_result.gl_pathv[i]); */
-            std::cout << mypid << ": " << glob_result.gl_pathv[i] << "belongs to a running process, skipping" << std::endl;
-            total_mutations = 0;
-            is_running = true;
-            globfree(&glob_result);
-            return;
-
-          } else {
-
-            // The mutations file doesn't belong to any running process, something crashed or it was killed
-            mutations_restore_filename = glob_result.gl_pathv[i];
-            size_t mut_str_idx = mutations_restore_filename.find("_mutations.log");
-            timestamp_restore_filename = mutations_restore_filename;
-            timestamp_restore_filename.replace(mut_str_idx, std::string("_mutations.log").length(), ".last_timestamp");
-
-            restore = true;
-
-            // Was killed by the watchdog and didn't crash, don't log a crash
-            if (was_killed(cur_fname)) {
-              do_resume = true;
-            }
-
-          }
-        }
-
-      }
-      globfree(&glob_result);
+      }
+      globfree(&glob_result);
 
       if (do_resume) {
         std::cout << mypid << ": " << cur_fname << " was killed, will resume from " << mutations_restore_filename << std::endl;
       } else if (restore) {
         std::cout << mypid << ": " << cur_fname << " crashed, will resume from " << mutations_restore_filename << std::endl;
-      } else {
-        create_file(time_filename, time_file, fflags);
-        time_file.rdbuf()->pubsetbuf(nullptr, 0);
-        create_file(except_filename, except_file, fflags);
-        except_file.rdbuf()->pubsetbuf(nullptr, 0);
       }
 
+      owns_ring = start_mutation_ring(ring_filename, time_filename);
+
       std::cout << mypid << ": Fuzzing function " << cur_fname << std::endl;
 
-      /* Disable buffering else program might crash before writing to logger */
-      create_file(mutations_logger_filename.c_str(), mutations_file, fflags);
-      mutations_file.rdbuf()->pubsetbuf(nullptr, 0);
-      create_file(last_timestamp_filename, last_timestamp_file, fflags);
-      last_timestamp_file.rdbuf()->pubsetbuf(nullptr, 0);
+      /* Shared mapping, the progress is kept even if the program crashes */
+      unmap_progress_slot(progress);
+      progress = map_progress_slot(mutations_logger_filename, cur_fname);
+      if (restore && progress != nullptr) {
+        copy_slot_history(mutations_restore_filename, progress);
+      }
 
       if (!restore) {
 
+        /* Started before but died before its first mutation, don't retry */
         if (stat(start_filename.c_str(), &stat_buffer) == 0) {
-            std::remove(mutations_restore_filename.c_str());
-            std::remove(timestamp_restore_filename.c_str());
-            total_mutations = 0;
-            is_running = true;
+            std::cout << mypid << ": " << cur_fname << " crashed before any mutation, skipping" << std::endl;
+            mark_fuzzing_done();
             return;
         }
 
@@ -1334,6 +1907,9 @@ Fuzzer::Fuzzer(char *fname, std::vector<std::string> types_vec, std::vector<void
       std::shuffle(std::begin(bool_arrays), std::end(bool_arrays), shuf_rng);
 
       calculate_total_mutations();
+#if defined(IVYSYN_NUM_SHARDS)
+      set_shard_range();
+#endif
 
       /* File to log total number of mutations */
       total_file.clear();
@@ -1344,41 +1920,27 @@ Fuzzer::Fuzzer(char *fname, std::vector<std::string> types_vec, std::vector<void
       }
       total_file << cur_fname << ":" << all_mutations << std::endl << std::flush;
       total_file.close();
+      if (!restore) {
+        log_pool_bytes();
+      }
 
       if (restore) {
 
-        mutations_restore.open(mutations_restore_filename, std::ios::out | std::ios::in);
-        timestamp_restore.open(timestamp_restore_filename, std::ios::out | std::ios::in);
-
-        std::string last_line;
-
-        getline(mutations_restore, last_line);
-        if (last_line.length() > 0) {
-          last_mutation = std::stoll(last_line);
-        } else {
-          printf("Error: reading %s (got %s)...\n", mutations_restore_filename.c_str(), last_line.c_str());
-        }
-
-        getline(timestamp_restore, last_line);
-        if (last_line.length() <= 0) {
-          printf("Error: reading %s (got %s)...\n", timestamp_restore_filename.c_str(), last_line.c_str());
-        } else {
-          last_timestamp = std::stoll(last_line);
-        }
         if (last_mutation >= 0) {
-            restore_last_mutation(last_mutation, last_timestamp, do_resume);
+            restore_last_mutation(last_mutation, last_timestamp, crash_bucket, crash_signal, do_resume);
             /* Delete the file since we already logged the crash */
             std::remove(mutations_restore_filename.c_str());
-            std::remove(timestamp_restore_filename.c_str());
         }
       } else {
         indices[0] = -1;
       }
 
-      struct sigaction timeout_sigaction = {};
-      timeout_sigaction.sa_handler = handle_timeout;
-      sigaction(SIGALRM, &timeout_sigaction, NULL);
-      alarm(TIMEOUT_SECS);
+      /* Armed around each mutation, see arm_watchdog() */
+      struct sigaction hang_sigaction = {};
+      hang_sigaction.sa_handler = handle_hang;
+      sigaction(SIGALRM, &hang_sigaction, NULL);
+
+      install_crash_handlers();
     }
 
   void Fuzzer::log_current_mutation(std::fstream &file) {
@@ -1595,7 +2157,31 @@ Fuzzer::Fuzzer(char *fname, std::vector<std::string> types_vec, std::vector<void
     file << "\n--------------------------------------" << std::endl;
   }
 
-  void Fuzzer::increase_num_crashes()
+  /*
+   * <kernel>.buckets has a line per crash: its stack hash bucket (0 if it
+   * wasn't hashed, e.g. a SIGKILL), the mutation and the signal. Returns how
+   * many of the crashes were in a bucket seen before, and whether crash_bucket
+   * was seen.
+   */
+  static long long scan_crash_buckets(const std::string& filename, unsigned long long crash_bucket, bool *seen)
+  {
+    std::ifstream buckets_file(filename);
+    std::set<unsigned long long> buckets;
+    unsigned long long bucket;
+    long long mutation, duplicates = 0;
+    int sig;
+
+    while (buckets_file >> std::hex >> bucket >> std::dec >> mutation >> sig) {
+      if (!buckets.insert(bucket).second) {
+        duplicates++;
+      }
+    }
+
+    *seen = buckets.count(crash_bucket) > 0;
+    return duplicates;
+  }
+
+  void Fuzzer::increase_num_crashes(unsigned long long crash_bucket, int crash_signal)
   {
 
     long long num_crashes = 0; // Used to bound number of crashes
@@ -1604,8 +2190,13 @@ Fuzzer::Fuzzer(char *fname, std::vector<std::string> types_vec, std::vector<void
     std::string crashes_num_filename;
     std::fstream run_file;
     std::string run_filename;
+    std::fstream buckets_file;
+    std::string buckets_filename;
     std::string last_line;
+    long long duplicates;
+    bool seen;
 
+    char line[BUFSZ];
     char logbuf[LOGBUFSZ];
     memset(logbuf, 0, LOGBUFSZ);
 
@@ -1631,8 +2222,21 @@ Fuzzer::Fuzzer(char *fname, std::vector<std::string> types_vec, std::vector<void
     num_crashes_file.flush();
     /* num_crashes_file.close(); */
 
-    if (num_crashes >= CRASHES_BOUND) {
-      std::cout << "Function " << cur_fname << " crashed " << CRASHES_BOUND << " times, skipping rest of fuzzing" << std::endl;
+    buckets_filename = std::string(results_dir) + "/" + cur_fname + ".buckets";
+    duplicates = scan_crash_buckets(buckets_filename, crash_bucket, &seen);
+    if (seen) {
+      duplicates++;
+    }
+
+    buckets_file.open(buckets_filename, std::ios::out | std::ios::app);
+    snprintf(line, BUFSZ, "%016llx %lld %d\n", crash_bucket, total_mutations, crash_signal);
+    buckets_file << line << std::flush;
+    buckets_file.close();
+
+    /* New buckets are new bugs, keep going until they stop showing up */
+    if (duplicates >= CRASH_DUPLICATES_BOUND || num_crashes >= CRASHES_BOUND) {
+      std::cout << "Function " << cur_fname << " crashed " << num_crashes << " times, " << duplicates
+                << " in buckets seen before, skipping rest of fuzzing" << std::endl;
 
       run_filename = std::string(results_dir) + "/" + cur_fname + ".run";
       create_file(run_filename, run_file, fflags);
@@ -1647,11 +2251,258 @@ Fuzzer::Fuzzer(char *fname, std::vector<std::string> types_vec, std::vector<void
     return;
   }
 
-  void Fuzzer::restore_last_mutation(long long last_mutation, long long last_timestamp, bool do_resume)
+  /*
+   * Take ownership of fname through an exclusive flock() on <fname>.lock.
+   * The lock goes away with the process that holds it, so if we get it,
+   * whoever fuzzed it before us is done, crashed or was killed. Returns false
+   * if another live process holds it.
+   */
+  bool Fuzzer::lock_kernel_file(const std::string& fname)
+  {
+    std::string lock_filename;
+    std::string pid_str;
+
+    lock_filename = std::string(results_dir) + "/" + fname + ".lock";
+
+    lock_fd = open(lock_filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (lock_fd < 0) {
+      std::cout << "Failed to open " << lock_filename << std::endl;
+      std::cout << "Error: " << strerror(errno) << std::endl;
+      return false;
+    }
+
+    if (flock(lock_fd, LOCK_EX | LOCK_NB) != 0) {
+      close(lock_fd);
+      lock_fd = -1;
+      return false;
+    }
+
+    /* Owner pid, only for whoever is looking at the results */
+    pid_str = std::to_string(::getpid()) + "\n";
+    if (ftruncate(lock_fd, 0) != 0 || pwrite(lock_fd, pid_str.c_str(), pid_str.length(), 0) < 0) {
+      std::cout << "Failed to write owner to " << lock_filename << std::endl;
+    }
+
+    return true;
+  }
+
+  /*
+   * With shards, take the first one that isn't done or owned by someone else
+   * and from then on go by its name (<kernel>.shard<i>) for everything but
+   * the merged results
+   */
+  bool Fuzzer::claim_kernel()
+  {
+#if defined(IVYSYN_NUM_SHARDS)
+    std::string shard_fname;
+
+    kernel_fname = cur_fname;
+    for (shard = 0; shard < IVYSYN_NUM_SHARDS; shard++) {
+      shard_fname = kernel_fname + ".shard" + std::to_string(shard);
+      if (!lock_kernel_file(shard_fname)) {
+        continue;
+      }
+      /* Checked under the lock, it may have finished since */
+      if (was_fuzzed(shard_fname)) {
+        close(lock_fd);
+        lock_fd = -1;
+        continue;
+      }
+      cur_fname = shard_fname;
+      cur_fname_glob.assign(cur_fname);
+      return true;
+    }
+
+    return false;
+#else
+    return lock_kernel_file(cur_fname);
+#endif
+  }
+
+#if defined(IVYSYN_NUM_SHARDS)
+  /*
+   * Only keep this shard's part of the main pool steps. The mutation numbers
+   * are still those of the whole kernel, so restoring works the same way
+   */
+  void Fuzzer::set_shard_range()
+  {
+    long long steps, first, last;
+
+    steps = all_mutations / num_mut_skip;
+    first = steps * shard / IVYSYN_NUM_SHARDS;
+    last = steps * (shard + 1) / IVYSYN_NUM_SHARDS;
+
+    total_mutations -= first * num_mut_skip;
+    /* The last shard runs to the end, like the kernel would unsharded */
+    if (shard < IVYSYN_NUM_SHARDS - 1) {
+      shard_stop = all_mutations - (last - 1) * num_mut_skip;
+    }
+
+    std::cout << "Shard " << shard << "/" << IVYSYN_NUM_SHARDS << ": steps " << first << " to " << last << std::endl;
+  }
+
+  static void append_file(const std::string& src_filename, const std::string& dst_filename)
+  {
+    std::ifstream src_file(src_filename);
+    std::ofstream dst_file;
+
+    if (!src_file.is_open() || src_file.peek() == std::ifstream::traits_type::eof()) {
+      return;
+    }
+
+    dst_file.open(dst_filename, std::ios::out | std::ios::app);
+    dst_file << src_file.rdbuf();
+    dst_file.close();
+  }
+
+  /*
+   * Once all the shards are done, put their crashes together under the
+   * kernel's name and mark the kernel itself done, which is what the other
+   * processes and the synthesizer look at. The kernel's own lock keeps two
+   * shards that finish together from both doing it.
+   */
+  void Fuzzer::merge_shards()
+  {
+    std::string kernel_path = std::string(results_dir) + "/" + kernel_fname;
+    std::string shard_path;
+    std::fstream kernel_done_file;
+    struct timespec ts = {};
+    int fd;
+
+    for (int i = 0; i < IVYSYN_NUM_SHARDS; i++) {
+      if (!was_fuzzed(kernel_fname + ".shard" + std::to_string(i))) {
+        return;
+      }
+    }
+
+    fd = open((kernel_path + ".lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd < 0 || flock(fd, LOCK_EX) != 0) {
+      std::cout << "Failed to lock " << kernel_path << ".lock" << std::endl;
+      std::cout << "Error: " << strerror(errno) << std::endl;
+      if (fd >= 0) {
+        close(fd);
+      }
+      return;
+    }
+
+    if (!was_fuzzed(kernel_fname)) {
+      for (int i = 0; i < IVYSYN_NUM_SHARDS; i++) {
+        shard_path = kernel_path + ".shard" + std::to_string(i);
+        append_file(shard_path + "_crashes.log", kernel_path + "_crashes.log");
+        append_file(shard_path + "_hangs.log", kernel_path + "_hangs.log");
+        append_file(shard_path + ".crash_found", kernel_path + ".crash_found");
+        append_file(shard_path + ".buckets", kernel_path + ".buckets");
+        append_file(shard_path + ".slow", kernel_path + ".slow");
+        /* Would otherwise show up as a kernel of its own */
+        std::remove((shard_path + "_crashes.log").c_str());
+        std::remove((shard_path + "_hangs.log").c_str());
+        std::remove((shard_path + ".slow").c_str());
+      }
+
+      create_file(kernel_path + ".done", kernel_done_file, std::ios::out | std::ios::in | std::ios::trunc);
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      kernel_done_file << ts.tv_sec << std::endl;
+      kernel_done_file.close();
+
+      std::cout << kernel_fname << ": all " << IVYSYN_NUM_SHARDS << " shards finished fuzzing" << std::endl;
+    }
+
+    close(fd);
+  }
+#endif
+
+  /* Write out the timings left behind by the process that owned stale_mutfile */
+  void Fuzzer::recover_stale_files(const std::string& stale_mutfile)
+  {
+    std::string old_ring_filename;
+    std::string old_time_filename;
+
+    old_ring_filename = stale_mutfile;
+    old_ring_filename.replace(old_ring_filename.find("_mutations.log"), std::string("_mutations.log").length(), ".ring");
+    old_time_filename = stale_mutfile;
+    old_time_filename.replace(old_time_filename.find("_mutations.log"), std::string("_mutations.log").length(), ".time");
+    recover_mutation_ring(old_ring_filename, old_time_filename);
+  }
+
+#if defined(IVYSYN_FORK_SERVER)
+  /*
+   * Fork a child to run the mutations and wait for it. If the child dies on
+   * a mutation, log the crash from the progress slot and fork a new child
+   * from the next mutation, without going back to the test. Returns true in
+   * the child (or if we can't fork at all), false in the parent once the
+   * kernel is done.
+   */
+  bool Fuzzer::run_fork_server()
+  {
+
+    long long last_mutation = -1, last_timestamp = -1;
+    unsigned long long crash_bucket = 0;
+    int crash_signal = 0;
+    int status = 0;
+    pid_t pid;
+
+    while (true) {
+
+      std::cout << std::flush;
+      pid = fork();
+
+      if (pid < 0) {
+        std::cout << "Fork failed, fuzzing " << cur_fname << " in process" << std::endl;
+        std::cout << "Error: " << strerror(errno) << std::endl;
+        return true;
+      }
+
+      if (pid == 0) {
+        /* Don't outlive the test if the watchdog kills it */
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        in_fork_child = true;
+        return true;
+      }
+
+      while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+
+      /* The child went through all the mutations */
+      if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        break;
+      }
+
+      if (!read_progress_slot(mutations_logger_filename, &last_mutation, &last_timestamp,
+                              &crash_bucket, &crash_signal)) {
+        std::cout << "Error while reading " << mutations_logger_filename << std::endl;
+        mark_fuzzing_done();
+        break;
+      }
+
+      std::cout << ::getpid() << ": " << cur_fname << " crashed in child " << pid << ", restoring" << std::endl;
+      restore_last_mutation(last_mutation, last_timestamp, crash_bucket, crash_signal, false);
+
+      if (main_pool_done && total_mutations <= 0) {
+        break;
+      }
+    }
+
+    /* Done, clean up as a child that got to the end would have */
+    mark_fuzzing_done();
+    std::remove(mutations_logger_filename.c_str());
+    unmap_progress_slot(progress);
+    progress = nullptr;
+    main_pool_done = true;
+    total_mutations = 0;
+
+    return false;
+  }
+#endif
+
+  void Fuzzer::restore_last_mutation(long long last_mutation, long long last_timestamp,
+                                     unsigned long long crash_bucket, int crash_signal, bool do_resume)
   {
 
     std::string crashes_filename;
     std::string crash_found_filename;
+    std::string hangs_filename;
+    std::fstream hangs_file;
+    int failing_arg;
+    bool hung, seen;
 
     /*
      * Handle the case where mutations were already done for this test
@@ -1662,23 +2513,43 @@ Fuzzer::Fuzzer(char *fname, std::vector<std::string> types_vec, std::vector<void
       return;
     }
 
+    hung = was_hung(last_mutation);
+
     std::cout << "Resuming from mutation " << last_mutation << std::endl;
     if (!zero_muts_crashed(cur_fname)) {
-      while (total_mutations != last_mutation) {
-        if (total_mutations < last_mutation) {
-          std::cout << "\033[1;31mError: didn't match last mutation, aborting\n\033[0m " << cur_fname << std::endl << std::flush;
-          mark_fuzzing_done();
-          return;
-        }
-        next_mutations_indices(false);
+      if (!seek_mutation(last_mutation)) {
+        std::cout << "\033[1;31mError: didn't match last mutation, aborting\n\033[0m " << cur_fname << std::endl << std::flush;
+        mark_fuzzing_done();
+        return;
       }
     } else {
       main_pool_done = true;
       total_mutations = last_mutation;
     }
 
-    /* If we weren't killed, also log the crash */
-    if (!do_resume) {
+    failing_arg = find_failing_arg();
+
+    /* A hang is not a crash, log it on its own and go on with the next one */
+    if (hung) {
+      hangs_filename = std::string(results_dir) + "/" + cur_fname + "_hangs.log";
+      hangs_file.open(hangs_filename, std::ios::out | std::ios::app);
+      log_current_mutation(hangs_file);
+      hangs_file.close();
+      std::remove(hang_filename);
+
+      log_mutation_record(total_mutations, -1, MUT_STATUS_HANG, failing_arg);
+
+      next_mutations_indices(true);
+      std::cout << "Mutation hung, mutations left: " << total_mutations << std::endl;
+      return;
+    }
+
+    /* If we weren't killed, also log the crash, once per bucket */
+    scan_crash_buckets(std::string(results_dir) + "/" + cur_fname + ".buckets", crash_bucket, &seen);
+    if (!do_resume && seen) {
+      std::cout << "Crash in bucket " << std::hex << crash_bucket << std::dec << " seen before, not logged" << std::endl;
+      log_mutation_record(total_mutations, -1, MUT_STATUS_CRASHED, failing_arg);
+    } else if (!do_resume) {
       crashes_filename = std::string(results_dir) + "/" + cur_fname + "_crashes.log";
       crashes_logger_filename = crashes_filename;
       crashes_file.open(crashes_logger_filename, std::ios::out | std::ios::app);
@@ -1690,14 +2561,247 @@ Fuzzer::Fuzzer(char *fname, std::vector<std::string> types_vec, std::vector<void
       /* Log crash time in seconds */
       crash_found_file << last_timestamp << std::endl;
       crash_found_file.close();
+
+      log_mutation_record(total_mutations, -1, MUT_STATUS_CRASHED, failing_arg);
     }
 
-    increase_num_crashes();
+    increase_num_crashes(crash_bucket, crash_signal);
 
     next_mutations_indices(true);
     std::cout << "Mutations left: " << total_mutations << std::endl;
   }
 
+#if defined(IVYSYN_COVERING_STRENGTH)
+  /*
+   * Greedily build a covering array of the given strength over the pools:
+   * every combination of values of any strength arguments shows up in at
+   * least one row. Each row starts from the first combination not covered
+   * yet and fills in the other arguments with the value that covers the most
+   * new combinations. Only draws from a generator seeded with RAND_SEED, so
+   * a restarted process gets the same rows and can resume by row number.
+   * Rows are stored flat in rows, pool_sizes.size() entries each.
+   */
+  static long long build_covering_array(const std::vector<int>& pool_sizes, int strength, std::vector<int>& rows)
+  {
+
+    int nargs = pool_sizes.size();
+    std::vector<std::vector<int>> subsets;
+    std::vector<std::vector<int>> arg_subsets(nargs);
+    std::vector<long long> offsets;
+    std::vector<bool> covered;
+    std::vector<int> comb(strength), row(nargs), order(nargs);
+    std::vector<bool> assigned(nargs);
+    long long uncovered = 0, scan = 0, tuple, best_gain, gain;
+    int cur_subset = 0, start, val, best_val, i, j;
+    bool complete;
+    std::mt19937 rngenerator(RAND_SEED);
+
+    /* All the strength-sized sets of arguments, in lexicographic order */
+    for (i = 0; i < strength; i++) {
+      comb[i] = i;
+    }
+    while (true) {
+      for (auto arg : comb) {
+        arg_subsets[arg].push_back(subsets.size());
+      }
+      subsets.push_back(comb);
+      offsets.push_back(uncovered);
+      tuple = 1;
+      for (auto arg : comb) {
+        tuple *= pool_sizes[arg];
+      }
+      uncovered += tuple;
+
+      for (i = strength - 1; i >= 0 && comb[i] == nargs - strength + i; i--);
+      if (i < 0) {
+        break;
+      }
+      comb[i]++;
+      for (j = i + 1; j < strength; j++) {
+        comb[j] = comb[j - 1] + 1;
+      }
+    }
+    offsets.push_back(uncovered);
+    covered.assign(uncovered, false);
+
+    auto tuple_index = [&](int s) {
+      long long idx = 0;
+      for (auto arg : subsets[s]) {
+        idx = idx * pool_sizes[arg] + row[arg];
+      }
+      return offsets[s] + idx;
+    };
+
+    while (uncovered > 0) {
+
+      /* Start from the first combination that isn't covered yet */
+      while (covered[scan]) {
+        scan++;
+      }
+      while (offsets[cur_subset + 1] <= scan) {
+        cur_subset++;
+      }
+      assigned.assign(nargs, false);
+      tuple = scan - offsets[cur_subset];
+      for (i = strength - 1; i >= 0; i--) {
+        val = subsets[cur_subset][i];
+        row[val] = tuple % pool_sizes[val];
+        tuple /= pool_sizes[val];
+        assigned[val] = true;
+      }
+
+      /* Fill in the rest in a random order */
+      for (i = 0; i < nargs; i++) {
+        order[i] = i;
+      }
+      for (i = nargs - 1; i > 0; i--) {
+        std::swap(order[i], order[rngenerator() % (i + 1)]);
+      }
+
+      for (auto arg : order) {
+        if (assigned[arg]) {
+          continue;
+        }
+        best_gain = -1;
+        best_val = 0;
+        start = rngenerator() % pool_sizes[arg];
+        for (i = 0; i < pool_sizes[arg]; i++) {
+          row[arg] = (start + i) % pool_sizes[arg];
+          gain = 0;
+          for (auto s : arg_subsets[arg]) {
+            complete = true;
+            for (auto other : subsets[s]) {
+              if (other != arg && !assigned[other]) {
+                complete = false;
+                break;
+              }
+            }
+            if (complete && !covered[tuple_index(s)]) {
+              gain++;
+            }
+          }
+          if (gain > best_gain) {
+            best_gain = gain;
+            best_val = row[arg];
+          }
+        }
+        row[arg] = best_val;
+        assigned[arg] = true;
+      }
+
+      for (i = 0; i < (int) subsets.size(); i++) {
+        tuple = tuple_index(i);
+        if (!covered[tuple]) {
+          covered[tuple] = true;
+          uncovered--;
+        }
+      }
+      rows.insert(rows.end(), row.begin(), row.end());
+    }
+
+    return rows.size() / nargs;
+  }
+
+  /* A cached covering array, if it is for pool_sizes and whole */
+  static bool read_covering_array(const std::string& filename, const std::vector<int>& pool_sizes, int strength,
+                                  std::vector<int>& rows)
+  {
+    struct covering_header header = {};
+    std::vector<int> sizes(pool_sizes.size());
+    std::ifstream file(filename, std::ios::binary);
+    int nargs = pool_sizes.size();
+
+    if (!file.read((char *) &header, sizeof(header)) || header.magic != COVERING_MAGIC ||
+        header.strength != strength || header.rng_seed != RAND_SEED || header.num_args != nargs ||
+        header.num_rows <= 0) {
+      return false;
+    }
+
+    if (!file.read((char *) sizes.data(), nargs * sizeof(int)) || sizes != pool_sizes) {
+      return false;
+    }
+
+    rows.resize(header.num_rows * nargs);
+    if (!file.read((char *) rows.data(), rows.size() * sizeof(int))) {
+      rows.clear();
+      return false;
+    }
+
+    /* The rows index the pools, don't trust them */
+    for (size_t i = 0; i < rows.size(); i++) {
+      if (rows[i] < 0 || rows[i] >= pool_sizes[i % nargs]) {
+        rows.clear();
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  /* Written aside and renamed, so other processes only see it whole */
+  static void write_covering_array(const std::string& filename, const std::vector<int>& pool_sizes, int strength,
+                                   const std::vector<int>& rows)
+  {
+    std::string tmp_filename = filename + "." + std::to_string(::getpid());
+    struct covering_header header = {};
+    std::ofstream file(tmp_filename, std::ios::binary | std::ios::trunc);
+
+    header.magic = COVERING_MAGIC;
+    header.strength = strength;
+    header.rng_seed = RAND_SEED;
+    header.num_args = pool_sizes.size();
+    header.num_rows = rows.size() / pool_sizes.size();
+
+    file.write((const char *) &header, sizeof(header));
+    file.write((const char *) pool_sizes.data(), pool_sizes.size() * sizeof(int));
+    file.write((const char *) rows.data(), rows.size() * sizeof(int));
+    file.close();
+
+    if (file.fail() || rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+      std::remove(tmp_filename.c_str());
+    }
+  }
+
+  /*
+   * The covering array only depends on the pool sizes, the strength and the
+   * seed, so it is built once and cached in results_dir under a name keyed by
+   * them. Restarts and other kernels with the same pools load it instead of
+   * building it again. Each kernel's number of arguments, rows and build time
+   * in ms (0 if loaded) go to covering_arrays.txt.
+   */
+  long long Fuzzer::get_covering_array()
+  {
+    std::string filename;
+    std::fstream covering_log_file;
+    struct timespec start_ts = {}, end_ts = {}, diff_ts = {};
+    uint64_t key = FNV_OFFSET_BASIS;
+    int strength = IVYSYN_COVERING_STRENGTH;
+    long long build_ms = 0;
+    char key_hex[17];
+
+    key = fnv1a(key, pool_sizes.data(), pool_sizes.size() * sizeof(int));
+    snprintf(key_hex, sizeof(key_hex), "%016llx", (unsigned long long) key);
+    filename = std::string(results_dir) + "/covering." + std::to_string(strength) + "." + key_hex;
+
+    covering_rows.clear();
+    if (!read_covering_array(filename, pool_sizes, strength, covering_rows)) {
+      clock_gettime(CLOCK_MONOTONIC, &start_ts);
+      build_covering_array(pool_sizes, strength, covering_rows);
+      clock_gettime(CLOCK_MONOTONIC, &end_ts);
+      diff_ts = time_diff(start_ts, end_ts);
+      build_ms = diff_ts.tv_sec * 1000 + diff_ts.tv_nsec / 1000000;
+      write_covering_array(filename, pool_sizes, strength, covering_rows);
+    }
+
+    covering_log_file.open(std::string(results_dir) + "/covering_arrays.txt", std::ios::out | std::ios::app);
+    covering_log_file << cur_fname << ":" << pool_sizes.size() << ":" << covering_rows.size() / pool_sizes.size()
+                      << ":" << build_ms << std::endl;
+    covering_log_file.close();
+
+    return covering_rows.size() / pool_sizes.size();
+  }
+#endif
+
   void Fuzzer::calculate_total_mutations() {
 
     fuzzing::TorchType type_enum;
@@ -1787,6 +2891,14 @@ Fuzzer::Fuzzer(char *fname, std::vector<std::string> types_vec, std::vector<void
       create_file(overflow_filename, overflow_file, std::ios::out | std::ios::in | std::ios::trunc);
     }
 
+#if defined(IVYSYN_COVERING_STRENGTH)
+    /* Too many combinations to run them all, only run the covering rows */
+    if (total_mutations > NMUT_UPPER_BOUND_MID && (int) pool_sizes.size() > IVYSYN_COVERING_STRENGTH) {
+      total_mutations = get_covering_array();
+      std::cout << "Covering array rows (t=" << IVYSYN_COVERING_STRENGTH << "): " << total_mutations << std::endl;
+    }
+#endif
+
     nmut_fuzz = total_mutations;
     num_mut_skip = 1;
 
@@ -1822,6 +2934,103 @@ Fuzzer::Fuzzer(char *fname, std::vector<std::string> types_vec, std::vector<void
 
   }
 
+  /*
+   * Halve the largest dimension until a tensor of dims fits in what is left of
+   * POOL_BYTES_BUDGET. Works on a copy since the pool keeps growing the
+   * original dims, and doesn't draw from the generator, so the rest of the
+   * pool comes out the same.
+   */
+  std::vector<int64_t> Fuzzer::fit_dims_to_budget(std::vector<int64_t> dims, size_t elem_size)
+  {
+
+    size_t left = 0, pool_bytes;
+    int64_t nelems;
+    size_t nbytes;
+    bool overflow;
+
+    pool_bytes = get_pool_bytes();
+    if (pool_bytes < POOL_BYTES_BUDGET) {
+      left = POOL_BYTES_BUDGET - pool_bytes;
+    }
+
+    while (!dims.empty()) {
+      nelems = 1;
+      overflow = false;
+      for (auto d : dims) {
+        overflow |= __builtin_mul_overflow(nelems, d, &nelems);
+      }
+      overflow |= __builtin_mul_overflow((size_t) nelems, elem_size, &nbytes);
+      if (!overflow && nbytes <= left) {
+        break;
+      }
+      auto largest = std::max_element(dims.begin(), dims.end());
+      *largest = *largest / 2;
+    }
+
+    return dims;
+  }
+
+  /*
+   * at::full() of dims fitted to the budget, except that large zero tensors
+   * on the CPU come from the zero page allocator and are never written here.
+   * Those cost next to nothing, so they keep their dims.
+   */
+  at::Tensor Fuzzer::get_full_tensor(std::vector<int64_t> dims, at::Scalar value, at::TensorOptions options)
+  {
+
+    size_t elem_size = c10::elementSize(c10::typeMetaToScalarType(options.dtype()));
+    size_t nbytes = elem_size;
+    bool overflow = false;
+    c10::DataPtr data;
+
+    for (auto d : dims) {
+      overflow |= __builtin_mul_overflow(nbytes, (size_t) d, &nbytes);
+    }
+
+    if (value.toDouble() == 0 && options.device().is_cpu() && !options.requires_grad() &&
+        !overflow && nbytes >= ZERO_PAGE_MIN_BYTES) {
+      data = zero_page_allocator()->allocate(nbytes);
+      if (data.get() != nullptr) {
+        c10::Storage storage(c10::Storage::use_byte_size_t(), nbytes, std::move(data), zero_page_allocator(), false);
+        return at::empty({0}, options).set_(storage, 0, dims);
+      }
+    }
+
+    return at::full(fit_dims_to_budget(dims, elem_size), value, options);
+  }
+
+#if defined(IVYSYN_GUARD_PAGES)
+  /*
+   * Copy of tensor in a buffer from the guard page allocator. Only for dense
+   * CPU tensors, anything else (and zero page tensors) is returned as is
+   */
+  at::Tensor Fuzzer::guard_tensor(const at::Tensor& tensor)
+  {
+
+    at::Tensor src, guarded;
+    c10::DataPtr data;
+    size_t nbytes;
+
+    if (!tensor.defined() || tensor.layout() != at::kStrided || !tensor.device().is_cpu() ||
+        tensor.storage().allocator() == zero_page_allocator()) {
+      return tensor;
+    }
+
+    src = tensor.contiguous();
+    nbytes = src.nbytes();
+    data = guard_page_allocator()->allocate(nbytes);
+    if (nbytes > 0) {
+      memcpy(data.get(), src.data_ptr(), nbytes);
+    }
+
+    c10::Storage storage(c10::Storage::use_byte_size_t(), nbytes, std::move(data), guard_page_allocator(), false);
+    guarded = at::empty({0}, src.options().requires_grad(false)).set_(storage, 0, src.sizes(), src.strides());
+    guarded.requires_grad_(tensor.requires_grad());
+
+    return guarded;
+  }
+#endif
+
   /* Creates all the tensor mutations */
   void Fuzzer::initialize_tensor_pool(){
 
@@ -1885,7 +3094,7 @@ Fuzzer::Fuzzer(char *fname, std::vector<std::string> types_vec, std::vector<void
       options = c10::TensorOptions()
         .device(tensor_dev)
         .dtype(c10::kLong);
-      tensor = at::full(fuzz_dims_vec, fuzzval, options);
+      tensor = get_full_tensor(fuzz_dims_vec, fuzzval, options);
       tensor_mutations.push_back(tensor);
       tensor_contents.push_back(fuzzval);
 
@@ -1896,7 +3105,7 @@ Fuzzer::Fuzzer(char *fname, std::vector<std::string> types_vec, std::vector<void
         .device(tensor_dev)
         .dtype(c10::kDouble);
         /* .requires_grad(true); */
-      tensor = at::full(fuzz_dims_vec, dfuzzval, options);
+      tensor = get_full_tensor(fuzz_dims_vec, dfuzzval, options);
       tensor_mutations.push_back(tensor);
       tensor_contents.push_back(dfuzzval);
 
@@ -1947,6 +3156,12 @@ Fuzzer::Fuzzer(char *fname, std::vector<std::string> types_vec, std::vector<void
     tensor_mutations.push_back(tensor);
     tensor_contents.push_back( (double) LARGE_FLOAT_FUZZ);
 
+#if defined(IVYSYN_GUARD_PAGES)
+    for (auto &guarded : tensor_mutations) {
+      guarded = guard_tensor(guarded);
+    }
+#endif
+
     /* std::cout << "Created tensor pool" << std::endl; */
   }
 
@@ -2018,7 +3233,7 @@ Fuzzer::Fuzzer(char *fname, std::vector<std::string> types_vec, std::vector<void
 
   void Fuzzer::initialize_intarrayref_pool(){
 
-    long int *data;
+    int64_t *data;
     at::IntArrayRef arr_ref;
     std::mt19937 rngenerator(RAND_SEED);
     std::uniform_int_distribution<> long_distr(0, long_mutations.size() - 1);
@@ -2028,11 +3243,12 @@ Fuzzer::Fuzzer(char *fname, std::vector<std::string> types_vec, std::vector<void
     /* Same sizes as originals, all long values */
     for (auto &sz : intarrayref_sizes) {
       for (auto &fuzzval : long_mutations) {
-        data = new long int[sz];
+        intarray_data.emplace_back(sz);
+        data = intarray_data.back().data();
         for (int l = 0; l < sz; l++) {
           data[l] = fuzzval;
         }
-        arr_ref = *(new at::IntArrayRef(data, sz));
+        arr_ref = at::IntArrayRef(data, sz);
         intarrayref_mutations.push_back(arr_ref);
       }
     }
@@ -2040,7 +3256,8 @@ Fuzzer::Fuzzer(char *fname, std::vector<std::string> types_vec, std::vector<void
     /* Arrays of increasing dimensions, random values, some 0 */
     for (int dim = 0; dim < MAX_TENSOR_DIMS_FUZZ; dim += TENSOR_NUM_DIMS_FUZZ) {
       fuzzval = long_mutations.at(long_distr(rngenerator));
-      data = new long int[dim];
+      intarray_data.emplace_back(dim);
+      data = intarray_data.back().data();
       for (int l = 0; l < dim; l++) {
         if (flip(rngenerator)) {
           data[l] = fuzzval;
@@ -2048,12 +3265,73 @@ Fuzzer::Fuzzer(char *fname, std::vector<std::string> types_vec, std::vector<void
           data[l] = 0;
         }
       }
-      arr_ref = *(new at::IntArrayRef(data, dim));
+      arr_ref = at::IntArrayRef(data, dim);
       intarrayref_mutations.push_back(arr_ref);
     }
 
   }
 
+  /*
+   * What a pool tensor takes once filled: nothing for the zero page, see
+   * ZeroPageAllocator, and whole pages for the guard pages
+   */
+  static size_t backed_bytes(const at::Tensor& tensor)
+  {
+
+    if (!tensor.has_storage()) {
+      return tensor.nbytes();
+    }
+    if (tensor.storage().allocator() == zero_page_allocator()) {
+      return 0;
+    }
+#if defined(IVYSYN_GUARD_PAGES)
+    if (tensor.storage().allocator() == guard_page_allocator()) {
+      size_t page_size = sysconf(_SC_PAGESIZE);
+      return ((tensor.nbytes() + page_size - 1) / page_size) * page_size;
+    }
+#endif
+
+    return tensor.nbytes();
+  }
+
+  size_t Fuzzer::get_pool_bytes()
+  {
+    size_t bytes = 0;
+
+    for (auto &tensor : tensor_mutations) {
+      /* Sparse/mkldnn tensors don't have a flat storage to count */
+      if (tensor.defined() && tensor.layout() == at::kStrided) {
+        bytes += backed_bytes(tensor);
+      }
+    }
+    for (auto &data : intarray_data) {
+      bytes += data.size() * sizeof(int64_t);
+    }
+    for (auto &data : doublearray_data) {
+      bytes += data.size() * sizeof(double);
+    }
+
+    return bytes;
+  }
+
+  /* Log how much memory the mutation pools of this kernel take */
+  void Fuzzer::log_pool_bytes()
+  {
+    std::string pool_bytes_filename;
+    std::fstream pool_bytes_file;
+
+    pool_bytes_filename = std::string(results_dir) + "/pool_bytes.txt";
+    pool_bytes_file.open(pool_bytes_filename, std::ios::out | std::ios::app);
+    if (pool_bytes_file.fail()) {
+      std::cout << "Failed to open " << pool_bytes_filename << std::endl;
+      std::cout << "Error: " << strerror(errno) << std::endl;
+      return;
+    }
+
+    pool_bytes_file << cur_fname << ":" << get_pool_bytes() << std::endl;
+    pool_bytes_file.close();
+  }
+
   void Fuzzer::initialize_doublearrayref_pool() {
 
     double *data;
@@ -2064,17 +3342,19 @@ Fuzzer::Fuzzer(char *fname, std::vector<std::string> types_vec, std::vector<void
 
     for (auto &sz : doublearrayref_sizes) {
       for (auto &fuzzval : double_mutations) {
-        data = new double[sz];
+        doublearray_data.emplace_back(sz);
+        data = doublearray_data.back().data();
         for (int l = 0; l < sz; l++) {
           data[l] = fuzzval;
         }
-        arr_ref = *(new at::ArrayRef<double>(data, sz));
+        arr_ref = at::ArrayRef<double>(data, sz);
         doublearrayref_mutations.push_back(arr_ref);
       }
     }
 
     for (auto &fuzzval : double_mutations) {
-      data = new double[ARRAYREF_LEN];
+      doublearray_data.emplace_back(ARRAYREF_LEN);
+      data = doublearray_data.back().data();
       for (int l = 0; l < ARRAYREF_LEN; l++) {
         if (flip(rngenerator)) {
           data[l] = fuzzval;
@@ -2082,7 +3362,7 @@ Fuzzer::Fuzzer(char *fname, std::vector<std::string> types_vec, std::vector<void
           data[l] = 0.0;
         }
       }
-      arr_ref = *(new at::ArrayRef<double>(data, ARRAYREF_LEN));
+      arr_ref = at::ArrayRef<double>(data, ARRAYREF_LEN);
       doublearrayref_mutations.push_back(arr_ref);
     }
   }
@@ -2113,7 +3393,16 @@ Fuzzer::Fuzzer(char *fname, std::vector<std::string> types_vec, std::vector<void
     if (is_running)
       return false;
 
-    has_more = total_mutations > 0;
+#if defined(IVYSYN_FORK_SERVER)
+    if (!fork_server_started) {
+      fork_server_started = true;
+      if (!run_fork_server()) {
+        return false;
+      }
+    }
+#endif
+
+    has_more = total_mutations > (main_pool_done ? 0 : shard_stop);
 
     if (has_more && reset) {
       cur_idx = 0;
@@ -2121,12 +3410,19 @@ Fuzzer::Fuzzer(char *fname, std::vector<std::string> types_vec, std::vector<void
     }
 
     if (!has_more) {
+#if defined(IVYSYN_NUM_SHARDS)
+      /* The zero-dim pool is small, the first shard runs all of it */
+      if (shard != 0) {
+        main_pool_done = true;
+      }
+#endif
       if (!main_pool_done) {
         /* std::cout << "Main pool done for " << cur_fname << ", creating secondary pool" << std::endl << std::flush; */
         if (zero_dim_mutations == 0) {
           mark_fuzzing_done();
           std::remove(mutations_logger_filename.c_str());
-          std::remove(timestamp_logger_filename.c_str());
+          unmap_progress_slot(progress);
+          progress = nullptr;
         } else {
           std::ios_base::openmode fflags = std::ios::out | std::ios::in | std::ios::trunc;
           std::string zero_muts_filename = std::string(results_dir) + "/" + cur_fname + ".zero_muts";
@@ -2144,62 +3440,188 @@ Fuzzer::Fuzzer(char *fname, std::vector<std::string> types_vec, std::vector<void
       } else {
         mark_fuzzing_done();
         std::remove(mutations_logger_filename.c_str());
-        std::remove(timestamp_logger_filename.c_str());
+        unmap_progress_slot(progress);
+        progress = nullptr;
       }
     }
 
+#if defined(IVYSYN_FORK_SERVER)
+    /* The parent runs the original kernel once we are gone */
+    if (!has_more && in_fork_child) {
+      std::cout << std::flush;
+      _exit(0);
+    }
+#endif
+
     return has_more;
   }
 
+#if defined(IVYSYN_PERMUTE_MUTATIONS)
+  /* splitmix64 finalizer, used as the Feistel round function */
+  static inline unsigned long long mix64(unsigned long long x)
+  {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+  }
+
+  /*
+   * Keyed bijection of [0, n) onto itself: a 4-round Feistel network over
+   * the smallest even number of bits that holds n, cycle-walking until the
+   * result is back in range. The network's domain is under 4n, so that takes
+   * less than 4 walks on average. Anything outside [0, n) is left alone.
+   */
+  static long long permute_mutation(long long passed, long long n)
+  {
+    unsigned long long x, left, right, tmp, mask;
+    int half_bits = 1;
+
+    if (passed < 0 || passed >= n) {
+      return passed;
+    }
+
+    while (half_bits < 32 && (1ULL << (2 * half_bits)) < (unsigned long long) n) {
+      half_bits++;
+    }
+    mask = (1ULL << half_bits) - 1;
+
+    x = passed;
+    do {
+      left = x >> half_bits;
+      right = x & mask;
+      for (int round = 0; round < 4; round++) {
+        tmp = right;
+        right = left ^ (mix64(right ^ mix64(RAND_SEED + round)) & mask);
+        left = tmp;
+      }
+      x = (left << half_bits) | right;
+    } while (x >= (unsigned long long) n);
+
+    return x;
+  }
+#endif
+
+  /*
+   * Mixed-radix decode of the number of mutations passed into the per-argument
+   * pool indices (first argument changes fastest). With IVYSYN_PERMUTE_MUTATIONS
+   * the number is shuffled first, so strided runs sample the whole space.
+   */
+  void Fuzzer::decode_mutation_indices(long long passed)
+  {
+
+#if defined(IVYSYN_COVERING_STRENGTH)
+    /*
+     * Mutation number is the covering array row. The last step lands one past
+     * the last row (see calculate_total_mutations()), which wraps around to
+     * the first one, as the mixed-radix decode does
+     */
+    if (!covering_rows.empty()) {
+      passed %= (long long) (covering_rows.size() / pool_sizes.size());
+      for (int i = 0; i < pool_sizes.size(); i++) {
+        indices[i] = covering_rows[passed * pool_sizes.size() + i];
+      }
+      return;
+    }
+#endif
+
+#if defined(IVYSYN_PERMUTE_MUTATIONS)
+    passed = permute_mutation(passed, all_mutations);
+#endif
+
+    for (int i = 0; i < pool_sizes.size(); i++) {
+      indices[i] = passed % pool_sizes[i];
+      passed = passed / pool_sizes[i];
+    }
+  }
+
+  /*
+   * Jump straight to a logged mutation number of the main pool. Equivalent to
+   * calling next_mutations_indices(false) until total_mutations reaches
+   * mutation, without walking the (up to NMUT_UPPER_BOUND_MID) steps in between.
+   * Returns false if mutation can not be reached with the current step size.
+   */
+  bool Fuzzer::seek_mutation(long long mutation)
+  {
+
+    long long steps;
+
+    steps = total_mutations - mutation;
+    if (steps < 0 || steps % num_mut_skip != 0) {
+      return false;
+    }
+
+    /* Nothing was run yet, keep the indices as they are */
+    if (steps == 0) {
+      return true;
+    }
+
+    total_mutations = mutation;
+    decode_mutation_indices(all_mutations - total_mutations);
+
+    return true;
+  }
+
+  /*
+   * Of the main pool mutation the indices are at, the argument whose pool
+   * index is the only one that differs from the last mutation that returned.
+   * That one is likely what made it crash, -1 if there is no such mutation or
+   * more than one argument changed since.
+   */
+  int Fuzzer::find_failing_arg()
+  {
+
+    std::vector<int> failing_indices;
+    int failing_arg = -1;
+
+    if (main_pool_done || progress == nullptr || progress->last_ok_mutation < 0) {
+      return -1;
+    }
+
+    failing_indices = indices;
+    decode_mutation_indices(all_mutations - progress->last_ok_mutation);
+
+    for (int i = 0; i < (int) pool_sizes.size(); i++) {
+      if (indices[i] == failing_indices[i]) {
+        continue;
+      }
+      if (failing_arg >= 0) {
+        failing_arg = -1;
+        break;
+      }
+      failing_arg = i;
+    }
+
+    indices = failing_indices;
+
+    return failing_arg;
+  }
+
   /* Skips ahead num_mut_skip mutations to bound the total mutations */
   void Fuzzer::next_mutations_indices(bool log)
   {
 
-    pid_t mypid = 0;
-    std::string mut_filename;
-    std::string last_timestamp_filename;
-    std::ios_base::openmode fflags = std::ios::out | std::ios::in | std::ios::trunc;
-    char logbuf[LOGBUFSZ];
     struct timespec ts = {};
-    memset(logbuf, 0, LOGBUFSZ);
 
     if (!main_pool_done) {
       total_mutations -= num_mut_skip;
-
-      long long passed = all_mutations - total_mutations;
-      for (int i = 0; i < pool_sizes.size(); i++) {
-        indices[i] = passed % pool_sizes[i];
-        passed = passed / pool_sizes[i];
-      }
+      decode_mutation_indices(all_mutations - total_mutations);
     } else {
       total_mutations--;
     }
 
     if (log) {
 
-      if (!mutations_file.is_open()) {
-        mypid = ::getpid();
-        mut_filename = std::string(results_dir) + "/" + cur_fname + "_mutations.log." + std::to_string(mypid);
-        create_file(mut_filename, mutations_file, fflags);
+      if (progress == nullptr) {
+        progress = map_progress_slot(mutations_logger_filename, cur_fname);
       }
-      mutations_file.seekp(0, std::ios::beg);
-      sprintf(logbuf, "%llu", total_mutations);
-      mutations_file.clear();
-      mutations_file.write(logbuf, LOGBUFSZ);
-      mutations_file.flush();
 
-      if (!last_timestamp_file.is_open()) {
-        mypid = ::getpid();
-        last_timestamp_filename = std::string(results_dir) + "/" + cur_fname + ".last_timestamp." + std::to_string(mypid);
-        create_file(last_timestamp_filename, last_timestamp_file, fflags);
+      if (progress != nullptr) {
+        /* Seconds are enough for the crash time, the coarse clock is cheaper */
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        progress->timestamp = ts.tv_sec;
+        progress->mutation = total_mutations;
       }
-
-      last_timestamp_file.seekp(0, std::ios::beg);
-      memset(logbuf, 0, LOGBUFSZ);
-      clock_gettime(CLOCK_MONOTONIC, &ts);
-      sprintf(logbuf, "%lld", (long long) ts.tv_sec);
-      last_timestamp_file.write(logbuf, LOGBUFSZ);
-      last_timestamp_file.flush();
     }
   }
 
@@ -2246,13 +3668,222 @@ Fuzzer::Fuzzer(char *fname, std::vector<std::string> types_vec, std::vector<void
     done_file << ts.tv_sec << std::endl;
     done_file.close();
 
+#if defined(IVYSYN_NUM_SHARDS)
+    merge_shards();
+#endif
+
     /* Set mutations to zero to stop fuzzing */
     total_mutations = 0;
   }
 
+  /*
+   * HANG_P99_FACTOR times the p99 of the mutations timed so far, read off the
+   * top of its bucket, never more than TIMEOUT_SECS. Until there are enough
+   * of them to go by, HANG_COLD_SECS. The times are kept in the progress
+   * slot, so fork server children and restarts go on from them.
+   */
+  long long Fuzzer::hang_deadline_ns()
+  {
+    unsigned long long seen = 0, rank;
+    double deadline;
+    int bucket;
+
+    if (progress == nullptr || progress->hang_samples < HANG_MIN_SAMPLES) {
+      return (long long) HANG_COLD_SECS * NS_PER_SEC;
+    }
+
+    rank = progress->hang_samples - progress->hang_samples / 100;
+    for (bucket = 0; bucket < HANG_NUM_BUCKETS - 1; bucket++) {
+      seen += progress->hang_buckets[bucket];
+      if (seen >= rank) {
+        break;
+      }
+    }
+
+    deadline = HANG_P99_FACTOR * std::ldexp(1.0, bucket + 1);
+    deadline = std::max(deadline, (double) HANG_MIN_SECS * NS_PER_SEC);
+    deadline = std::min(deadline, (double) TIMEOUT_SECS * NS_PER_SEC);
+
+    return (long long) deadline;
+  }
+
+  /*
+   * One shot timer on the fuzzing thread, so SIGALRM interrupts the mutation
+   * itself. Timers don't survive a fork, each fork server child makes its own.
+   */
+  void Fuzzer::arm_watchdog()
+  {
+    struct sigevent sev = {};
+    struct itimerspec its = {};
+    long long deadline;
+
+    if (hang_timer_pid != ::getpid()) {
+      sev.sigev_notify = SIGEV_THREAD_ID;
+      sev.sigev_signo = SIGALRM;
+      sev.sigev_notify_thread_id = syscall(SYS_gettid);
+      if (timer_create(CLOCK_MONOTONIC, &sev, &hang_timer) != 0) {
+        std::cout << "Failed to create the watchdog for " << cur_fname << std::endl;
+        std::cout << "Error: " << strerror(errno) << std::endl;
+        return;
+      }
+      hang_timer_pid = ::getpid();
+    }
+
+    deadline = hang_deadline_ns();
+    its.it_value.tv_sec = deadline / NS_PER_SEC;
+    its.it_value.tv_nsec = deadline % NS_PER_SEC;
+    timer_settime(hang_timer, 0, &its, NULL);
+  }
+
+  void Fuzzer::disarm_watchdog()
+  {
+    struct itimerspec its = {};
+
+    if (hang_timer_pid == ::getpid()) {
+      timer_settime(hang_timer, 0, &its, NULL);
+    }
+  }
+
+  /* Whether the watchdog stopped the process on last_mutation */
+  bool Fuzzer::was_hung(long long last_mutation)
+  {
+    std::ifstream hang_file(hang_filename);
+    long long mutation;
+
+    if (!(hang_file >> mutation)) {
+      return false;
+    }
+
+    return mutation == last_mutation;
+  }
+
+#if defined(IVYSYN_SLOW_INPUTS)
+  /* Four buckets per power of two, the first few nanoseconds get one each */
+  static inline int slow_time_bucket(long long duration)
+  {
+    int exp;
+
+    if (duration < 4) {
+      return duration > 0 ? duration : 0;
+    }
+
+    exp = 63 - __builtin_clzll(duration);
+    return exp * 4 + ((duration >> (exp - 2)) & 3);
+  }
+
+  /* Middle of a bucket */
+  static inline double slow_bucket_ns(int bucket)
+  {
+    int exp = bucket / 4;
+
+    if (bucket < 4) {
+      return bucket;
+    }
+
+    return std::ldexp(4 + bucket % 4 + 0.5, exp - 2);
+  }
+
+  /*
+   * Median of the durations in hist, and their MAD: the deviations grow
+   * going out from the median bucket on either side, so walk out from it
+   * until half of the samples are covered.
+   */
+  static void slow_median_mad(const uint32_t *hist, unsigned long long samples, double *median, double *mad)
+  {
+    unsigned long long seen = 0;
+    double lo_dev, hi_dev, dev = 0;
+    int bucket, lo, hi;
+
+    for (bucket = 0; bucket < SLOW_TIME_BUCKETS - 1; bucket++) {
+      seen += hist[bucket];
+      if (2 * seen >= samples) {
+        break;
+      }
+    }
+    *median = slow_bucket_ns(bucket);
+
+    seen = 0;
+    lo = bucket;
+    hi = bucket + 1;
+    while (2 * seen < samples && (lo >= 0 || hi < SLOW_TIME_BUCKETS)) {
+      lo_dev = lo >= 0 ? *median - slow_bucket_ns(lo) : HUGE_VAL;
+      hi_dev = hi < SLOW_TIME_BUCKETS ? slow_bucket_ns(hi) - *median : HUGE_VAL;
+      if (lo_dev <= hi_dev) {
+        seen += hist[lo--];
+        dev = lo_dev;
+      } else {
+        seen += hist[hi++];
+        dev = hi_dev;
+      }
+    }
+    *mad = dev;
+  }
+
+  /*
+   * Compare the mutation that just ran with the ones before it with about as
+   * many tensor elements, log it to <kernel>.slow if it is an outlier, and
+   * add it to the model
+   */
+  void Fuzzer::check_slow_input(long long duration)
+  {
+    unsigned long long elements = 0;
+    std::string slow_filename;
+    std::fstream slow_file;
+    double median, mad;
+    uint32_t *hist;
+    int size_bucket;
+    at::Tensor tensor;
+
+    if (slow_hist.empty()) {
+      slow_hist.assign(SLOW_SIZE_BUCKETS * SLOW_TIME_BUCKETS, 0);
+      slow_samples.assign(SLOW_SIZE_BUCKETS, 0);
+    }
+
+    for (size_t idx = 0; idx < func_types.size(); idx++) {
+      switch (func_types[idx]) {
+        case fuzzing::FUZZ_TENSOR:
+        case fuzzing::FUZZ_C10OPTIONAL_TENSOR:
+          tensor = tensor_mutations.at(indices[idx]);
+          break;
+        case fuzzing::FUZZ_SPARSE_TENSOR:
+          tensor = sparse_tensor_mutations.at(indices[idx]);
+          break;
+        default:
+          continue;
+      }
+      if (tensor.defined()) {
+        elements += tensor.numel();
+      }
+    }
+
+    size_bucket = elements > 0 ? std::min(64 - __builtin_clzll(elements), SLOW_SIZE_BUCKETS - 1) : 0;
+    hist = &slow_hist[size_bucket * SLOW_TIME_BUCKETS];
+
+    if (duration >= SLOW_MIN_NS && slow_samples[size_bucket] >= SLOW_MIN_SAMPLES) {
+      slow_median_mad(hist, slow_samples[size_bucket], &median, &mad);
+      /* 1.4826 scales the MAD to a standard deviation */
+      if (duration > median + SLOW_MAD_FACTOR * 1.4826 * mad && duration > SLOW_MIN_RATIO * median) {
+        slow_filename = std::string(results_dir) + "/" + cur_fname + ".slow";
+        slow_file.open(slow_filename, std::ios::out | std::ios::app);
+        slow_file << "mutation:" << total_mutations << " elements:" << elements << " duration_ns:" << duration
+                  << " median_ns:" << (long long) median << " mad_ns:" << (long long) mad << std::endl;
+        /* Goes through the arguments again */
+        cur_idx = 0;
+        log_current_mutation(slow_file);
+        slow_file.close();
+      }
+    }
+
+    hist[slow_time_bucket(duration)]++;
+    slow_samples[size_bucket]++;
+  }
+#endif
+
   void Fuzzer::mut_start_time()
   {
 
+    arm_watchdog();
+
     if (main_pool_done) {
       return;
     }
@@ -2264,60 +3895,31 @@ Fuzzer::Fuzzer(char *fname, std::vector<std::string> types_vec, std::vector<void
   {
 
     struct timespec duration_ts = {};
-    struct stat stat_buffer = {};
-    std::ios_base::openmode fflags = std::ios::out | std::ios::in;
-    /* std::string duration_filename; */
-    /* std::fstream duration_file; */
-    /* char logbuf[LOGBUFSZ]; */
-    /* memset(logbuf, 0, LOGBUFSZ); */
 
     clock_gettime(CLOCK_MONOTONIC, &end_time);
 
+    disarm_watchdog();
+
     duration_ts = time_diff(start_time, end_time);
     int64_t duration = duration_ts.tv_sec * NS_PER_SEC + duration_ts.tv_nsec;
 
-    /* Log successful and failed mutations in different files */
+    /* The zero-dim pool isn't timed */
+    if (!main_pool_done) {
+      if (progress != nullptr) {
+        progress->hang_buckets[duration > 0 ? 63 - __builtin_clzll(duration) : 0]++;
+        progress->hang_samples++;
+        progress->last_ok_mutation = total_mutations;
+      }
+#if defined(IVYSYN_SLOW_INPUTS)
+      check_slow_input(duration);
+#endif
+    }
+
     if (!failed) {
-      /* time_file.write(logbuf, LOGBUFSZ) << ":" << duration << std::endl << std::flush; */
-      time_file << total_mutations << ":" << duration << std::endl << std::flush;
+      log_mutation_record(total_mutations, duration, MUT_STATUS_OK, -1);
     } else {
-      /* except_file.write(logbuf, LOGBUFSZ) << ":" << duration << std::endl << std::flush; */
-      except_file << total_mutations << ":" << duration << std::endl << std::flush;
-    }
-
-    ///* Log mutations that took more than THRESH seconds to finish */
-    //if (duration_secs > TIME_THRESH_SECS) {
-    //  /*
-    //   * We want to log the mutation that just run, so this will achieve it:
-    //   * 1. Move to the mutation BEFORE the mutation that just run
-    //   * 2. Call next_mutations_indices to set up the indices array correctly
-    //   * for the mutation after that, which is the mutation that just run
-    //   * 3. Call log_current_mutation to log it
-    //   * 4. When the fuzzed function calls has_more_mutations,
-    //   * next_mutations_indices will be called again and will move to the next
-    //   * mutation
-    //   */
-    //  total_mutations += (num_mut_skip * 2);
-    //  next_mutations_indices(false);
-
-    //  duration_filename = std::string(results_dir) + "/" + cur_fname + ".duration";
-    //  if (stat(duration_filename.c_str(), &stat_buffer) != 0) {
-    //    fflags |= std::ios::trunc;
-    //    create_file(duration_filename, duration_file, fflags);
-    //  } else {
-    //    duration_file.open(duration_filename, std::ios::app);
-    //    if (duration_file.fail()) {
-    //      std::cout << "Failed to open " << duration_filename << std::endl;
-    //      std::cout << "Error: " << strerror(errno) << std::endl;
-    //    }
-    //  }
-
-    //  duration_file << "Duration (secs): " << duration_secs << std::endl;
-    //  log_current_mutation(duration_file);
-    //  duration_file << std::flush;
-    //  duration_file.close();
-    //}
-
+      log_mutation_record(total_mutations, duration, MUT_STATUS_FAILED, -1);
+    }
   }
 
   double Fuzzer::get_tensor_contents() {
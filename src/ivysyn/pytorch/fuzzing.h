@@ -2,27 +2,58 @@
 #pragma once
 
 //#define IVYSYN_VALIDATE
+/* Run the mutations in a forked child, restarted in-process after a crash */
+//#define IVYSYN_FORK_SERVER
+/*
+ * Run a covering array of this strength (2 or 3) over the argument pools
+ * instead of striding through all their combinations when there are too many
+ */
+//#define IVYSYN_COVERING_STRENGTH 2
+/* Visit the mutations in a seeded pseudo-random order instead of in sequence */
+//#define IVYSYN_PERMUTE_MUTATIONS
+/*
+ * Split the mutations of each kernel into this many shards, fuzzed at the
+ * same time by different processes (or hosts sharing results_dir)
+ */
+//#define IVYSYN_NUM_SHARDS 8
+/* Put the pool tensors right before a PROT_NONE page, so over-reads fault */
+//#define IVYSYN_GUARD_PAGES
+/*
+ * Log the mutations that run far slower than the others with about as many
+ * input elements to <kernel>.slow, to find quadratic paths and huge loops
+ */
+//#define IVYSYN_SLOW_INPUTS
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>         // std::chrono::seconds
+#include <cmath>
 #include <cstdarg>
 #include <cstdio>
 #include <cstdio>
+#include <deque>
 #include <execinfo.h>
 #include <mutex>
 #include <fstream>
 #include <glob.h>
 #include <initializer_list>
 #include <iostream>
+#include <link.h>
 #include <mutex>
 #include <random>
 #include <set>
 #include <signal.h>
 #include <string>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 #include <thread>         // std::this_thread::sleep_for
+#include <time.h>
 #include <unistd.h>
 #include <unordered_map>
 #include <vector>
@@ -56,6 +87,32 @@
 #define TENSOR_NUM_DIMS_FUZZ 5
 #define TENSOR_DIM_SIZE_FUZZ 5
 #define MAX_TENSOR_DIMS_FUZZ 15
+/* Upper bound on the memory of a kernel's mutation pools */
+#define POOL_BYTES_BUDGET (512UL * 1024 * 1024)
+/* Zero tensors at least this big are mapped from the zero page instead of filled */
+#define ZERO_PAGE_MIN_BYTES (64 * 1024)
+/* Freed guarded buffers kept for reuse, per size in pages */
+#define GUARD_FREE_LIST_MAX 64
+/* Start of a guarded buffer, enough for the vectorized CPU kernels */
+#define GUARD_PAGE_ALIGN 16
+/* A mutation hangs after HANG_P99_FACTOR times the p99 of the kernel's mutations */
+#define HANG_P99_FACTOR 10
+#define HANG_MIN_SAMPLES 32
+#define HANG_MIN_SECS 1
+/* Deadline until there are HANG_MIN_SAMPLES mutations to go by */
+#define HANG_COLD_SECS 60
+#define HANG_NUM_BUCKETS 64
+/*
+ * Slow inputs: durations are kept per power of two of input elements, in
+ * buckets of a quarter of a power of two. A mutation is slow when it takes
+ * SLOW_MAD_FACTOR MADs over the median, and at least SLOW_MIN_RATIO times it.
+ */
+#define SLOW_SIZE_BUCKETS 64
+#define SLOW_TIME_BUCKETS (64 * 4)
+#define SLOW_MIN_SAMPLES 16
+#define SLOW_MAD_FACTOR 10
+#define SLOW_MIN_RATIO 4
+#define SLOW_MIN_NS (10 * 1000 * 1000)
 #define MEDIUM_TENSOR_DIMS_FUZZ 10
 #define SMALL_INT_FUZZ 0xfffe
 #define SMALL_INT_NEG_FUZZ -0xfffe
@@ -63,6 +120,29 @@
 #define BUFSZ 0x100
 #define FILENAME_SZ 100
 
+#define PROGRESS_MAGIC 0x49565953
+#define RING_MAGIC 0x49565952
+#define COVERING_MAGIC 0x49565941
+#define RING_NUM_RECORDS 0x1000
+#define RING_DRAIN_MS 50
+#define MAX_KERNEL_IDS 0x10000
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+/*
+ * A crash is bucketed by the hash of the top CRASH_HASH_FRAMES frames of its
+ * stack. Fuzzing a kernel stops after CRASH_DUPLICATES_BOUND crashes in
+ * buckets seen before, or after CRASHES_BOUND crashes in all
+ */
+#define CRASH_MAX_FRAMES 64
+#define CRASH_HASH_FRAMES 8
+#define CRASH_MAX_MODULES 512
+#define CRASH_DUPLICATES_BOUND 3
+#define CRASHES_BOUND 32
+
+/* Only spelled out by newer glibc */
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
 namespace fuzzing {
 
     extern bool already_fuzzing;
@@ -190,9 +270,138 @@ namespace fuzzing {
     };
 
     bool was_fuzzed(const std::string& fname);
+    bool was_fuzzed(int kernel_id, const char *fname);
     bool was_killed(const std::string& fname);
     void create_file(const std::string& filename, std::fstream &file, std::ios_base::openmode fflags);
 
+#if defined(IVYSYN_COVERING_STRENGTH)
+    /*
+     * Header of results_dir/covering.<strength>.<key>, the covering array of
+     * every kernel with the same pool sizes. Followed by the pool sizes and
+     * the rows, as ints.
+     */
+    struct covering_header {
+        uint32_t magic;
+        int32_t strength;
+        int32_t rng_seed;
+        int32_t num_args;
+        int64_t num_rows;
+    };
+#endif
+
+    /*
+     * Progress of the kernel currently being fuzzed by this process. Mapped
+     * shared from <kernel>_mutations.log.<pid> in results_dir and updated with
+     * plain stores on every mutation, so the last mutation survives a crash or
+     * a SIGKILL of the process and can be read back by the next restart.
+     */
+    struct progress_slot {
+        volatile long long mutation;
+        volatile long long timestamp;
+        volatile unsigned int magic;
+        char kernel[FILENAME_SZ];
+        /* Set by the crash handler, only good if crash_mutation is mutation */
+        volatile long long crash_mutation;
+        volatile unsigned long long crash_bucket;
+        volatile int crash_signal;
+        /* The kernel's mutation times, carried over by restarts, see hang_deadline_ns() */
+        volatile unsigned long long hang_buckets[HANG_NUM_BUCKETS];
+        volatile unsigned long long hang_samples;
+        /* Last main pool mutation that returned, -1 if none. Also carried over */
+        volatile long long last_ok_mutation;
+    };
+
+    /*
+     * Cached state of every instrumented kernel, indexed by the id the injection
+     * pass assigned to it (kernel_ids.txt). Mapped shared from
+     * results_dir/kernel_states, so a kernel one process has seen done is done
+     * for all of them. A kernel is done if its entry is generation + 1 (0 is
+     * never seen), so bumping generation (tools/reset_kernel_states.cc)
+     * forgets them all at once, in every process that has the table mapped.
+     */
+    struct kernel_state_table {
+        std::atomic<unsigned int> generation;
+        std::atomic<unsigned int> done[MAX_KERNEL_IDS];
+    };
+
+    struct progress_slot *map_progress_slot(const std::string& filename, const std::string& fname);
+    void unmap_progress_slot(struct progress_slot *slot);
+    bool read_progress_slot(const std::string& filename, long long *mutation, long long *timestamp,
+                            unsigned long long *crash_bucket, int *crash_signal);
+
+    enum mutation_status {
+        MUT_STATUS_OK = 0,
+        MUT_STATUS_FAILED,
+        MUT_STATUS_CRASHED,
+        MUT_STATUS_HANG,
+    };
+
+    /*
+     * Timing record of a single mutation. The <kernel>.time.<pid> files are
+     * plain arrays of these, tools/timings_to_csv.cc converts them to CSV.
+     * failing_arg is only set for crashes and hangs: the one argument whose
+     * pool index differs from the last mutation that returned, see
+     * find_failing_arg(). It is -1 otherwise, or when that is not a single one.
+     */
+    struct mutation_record {
+        long long mutation;
+        long long duration;
+        int status;
+        int failing_arg;
+    };
+
+    /*
+     * Single producer/single consumer ring of mutation records, mapped shared
+     * from <kernel>.ring.<pid> in results_dir. The fuzzing thread moves head
+     * and a drain thread moves tail once the records are written out in
+     * batches, so whatever was not written yet is still in the file if the
+     * process crashes and is recovered by the next restart.
+     */
+    struct mutation_ring {
+        unsigned int magic;
+        std::atomic<unsigned long long> head;
+        std::atomic<unsigned long long> tail;
+        struct mutation_record records[RING_NUM_RECORDS];
+    };
+
+    bool start_mutation_ring(const std::string& ring_filename, const std::string& time_filename);
+    void stop_mutation_ring(const std::string& ring_filename);
+    void recover_mutation_ring(const std::string& ring_filename, const std::string& time_filename);
+    void log_mutation_record(long long mutation, long long duration, int status, int failing_arg);
+
+    /*
+     * Hands out private anonymous mappings, which read as zeros without any
+     * memory behind them until a page is written. Zero filled pool tensors
+     * come from here and are never touched, so only the pages a kernel
+     * actually writes get materialised.
+     */
+    class ZeroPageAllocator : public c10::Allocator {
+    public:
+        c10::DataPtr allocate(size_t nbytes) const override;
+    };
+
+    ZeroPageAllocator *zero_page_allocator();
+
+    /*
+     * Electric fence style allocator. Every buffer ends (as close as the
+     * alignment allows) at a PROT_NONE page, so reading past it faults right
+     * away and shows up as a crash of the mutation. Freed mappings go on a
+     * free list per number of pages instead of back to the kernel.
+     */
+    class GuardPageAllocator : public c10::Allocator {
+    public:
+        c10::DataPtr allocate(size_t nbytes) const override;
+        void release(void *ptr);
+
+    private:
+        mutable std::mutex mu;
+        /* Returned pointer to the start of its mapping and its data pages */
+        mutable std::unordered_map<void *, std::pair<char *, size_t>> mappings;
+        mutable std::unordered_map<size_t, std::vector<char *>> free_lists;
+    };
+
+    GuardPageAllocator *guard_page_allocator();
+
     class Fuzzer {
     private:
 
@@ -221,9 +430,30 @@ namespace fuzzing {
         long long all_mutations;
         int rnd_idx = 0;
         std::string mutations_logger_filename;
-        std::string timestamp_logger_filename;
+        std::string ring_filename;
+        bool owns_ring = false;
+        int lock_fd = -1;
+        long long shard_stop = 0;
+        /* Per-mutation watchdog, power of two buckets of mutation durations */
+        timer_t hang_timer;
+        pid_t hang_timer_pid = 0;
+#if defined(IVYSYN_SLOW_INPUTS)
+        /* SLOW_TIME_BUCKETS duration buckets for each size bucket */
+        std::vector<uint32_t> slow_hist;
+        std::vector<unsigned long long> slow_samples;
+#endif
+#if defined(IVYSYN_NUM_SHARDS)
+        int shard = 0;
+        std::string kernel_fname;
+#endif
+#if defined(IVYSYN_COVERING_STRENGTH)
+        std::vector<int> covering_rows;
+#endif
+#if defined(IVYSYN_FORK_SERVER)
+        bool fork_server_started = false;
+        bool in_fork_child = false;
+#endif
         std::string mutations_restore_filename;
-        std::string timestamp_restore_filename;
         std::string crashes_logger_filename;
         std::vector<int> pool_sizes;
         std::vector<at::IntArrayRef> tensor_dims;
@@ -252,13 +482,44 @@ namespace fuzzing {
         void initialize_sparse_tensor_pool();
         void initialize_tensor_options_pool();
         void initialize_scalar_pool();
+        void log_pool_bytes();
+        size_t get_pool_bytes();
+        std::vector<int64_t> fit_dims_to_budget(std::vector<int64_t> dims, size_t elem_size);
+        at::Tensor get_full_tensor(std::vector<int64_t> dims, at::Scalar value, at::TensorOptions options);
+#if defined(IVYSYN_GUARD_PAGES)
+        at::Tensor guard_tensor(const at::Tensor& tensor);
+#endif
         void initialize_boolarrays();
         void calculate_total_mutations();
         void next_mutations_indices(bool log);
+        void decode_mutation_indices(long long passed);
+        int find_failing_arg();
+        bool seek_mutation(long long mutation);
+        bool lock_kernel_file(const std::string& fname);
+        bool claim_kernel();
+#if defined(IVYSYN_NUM_SHARDS)
+        void set_shard_range();
+        void merge_shards();
+#endif
+#if defined(IVYSYN_COVERING_STRENGTH)
+        long long get_covering_array();
+#endif
+#if defined(IVYSYN_FORK_SERVER)
+        bool run_fork_server();
+#endif
+        void recover_stale_files(const std::string& stale_mutfile);
         inline void inc_mutations_indices(bool log);
-        void restore_last_mutation(long long last_mutation, long long last_timestamp, bool resume);
+        void restore_last_mutation(long long last_mutation, long long last_timestamp,
+                                   unsigned long long crash_bucket, int crash_signal, bool resume);
         void log_current_mutation(std::fstream &file);
-        void increase_num_crashes();
+        long long hang_deadline_ns();
+        void arm_watchdog();
+        void disarm_watchdog();
+        bool was_hung(long long last_mutation);
+#if defined(IVYSYN_SLOW_INPUTS)
+        void check_slow_input(long long duration);
+#endif
+        void increase_num_crashes(unsigned long long crash_bucket, int crash_signal);
         void mark_fuzzing_done();
 
 #endif
@@ -284,6 +545,9 @@ namespace fuzzing {
 
         std::vector<at::IntArrayRef> intarrayref_mutations;
         std::vector<at::ArrayRef<double>> doublearrayref_mutations;
+        /* Backing storage of the ArrayRef mutations, released with the Fuzzer */
+        std::deque<std::vector<int64_t>> intarray_data;
+        std::deque<std::vector<double>> doublearray_data;
         std::vector<at::Tensor> tensor_mutations;
         std::vector<double> tensor_contents;
         std::vector<at::Tensor> sparse_tensor_mutations;
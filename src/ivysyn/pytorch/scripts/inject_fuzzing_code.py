@@ -15,6 +15,7 @@ KERNELS_PATH = os.path.join(PYTORCH_PATH, "aten/src/ATen/native/")
 STATS_PATH = os.path.join(IVYSYN_PATH, "results/pytorch/instrumentation/")
 ATHERIS_COMMON_KERNELS = os.path.join(
     PYTORCH_IVYSYN_PATH, "one_to_one_kernels.txt")
+KERNEL_IDS_FILE = os.path.join(PYTORCH_IVYSYN_PATH, "kernel_ids.txt")
 
 build_include_path = glob.glob(os.path.join(
     PYTORCH_PATH + "build/lib.linux-x86_64*/torch/include"))[0]
@@ -29,6 +30,28 @@ clang_args = [
     "-I" + PYTORCH_PATH + "c10/util",
 ]
 
+# Id of a kernel is its (1-based) line in KERNEL_IDS_FILE, new kernels are
+# appended so ids stay the same across runs. The fuzzer uses it to index the
+# per-kernel state it caches for was_fuzzed()
+kernel_ids = {}
+
+
+def load_kernel_ids():
+    if not os.path.exists(KERNEL_IDS_FILE):
+        return
+    with open(KERNEL_IDS_FILE, "r") as f:
+        for kernel_name in f.read().strip().split("\n"):
+            if kernel_name:
+                kernel_ids[kernel_name] = len(kernel_ids) + 1
+
+
+def get_kernel_id(kernel_name):
+    if kernel_name not in kernel_ids:
+        kernel_ids[kernel_name] = len(kernel_ids) + 1
+        with open(KERNEL_IDS_FILE, "a") as f:
+            f.write(kernel_name + "\n")
+    return kernel_ids[kernel_name]
+
 
 class Parser:
     def __init__(self, filename, function_names, verbose=False, log_types=False, validate=False):
@@ -361,7 +384,7 @@ class Parser:
         # Avoid nested fuzzing or re-fuzzing of the same function
         if not self.log_types and not self.validate:
             wrapper_func.append(
-                f'\tif (!fuzzing::already_fuzzing && !fuzzing::was_fuzzed("{func.spelling}")) {{')
+                f'\tif (!fuzzing::already_fuzzing && !fuzzing::was_fuzzed({get_kernel_id(func.spelling)}, "{func.spelling}")) {{')
 
             # Mark that we are fuzzing to avoid nested fuzzing
             wrapper_func.append("\n\t\tfuzzing::already_fuzzing = true;\n")
@@ -605,6 +628,8 @@ if __name__ == "__main__":
 
     args = args_parser.parse_args()
 
+    load_kernel_ids()
+
     # Need to use the hip modified libclang to parse .hip files, but native one for the rest
     if args.hip_only:
         Config.set_library_path("/opt/rocm-4.3.0/llvm/lib/")
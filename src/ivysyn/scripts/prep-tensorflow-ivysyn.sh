@@ -29,6 +29,10 @@ copy_files()
 {
     echo "Copying ivysyn files..."
     cp ${TF_FILES_PATH}fuzzing* "${TENSORFLOW_PATH}tensorflow/core/framework"
+    mkdir -p "${TENSORFLOW_PATH}tensorflow/tools/ivysyn_replay"
+    cp ${TF_FILES_PATH}replay/* "${TENSORFLOW_PATH}tensorflow/tools/ivysyn_replay"
+    mkdir -p "${TENSORFLOW_PATH}tensorflow/tools/ivysyn_validator"
+    cp ${TF_FILES_PATH}validator/* "${TENSORFLOW_PATH}tensorflow/tools/ivysyn_validator"
     echo "Files copied"
 }
 
@@ -5,130 +5,1594 @@
 
 namespace tffuzzing {
 
-  const char *results_dir = "/mnt/tensorflow-ivysyn";
+  /* Can be pointed elsewhere, e.g. to a directory shared by several hosts */
+  static const char *get_results_dir()
+  {
+    const char *dir = getenv("IVYSYN_RESULTS_DIR");
+    return dir != NULL ? dir : "/mnt/tensorflow-ivysyn";
+  }
+
+  const char *results_dir = get_results_dir();
+
+#if defined(IVYSYN_COVERAGE)
+  /* Updated by the SanitizerCoverage callbacks at the end of this file */
+  unsigned char *cov_seen = nullptr;
+  uint32_t cov_seen_size = 0;
+  uint32_t cov_num_guards = 0;
+  size_t cov_num_pcs = 0;
+  volatile bool cov_active = false;
+  std::atomic<unsigned long long> cov_new_edges(0);
+  unsigned long long cov_calls = 0;
+  double cov_ns_per_call = 0;
+#endif
+
+#if !defined(IVYSYN_VALIDATE) && !defined(IVYSYN_COLLECT_TYPES)
+  bool already_fuzzing = false;
+  const int TIMEOUT_SECS = 1200;
+  const int RNG_SEED = 123;
+  const int NMUT_UPPER_BOUND_MID = 1000000;
+  std::string cur_fname_glob = {};
+
+  static struct progress_slot *progress = nullptr;
+  static std::fstream crashes_file;
+  static std::fstream num_crashes_file;
+  static std::fstream unknown_type_file;
+  static struct mutation_ring *ring = nullptr;
+  static int ring_fd = -1;
+  static std::thread *drain_thread = nullptr;
+  static std::atomic<bool> drain_stop;
+  static char hang_filename[FILENAME_SZ];
+#if defined(IVYSYN_GUARD_OUTPUTS)
+  static tensorflow::OpKernelContext *guarded_ctx = nullptr;
+  static char guard_fault_filename[FILENAME_SZ];
+#endif
+  static std::fstream start_file;
+  static std::fstream done_file;
+  static std::fstream crash_found_file;
+  static std::fstream overflow_file;
+  static std::fstream nofuzz_file;
+  static std::fstream zero_muts_file;
+
+  static struct timespec start_time;
+  static struct timespec end_time;
+#endif
+
+#if defined(IVYSYN_COLLECT_TYPES)
+  static std::fstream types_file;
+  static std::fstream gpu_file;
+  static std::fstream cpu_file;
+#endif
+
+  void create_file(const std::string& filename, std::fstream &file, std::ios_base::openmode fflags)
+  {
+    std::ofstream file_stream(filename);
+    if (file.is_open()) {
+      file.close();
+    }
+    file.clear();
+    file.open(filename, fflags);
+    if (file.fail()) {
+      std::cout << "Failed to open " << filename << std::endl;
+      std::cout << "Error: " << strerror(errno) << std::endl;
+    }
+  }
+
+  /*
+   * The size of the mapping is kept in the page in front of the one that is
+   * handed out, so unmapping only needs the pointer
+   */
+  static void *map_zero_pages(size_t num_bytes)
+  {
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t map_bytes = page_size + ((num_bytes + page_size - 1) / page_size) * page_size;
+    char *base;
+
+    base = (char *) mmap(NULL, map_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+      return nullptr;
+    }
+
+    *(size_t *) base = map_bytes;
+    return base + page_size;
+  }
+
+  static void unmap_zero_pages(void *ptr)
+  {
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    char *base;
+
+    if (ptr == nullptr) {
+      return;
+    }
+
+    base = (char *) ptr - page_size;
+    munmap(base, *(size_t *) base);
+  }
+
+  /* Page aligned, which is more than any tensor asks for */
+  void *ZeroPageAllocator::AllocateRaw(size_t alignment, size_t num_bytes)
+  {
+    return map_zero_pages(num_bytes);
+  }
+
+  void ZeroPageAllocator::DeallocateRaw(void *ptr)
+  {
+    unmap_zero_pages(ptr);
+  }
+
+  /* Never freed, kernels can hold on to their inputs after the Fuzzer is gone */
+  ZeroPageAllocator *zero_page_allocator()
+  {
+    static ZeroPageAllocator *allocator = new ZeroPageAllocator();
+    return allocator;
+  }
+
+  void *GuardPageAllocator::AllocateRaw(size_t alignment, size_t num_bytes)
+  {
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t data_bytes, data_pages;
+    char *base = nullptr;
+    void *ptr;
+
+    /*
+     * Eigen needs the start aligned, which can leave a gap before the guard
+     * page. Only as aligned as Tensor::IsAligned() checks, rather than the
+     * 64 bytes TensorFlow asks for, so that more sizes end right at it.
+     */
+    alignment = std::min(std::max(alignment, (size_t) 1), (size_t) EIGEN_MAX_ALIGN_BYTES);
+    data_bytes = ((num_bytes + alignment - 1) / alignment) * alignment;
+    data_pages = std::max((data_bytes + page_size - 1) / page_size, (size_t) 1);
+
+    std::lock_guard<std::mutex> lock(mu);
+
+    auto &free_list = free_lists[data_pages];
+    if (!free_list.empty()) {
+      base = free_list.back();
+      free_list.pop_back();
+    } else {
+      base = (char *) mmap(NULL, (data_pages + 1) * page_size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (base == MAP_FAILED) {
+        return tensorflow::cpu_allocator()->AllocateRaw(alignment, num_bytes);
+      }
+      if (mprotect(base + data_pages * page_size, page_size, PROT_NONE) != 0) {
+        munmap(base, (data_pages + 1) * page_size);
+        return tensorflow::cpu_allocator()->AllocateRaw(alignment, num_bytes);
+      }
+    }
+
+    ptr = base + data_pages * page_size - data_bytes;
+    mappings[ptr] = {base, data_pages, data_bytes - num_bytes};
+
+    num_buffers++;
+    if (data_bytes > num_bytes) {
+      num_slack++;
+      max_slack = std::max(max_slack, data_bytes - num_bytes);
+    }
+
+    return ptr;
+  }
+
+  void GuardPageAllocator::DeallocateRaw(void *ptr)
+  {
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    char *base;
+    size_t data_pages;
+
+    std::lock_guard<std::mutex> lock(mu);
+
+    auto it = mappings.find(ptr);
+    if (it == mappings.end()) {
+      /* Didn't get a mapping for it */
+      tensorflow::cpu_allocator()->DeallocateRaw(ptr);
+      return;
+    }
+
+    base = it->second.base;
+    data_pages = it->second.data_pages;
+    mappings.erase(it);
+
+    auto &free_list = free_lists[data_pages];
+    if (free_list.size() < GUARD_FREE_LIST_MAX) {
+      free_list.push_back(base);
+    } else {
+      munmap(base, (data_pages + 1) * page_size);
+    }
+  }
+
+  /*
+   * Whether addr is in the guard page of one of the buffers handed out, and
+   * which. Called from the SIGSEGV handler, so it gives up rather than wait
+   * for the lock.
+   */
+  bool GuardPageAllocator::find_guard_page(void *addr, void **buffer, size_t *slack)
+  {
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    char *guard;
+    bool found = false;
+
+    if (!mu.try_lock()) {
+      return false;
+    }
+
+    for (auto &mapping : mappings) {
+      guard = mapping.second.base + mapping.second.data_pages * page_size;
+      if ((char *) addr >= guard && (char *) addr < guard + page_size) {
+        *buffer = mapping.first;
+        *slack = mapping.second.slack;
+        found = true;
+        break;
+      }
+    }
+
+    mu.unlock();
+
+    return found;
+  }
+
+  void GuardPageAllocator::take_slack_stats(size_t *num_buffers, size_t *num_slack, size_t *max_slack)
+  {
+    std::lock_guard<std::mutex> lock(mu);
+
+    *num_buffers = this->num_buffers;
+    *num_slack = this->num_slack;
+    *max_slack = this->max_slack;
+    this->num_buffers = 0;
+    this->num_slack = 0;
+    this->max_slack = 0;
+  }
+
+  GuardPageAllocator *guard_page_allocator()
+  {
+    static GuardPageAllocator *allocator = new GuardPageAllocator();
+    return allocator;
+  }
+
+#if defined(IVYSYN_MEMORY_CEILING)
+  /* Shared by all the counting allocators, the kernel can allocate from any thread */
+  static std::mutex counting_mu;
+  static std::unordered_map<void *, size_t> counted_sizes;
+  static unsigned long long counted_live = 0;
+  static unsigned long long counted_requested = 0;
+  static unsigned long long counted_peak = 0;
+  static unsigned long long counted_refused = 0;
+
+  void *CountingAllocator::AllocateRaw(size_t alignment, size_t num_bytes)
+  {
+    void *ptr;
+
+    {
+      std::lock_guard<std::mutex> lock(counting_mu);
+      counted_requested += num_bytes;
+      if (counted_live + num_bytes > (unsigned long long) (IVYSYN_MEMORY_CEILING)) {
+        counted_refused++;
+        return nullptr;
+      }
+    }
+
+    ptr = wrapped->AllocateRaw(alignment, num_bytes);
+    if (ptr == nullptr) {
+      return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(counting_mu);
+    counted_sizes[ptr] = num_bytes;
+    counted_live += num_bytes;
+    counted_peak = std::max(counted_peak, counted_live);
+
+    return ptr;
+  }
+
+  void CountingAllocator::DeallocateRaw(void *ptr)
+  {
+    {
+      std::lock_guard<std::mutex> lock(counting_mu);
+      auto it = counted_sizes.find(ptr);
+      if (it != counted_sizes.end()) {
+        counted_live -= it->second;
+        counted_sizes.erase(it);
+      }
+    }
+
+    wrapped->DeallocateRaw(ptr);
+  }
+
+  /* Whatever the last mutation left allocated counts towards the peak */
+  void CountingAllocator::reset()
+  {
+    std::lock_guard<std::mutex> lock(counting_mu);
+    counted_requested = 0;
+    counted_peak = counted_live;
+    counted_refused = 0;
+  }
+
+  void CountingAllocator::stats(unsigned long long *requested, unsigned long long *peak, unsigned long long *refused)
+  {
+    std::lock_guard<std::mutex> lock(counting_mu);
+    *requested = counted_requested;
+    *peak = counted_peak;
+    *refused = counted_refused;
+  }
+
+  /* One per wrapped allocator, never freed since outputs can outlive the Fuzzer */
+  CountingAllocator *counting_allocator(tensorflow::Allocator *wrapped)
+  {
+    static std::mutex mu;
+    static std::unordered_map<tensorflow::Allocator *, CountingAllocator *> allocators;
+
+    std::lock_guard<std::mutex> lock(mu);
+    auto &allocator = allocators[wrapped];
+    if (allocator == nullptr) {
+      allocator = new CountingAllocator(wrapped);
+    }
+    return allocator;
+  }
+#endif
+
+  static void write_capture_record(std::ostream &file, const std::string& record)
+  {
+    uint32_t len = record.size();
+
+    file.write((const char *) &len, sizeof(len));
+    file.write(record.data(), len);
+  }
+
+  static bool read_capture_record(std::istream &file, std::string *record)
+  {
+    uint32_t len;
+
+    if (!file.read((char *) &len, sizeof(len))) {
+      return false;
+    }
+
+    record->resize(len);
+    return len == 0 || file.read(&(*record)[0], len);
+  }
+
+  /* Only CPU kernels, the inputs of the others are in device memory */
+  static bool serialize_kernel_capture(tensorflow::OpKernelContext *ctx, std::string *out)
+  {
+    std::string device_type = ctx->device()->attributes().device_type();
+    std::ostringstream file;
+    tensorflow::TensorProto proto;
+    std::string record;
+    uint32_t header[2];
+
+    if (device_type != tensorflow::DEVICE_CPU) {
+      return false;
+    }
+
+    header[0] = CAPTURE_MAGIC;
+    header[1] = ctx->num_inputs();
+    file.write((const char *) header, sizeof(header));
+
+    ctx->op_kernel().def().SerializeToString(&record);
+    write_capture_record(file, record);
+    write_capture_record(file, device_type);
+
+    for (int i = 0; i < ctx->num_inputs(); i++) {
+      record.clear();
+      /* Refs too, the replay passes them by value */
+      if (ctx->has_input(i)) {
+        proto.Clear();
+        (*ctx->get_params()->inputs)[i].tensor->AsProtoTensorContent(&proto);
+        proto.SerializeToString(&record);
+      }
+      write_capture_record(file, record);
+    }
+
+    *out = file.str();
+    return true;
+  }
+
+  static bool parse_kernel_capture(std::istream &file, struct kernel_capture *capture)
+  {
+    tensorflow::TensorProto proto;
+    std::string record;
+    uint32_t header[2];
+
+    if (!file.read((char *) header, sizeof(header)) || header[0] != CAPTURE_MAGIC) {
+      return false;
+    }
+
+    if (!read_capture_record(file, &record) || !capture->node_def.ParseFromString(record) ||
+        !read_capture_record(file, &capture->device_type)) {
+      return false;
+    }
+
+    /* Sized up front, the replay points its TensorValues into it */
+    capture->inputs.assign(header[1], tensorflow::Tensor());
+    capture->has_input.assign(header[1], false);
+
+    for (uint32_t i = 0; i < header[1]; i++) {
+      if (!read_capture_record(file, &record)) {
+        return false;
+      }
+      if (record.empty()) {
+        continue;
+      }
+      if (!proto.ParseFromString(record) || !capture->inputs[i].FromProto(proto)) {
+        return false;
+      }
+      capture->has_input[i] = true;
+    }
+
+    return true;
+  }
+
+  /*
+   * Written next to the final name and moved over it once complete, so a
+   * crash while capturing doesn't leave a truncated capture behind.
+   */
+  bool write_kernel_capture(const std::string& filename, tensorflow::OpKernelContext *ctx)
+  {
+    std::string tmp_filename = filename + ".tmp";
+    std::ofstream file;
+    std::string capture;
+
+    if (!serialize_kernel_capture(ctx, &capture)) {
+      return false;
+    }
+
+    file.open(tmp_filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (file.fail()) {
+      std::cout << "Failed to open " << tmp_filename << std::endl;
+      std::cout << "Error: " << strerror(errno) << std::endl;
+      return false;
+    }
+
+    file.write(capture.data(), capture.size());
+    file.close();
+    if (file.fail() || std::rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+      std::remove(tmp_filename.c_str());
+      return false;
+    }
+
+    return true;
+  }
+
+  bool read_kernel_capture(const std::string& filename, struct kernel_capture *capture)
+  {
+    std::ifstream file(filename, std::ios::in | std::ios::binary);
+
+    return parse_kernel_capture(file, capture);
+  }
+
+  bool read_kernel_seeds(const std::string& filename, std::vector<struct kernel_capture> *seeds)
+  {
+    std::ifstream file(filename, std::ios::in | std::ios::binary);
+    struct seed_header header;
+    std::string capture;
+
+    while (file.read((char *) &header, sizeof(header))) {
+      capture.resize(header.len);
+      if (!file.read(&capture[0], header.len)) {
+        /* Torn append, the seeds before it are fine */
+        break;
+      }
+      std::istringstream capture_stream(capture);
+      seeds->emplace_back();
+      if (!parse_kernel_capture(capture_stream, &seeds->back())) {
+        seeds->pop_back();
+      }
+    }
+
+    return !seeds->empty();
+  }
+
+  static bool write_all(int fd, const char *data, size_t len)
+  {
+    ssize_t written;
+
+    while (len > 0) {
+      written = write(fd, data, len);
+      if (written < 0 && errno == EINTR) {
+        continue;
+      }
+      if (written <= 0) {
+        return false;
+      }
+      data += written;
+      len -= written;
+    }
+
+    return true;
+  }
+
+  static uint64_t fnv1a(uint64_t hash, const void *data, size_t len)
+  {
+    const unsigned char *bytes = (const unsigned char *) data;
+
+    for (size_t i = 0; i < len; i++) {
+      hash ^= bytes[i];
+      hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+  }
+
+  static void pad_crash_record(std::ostream &out)
+  {
+    static const char zeros[CRASH_ALIGN] = {};
+    size_t pos = out.tellp();
+
+    out.write(zeros, (CRASH_ALIGN - pos % CRASH_ALIGN) % CRASH_ALIGN);
+  }
+
+  /* A nullptr input is a missing one */
+  bool append_crash_record(const std::string& filename, long long mutation, const tensorflow::NodeDef& node_def,
+                           const std::string& device_type, const std::vector<const tensorflow::Tensor *>& inputs)
+  {
+    struct crash_record_header header = {};
+    tensorflow::TensorProto proto;
+    std::ostringstream out;
+    std::string record;
+    uint64_t raw_len;
+    bool written;
+    int fd;
+
+    out.write((const char *) &header, sizeof(header));
+    node_def.SerializeToString(&record);
+    write_capture_record(out, record);
+    write_capture_record(out, device_type);
+
+    for (auto tensor : inputs) {
+      record.clear();
+      raw_len = 0;
+      if (tensor != nullptr) {
+        proto.Clear();
+        if (tensorflow::DataTypeCanUseMemcpy(tensor->dtype())) {
+          proto.set_dtype(tensor->dtype());
+          tensor->shape().AsProto(proto.mutable_tensor_shape());
+          raw_len = tensor->tensor_data().size();
+        } else {
+          tensor->AsProtoTensorContent(&proto);
+        }
+        proto.SerializeToString(&record);
+      }
+      write_capture_record(out, record);
+      out.write((const char *) &raw_len, sizeof(raw_len));
+      if (raw_len > 0) {
+        pad_crash_record(out);
+        out.write(tensor->tensor_data().data(), raw_len);
+      }
+    }
+    pad_crash_record(out);
+
+    record = out.str();
+    header.magic = CRASH_MAGIC;
+    header.num_inputs = inputs.size();
+    header.mutation = mutation;
+    header.len = record.size();
+    memcpy(&record[0], &header, sizeof(header));
+
+    /* One write, so a record is either all there or torn at the end of the file */
+    fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd < 0) {
+      std::cout << "Failed to open " << filename << std::endl;
+      std::cout << "Error: " << strerror(errno) << std::endl;
+      return false;
+    }
+    written = write_all(fd, record.data(), record.size());
+    close(fd);
+
+    return written;
+  }
+
+  /* Points into the mapping of a crash record, which is never unmapped */
+  class MappedTensorBuffer : public tensorflow::TensorBuffer {
+  public:
+    MappedTensorBuffer(void *data, size_t len) : tensorflow::TensorBuffer(data), len(len) {}
+
+    size_t size() const override { return len; }
+    tensorflow::TensorBuffer *root_buffer() override { return this; }
+    bool OwnsMemory() const override { return false; }
+
+    void FillAllocationDescription(tensorflow::AllocationDescription *proto) const override
+    {
+      proto->set_requested_bytes(len);
+      proto->set_allocator_name("ivysyn_mapped");
+    }
+
+  private:
+    size_t len;
+  };
+
+  static const char *take_bytes(const char *base, size_t end, size_t *off, size_t len)
+  {
+    const char *ptr;
+
+    if (*off > end || len > end - *off) {
+      return nullptr;
+    }
+
+    ptr = base + *off;
+    *off += len;
+    return ptr;
+  }
+
+  static const char *take_record(const char *base, size_t end, size_t *off, uint32_t *len)
+  {
+    const char *ptr = take_bytes(base, end, off, sizeof(*len));
+
+    if (ptr == nullptr) {
+      return nullptr;
+    }
+
+    memcpy(len, ptr, sizeof(*len));
+    return take_bytes(base, end, off, *len);
+  }
+
+  /*
+   * Reads the first record of filename. The raw buffers are not copied: the
+   * tensors point into a private mapping of the file, so a kernel writing to
+   * its inputs doesn't change the file.
+   */
+  bool map_crash_record(const std::string& filename, struct kernel_capture *record)
+  {
+    struct crash_record_header header;
+    struct stat stat_buffer = {};
+    tensorflow::TensorProto proto;
+    tensorflow::TensorShape shape;
+    MappedTensorBuffer *buffer;
+    const char *ptr;
+    uint64_t raw_len;
+    uint32_t len;
+    size_t off, end;
+    char *base;
+    int fd;
+
+    fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+    if (fstat(fd, &stat_buffer) != 0 || stat_buffer.st_size < (off_t) sizeof(header)) {
+      close(fd);
+      return false;
+    }
+
+    base = (char *) mmap(NULL, stat_buffer.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+      return false;
+    }
+
+    memcpy(&header, base, sizeof(header));
+    if (header.magic != CRASH_MAGIC || header.len > (uint64_t) stat_buffer.st_size) {
+      munmap(base, stat_buffer.st_size);
+      return false;
+    }
+
+    off = sizeof(header);
+    end = header.len;
+
+    if ((ptr = take_record(base, end, &off, &len)) == nullptr || !record->node_def.ParseFromArray(ptr, len) ||
+        (ptr = take_record(base, end, &off, &len)) == nullptr) {
+      munmap(base, stat_buffer.st_size);
+      return false;
+    }
+    record->device_type.assign(ptr, len);
+
+    record->inputs.assign(header.num_inputs, tensorflow::Tensor());
+    record->has_input.assign(header.num_inputs, false);
+
+    /* Left mapped from here on, the inputs read so far point into it */
+    for (uint32_t i = 0; i < header.num_inputs; i++) {
+      if ((ptr = take_record(base, end, &off, &len)) == nullptr || !proto.ParseFromArray(ptr, len)) {
+        return false;
+      }
+      if ((ptr = take_bytes(base, end, &off, sizeof(raw_len))) == nullptr) {
+        return false;
+      }
+      memcpy(&raw_len, ptr, sizeof(raw_len));
+      if (len == 0) {
+        continue;
+      }
+
+      if (raw_len == 0) {
+        if (!record->inputs[i].FromProto(proto)) {
+          return false;
+        }
+      } else {
+        off += (CRASH_ALIGN - off % CRASH_ALIGN) % CRASH_ALIGN;
+        if (!tensorflow::DataTypeCanUseMemcpy(proto.dtype()) || !tensorflow::TensorShape::IsValid(proto.tensor_shape()) ||
+            (ptr = take_bytes(base, end, &off, raw_len)) == nullptr) {
+          return false;
+        }
+        shape = tensorflow::TensorShape(proto.tensor_shape());
+        if (raw_len != shape.num_elements() * tensorflow::DataTypeSize(proto.dtype())) {
+          return false;
+        }
+        buffer = new MappedTensorBuffer((void *) ptr, raw_len);
+        record->inputs[i] = tensorflow::Tensor(proto.dtype(), shape, buffer);
+        buffer->Unref();
+      }
+      record->has_input[i] = true;
+    }
+
+    return true;
+  }
+
+#if !defined(IVYSYN_VALIDATE) && !defined(IVYSYN_COLLECT_TYPES)
+  struct timespec time_diff(struct timespec start, struct timespec end)
+  {
+    struct timespec res;
+    if ((end.tv_nsec - start.tv_nsec) < 0) {
+      res.tv_sec = end.tv_sec - start.tv_sec - 1;
+      res.tv_nsec = 1000000000 + end.tv_nsec - start.tv_nsec;
+    }
+    else {
+      res.tv_sec = end.tv_sec - start.tv_sec;
+      res.tv_nsec = end.tv_nsec - start.tv_nsec;
+    }
+    return res;
+  }
+
+  bool was_fuzzed(const std::string& fname) {
+    struct stat stat_buffer = {};
+    std::string stat_filename;
+    std::string unknown_filename;
+    int done_status = 0;
+    int unknown_status = 0;
+
+    stat_filename = std::string(results_dir) + "/" + fname + ".done";
+    unknown_filename = std::string(results_dir) + "/" + fname + ".unknown";
+
+    done_status = stat(stat_filename.c_str(), &stat_buffer) == 0;
+    unknown_status = stat(unknown_filename.c_str(), &stat_buffer) == 0;
+
+    return done_status || unknown_status;
+  }
+
+  static struct kernel_state_table *map_kernel_states()
+  {
+    std::string filename = std::string(results_dir) + "/kernel_states";
+    struct kernel_state_table *table;
+    struct stat stat_buffer = {};
+    int fd;
+
+    fd = open(filename.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd < 0) {
+      return nullptr;
+    }
+
+    /* Only grow it, other processes may have it mapped already */
+    if (fstat(fd, &stat_buffer) != 0 ||
+        (stat_buffer.st_size < (off_t) sizeof(struct kernel_state_table) &&
+         ftruncate(fd, sizeof(struct kernel_state_table)) != 0)) {
+      close(fd);
+      return nullptr;
+    }
+
+    table = (struct kernel_state_table *) mmap(NULL, sizeof(struct kernel_state_table), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (table == MAP_FAILED) {
+      return nullptr;
+    }
+
+    return table;
+  }
+
+  /*
+   * Called on every Compute() of an instrumented kernel. Once the kernel is
+   * known to be done in the current generation this is two loads from the
+   * shared state table, the marker files are only checked while it isn't
+   */
+  bool was_fuzzed(int kernel_id, const char *fname)
+  {
+    /* Mapped on first use, thread safe local static initialization */
+    static struct kernel_state_table *kernel_states = map_kernel_states();
+    unsigned int generation;
+    bool fuzzed;
+
+    if (kernel_states == nullptr || kernel_id <= 0 || kernel_id >= MAX_KERNEL_IDS) {
+      return was_fuzzed(std::string(fname));
+    }
+
+    generation = kernel_states->generation.load(std::memory_order_relaxed);
+    if (kernel_states->done[kernel_id].load(std::memory_order_relaxed) == generation + 1) {
+      return true;
+    }
+
+    fuzzed = was_fuzzed(std::string(fname));
+    if (fuzzed) {
+      kernel_states->done[kernel_id].store(generation + 1, std::memory_order_relaxed);
+    }
+
+    return fuzzed;
+  }
+
+  bool zero_muts_crashed(const std::string& fname) {
+    struct stat stat_buffer = {};
+    std::string zero_mut_filename;
+    int done_status = 0;
+
+    zero_mut_filename = std::string(results_dir) + "/" + fname + ".zero_muts";
+
+    return stat(zero_mut_filename.c_str(), &stat_buffer) == 0;
+  }
+
+  bool was_killed(const std::string& fname)
+  {
+    struct stat stat_buffer = {};
+    std::string killed_filename = std::string(results_dir) + "/" + fname + ".killed";
+
+    return stat(killed_filename.c_str(), &stat_buffer) == 0;
+  }
+
+  /* No iostreams in a signal handler */
+  static char *append_str(char *p, const char *str)
+  {
+    while (*str) {
+      *p++ = *str++;
+    }
+    return p;
+  }
+
+  static char *append_number(char *p, unsigned long long num, int base)
+  {
+    char digits[32];
+    int n = 0;
+
+    do {
+      digits[n++] = "0123456789abcdef"[num % base];
+      num /= base;
+    } while (num != 0);
+
+    while (n > 0) {
+      *p++ = digits[--n];
+    }
+    return p;
+  }
+
+  /*
+   * The watchdog went off, so the mutation in the progress slot hung. Note it
+   * in <kernel>.hang and die, the restart logs it as a hang and goes on from
+   * the next mutation. The kernel can be holding any lock, hence no iostreams.
+   */
+  void handle_hang(int)
+  {
+    char line[LOGBUFSZ];
+    char *p = line;
+    long long mutation;
+    int fd;
+
+    if (progress == nullptr) {
+      _exit(-SIGALRM);
+    }
+
+    mutation = progress->mutation;
+    if (mutation < 0) {
+      *p++ = '-';
+      mutation = -mutation;
+    }
+    p = append_number(p, mutation, 10);
+    *p++ = '\n';
+
+    fd = open(hang_filename, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd >= 0) {
+      if (write(fd, line, p - line) < 0) {
+        /* Restored as a crash then */
+      }
+      close(fd);
+    }
+
+    _exit(-SIGALRM);
+  }
+
+#if defined(IVYSYN_GUARD_OUTPUTS)
+  /*
+   * If the fault is in a guard page, note which output of the mutation (or
+   * else which temporary) ran over into <kernel>.guard_fault. Then let the
+   * fault kill us as it would have anyway, the crash itself is logged when
+   * the kernel is restored.
+   */
+  static void handle_guard_fault(int sig, siginfo_t *info, void *)
+  {
+    char line[BUFSZ];
+    char *p = line;
+    void *buffer = nullptr;
+    tensorflow::Tensor *output;
+    size_t slack = 0;
+    int output_idx = -1;
+    int fd;
+
+    signal(sig, SIG_DFL);
+
+    if (!guard_page_allocator()->find_guard_page(info->si_addr, &buffer, &slack)) {
+      return;
+    }
+
+    if (guarded_ctx != nullptr) {
+      for (int i = 0; i < guarded_ctx->num_outputs(); i++) {
+        output = guarded_ctx->mutable_output(i);
+        if (output != nullptr && output->IsInitialized() && output->data() == buffer) {
+          output_idx = i;
+          break;
+        }
+      }
+    }
+
+    p = append_str(p, "mutation ");
+    p = append_number(p, progress != nullptr ? progress->mutation : 0, 10);
+    if (output_idx >= 0) {
+      p = append_str(p, " output ");
+      p = append_number(p, output_idx, 10);
+    } else {
+      p = append_str(p, " temp");
+    }
+    p = append_str(p, " addr 0x");
+    p = append_number(p, (unsigned long long) info->si_addr, 16);
+    p = append_str(p, " slack ");
+    p = append_number(p, slack, 10);
+    *p++ = '\n';
+
+    fd = open(guard_fault_filename, O_WRONLY | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd >= 0) {
+      if (write(fd, line, p - line) < 0) {
+        /* Nothing else we can do */
+      }
+      close(fd);
+    }
+  }
+#endif
+
+  /* Executable segments, so frames hash the same in every process despite ASLR */
+  struct crash_module {
+    uintptr_t start;
+    uintptr_t end;
+    uint64_t name_hash;
+  };
+
+  static struct crash_module crash_modules[CRASH_MAX_MODULES];
+  static int num_crash_modules = 0;
+  static const int crash_signals[] = { SIGSEGV, SIGFPE, SIGABRT };
+  static struct sigaction old_crash_actions[sizeof(crash_signals) / sizeof(crash_signals[0])];
+
+  static int add_crash_modules(struct dl_phdr_info *info, size_t, void *)
+  {
+    const char *name = info->dlpi_name;
+    uint64_t name_hash;
+
+    /* The same library can be installed in different places */
+    if (strrchr(name, '/') != nullptr) {
+      name = strrchr(name, '/') + 1;
+    }
+    name_hash = fnv1a(FNV_OFFSET_BASIS, name, strlen(name));
+
+    for (int i = 0; i < info->dlpi_phnum && num_crash_modules < CRASH_MAX_MODULES; i++) {
+      if (info->dlpi_phdr[i].p_type != PT_LOAD || !(info->dlpi_phdr[i].p_flags & PF_X)) {
+        continue;
+      }
+      crash_modules[num_crash_modules].start = info->dlpi_addr + info->dlpi_phdr[i].p_vaddr;
+      crash_modules[num_crash_modules].end = crash_modules[num_crash_modules].start + info->dlpi_phdr[i].p_memsz;
+      crash_modules[num_crash_modules].name_hash = name_hash;
+      num_crash_modules++;
+    }
+
+    return 0;
+  }
+
+  /*
+   * Hash the top CRASH_HASH_FRAMES frames of the crashing stack into the
+   * progress slot, as offsets into their modules, and let the signal do what
+   * it would have done. The restart buckets the crash by the hash, see
+   * increase_num_crashes(). backtrace() was called once before, so it doesn't
+   * have to load libgcc in here.
+   */
+  static void handle_crash(int sig, siginfo_t *info, void *)
+  {
+    void *frames[CRASH_MAX_FRAMES];
+    uint64_t hash = FNV_OFFSET_BASIS;
+    uintptr_t pc;
+    int num_frames;
+    size_t idx = 0;
+
+    num_frames = backtrace(frames, CRASH_MAX_FRAMES);
+
+    /* Past this handler and the signal trampoline */
+    for (int i = 2; i < num_frames && i < 2 + CRASH_HASH_FRAMES; i++) {
+      pc = (uintptr_t) frames[i];
+      for (int m = 0; m < num_crash_modules; m++) {
+        if (pc >= crash_modules[m].start && pc < crash_modules[m].end) {
+          hash = fnv1a(hash, &crash_modules[m].name_hash, sizeof(crash_modules[m].name_hash));
+          pc -= crash_modules[m].start;
+          break;
+        }
+      }
+      hash = fnv1a(hash, &pc, sizeof(pc));
+    }
+
+    /* Keep the first signal, an abort can follow a fault */
+    if (progress != nullptr && progress->crash_mutation != progress->mutation) {
+      /* 0 is a crash that wasn't hashed */
+      progress->crash_bucket = hash != 0 ? hash : 1;
+      progress->crash_signal = sig;
+      progress->crash_mutation = progress->mutation;
+    }
+
+    while (crash_signals[idx] != sig) {
+      idx++;
+    }
+    sigaction(sig, &old_crash_actions[idx], NULL);
+
+    /* A fault happens again on return, a sent signal has to be sent again */
+    if (info->si_code <= 0) {
+      raise(sig);
+    }
+  }
+
+  static void install_crash_handlers()
+  {
+    struct sigaction crash_sigaction = {};
+    struct sigaction cur_sigaction = {};
+    void *frame;
+
+    if (num_crash_modules == 0) {
+      backtrace(&frame, 1);
+      dl_iterate_phdr(add_crash_modules, NULL);
+    }
+
+    crash_sigaction.sa_sigaction = handle_crash;
+    crash_sigaction.sa_flags = SA_SIGINFO;
+
+    for (size_t i = 0; i < sizeof(crash_signals) / sizeof(crash_signals[0]); i++) {
+      sigaction(crash_signals[i], NULL, &cur_sigaction);
+      /* Already installed by a kernel fuzzed before in this process */
+      if ((cur_sigaction.sa_flags & SA_SIGINFO) && cur_sigaction.sa_sigaction == handle_crash) {
+        continue;
+      }
+      sigaction(crash_signals[i], &crash_sigaction, &old_crash_actions[i]);
+    }
+  }
+
+  struct progress_slot *map_progress_slot(const std::string& filename, const std::string& fname)
+  {
+    struct progress_slot *slot;
+    int fd;
+
+    fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd < 0) {
+      std::cout << "Failed to open " << filename << std::endl;
+      std::cout << "Error: " << strerror(errno) << std::endl;
+      return nullptr;
+    }
+
+    if (ftruncate(fd, sizeof(struct progress_slot)) != 0) {
+      std::cout << "Failed to resize " << filename << std::endl;
+      std::cout << "Error: " << strerror(errno) << std::endl;
+      close(fd);
+      return nullptr;
+    }
+
+    slot = (struct progress_slot *) mmap(NULL, sizeof(struct progress_slot), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (slot == MAP_FAILED) {
+      std::cout << "Failed to map " << filename << std::endl;
+      std::cout << "Error: " << strerror(errno) << std::endl;
+      return nullptr;
+    }
+
+    slot->mutation = -1;
+    slot->timestamp = -1;
+    slot->crash_mutation = -1;
+    slot->last_ok_mutation = -1;
+    strncpy(slot->kernel, fname.c_str(), FILENAME_SZ - 1);
+    /* Set last, a slot without the magic was never initialized */
+    slot->magic = PROGRESS_MAGIC;
+
+    return slot;
+  }
+
+  void unmap_progress_slot(struct progress_slot *slot)
+  {
+    if (slot != nullptr) {
+      munmap(slot, sizeof(struct progress_slot));
+    }
+  }
+
+  bool read_progress_slot(const std::string& filename, long long *mutation, long long *timestamp,
+                          unsigned long long *crash_bucket, int *crash_signal)
+  {
+    struct progress_slot slot = {};
+    ssize_t nread;
+    int fd;
+
+    fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+
+    nread = pread(fd, &slot, sizeof(struct progress_slot), 0);
+    close(fd);
+
+    if (nread != sizeof(struct progress_slot) || slot.magic != PROGRESS_MAGIC) {
+      return false;
+    }
+
+    *mutation = slot.mutation;
+    *timestamp = slot.timestamp;
+    /* Killed without the handler running, or a stale crash */
+    *crash_bucket = 0;
+    *crash_signal = 0;
+    if (slot.crash_mutation == slot.mutation) {
+      *crash_bucket = slot.crash_bucket;
+      *crash_signal = slot.crash_signal;
+    }
+
+    return true;
+  }
+
+  /*
+   * Carry the mutation times and last returned mutation of the run that left
+   * filename over to slot
+   */
+  static void copy_slot_history(const std::string& filename, struct progress_slot *slot)
+  {
+    struct progress_slot old_slot = {};
+    ssize_t nread;
+    int fd;
+
+    fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+
+    nread = pread(fd, &old_slot, sizeof(struct progress_slot), 0);
+    close(fd);
+
+    if (nread != sizeof(struct progress_slot) || old_slot.magic != PROGRESS_MAGIC) {
+      return;
+    }
+
+    for (int i = 0; i < HANG_NUM_BUCKETS; i++) {
+      slot->hang_buckets[i] = old_slot.hang_buckets[i];
+    }
+    slot->hang_samples = old_slot.hang_samples;
+    slot->last_ok_mutation = old_slot.last_ok_mutation;
+  }
+
+  static struct mutation_ring *map_mutation_ring(const std::string& filename, bool create)
+  {
+    struct mutation_ring *ring;
+    struct stat stat_buffer = {};
+    int fd;
+
+    if (create) {
+      fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    } else {
+      fd = open(filename.c_str(), O_RDWR);
+    }
+    if (fd < 0) {
+      if (create) {
+        std::cout << "Failed to open " << filename << std::endl;
+        std::cout << "Error: " << strerror(errno) << std::endl;
+      }
+      return nullptr;
+    }
+
+    if (create && ftruncate(fd, sizeof(struct mutation_ring)) != 0) {
+      std::cout << "Failed to resize " << filename << std::endl;
+      std::cout << "Error: " << strerror(errno) << std::endl;
+      close(fd);
+      return nullptr;
+    }
+
+    if (!create && (fstat(fd, &stat_buffer) != 0 || stat_buffer.st_size != sizeof(struct mutation_ring))) {
+      close(fd);
+      return nullptr;
+    }
+
+    ring = (struct mutation_ring *) mmap(NULL, sizeof(struct mutation_ring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ring == MAP_FAILED) {
+      std::cout << "Failed to map " << filename << std::endl;
+      std::cout << "Error: " << strerror(errno) << std::endl;
+      return nullptr;
+    }
+
+    if (create) {
+      ring->head.store(0);
+      ring->tail.store(0);
+      ring->magic = RING_MAGIC;
+    } else if (ring->magic != RING_MAGIC) {
+      munmap(ring, sizeof(struct mutation_ring));
+      return nullptr;
+    }
+
+    return ring;
+  }
+
+  /* Write out everything between tail and head, in at most two chunks */
+  static void drain_mutation_ring(struct mutation_ring *ring, int fd)
+  {
+    unsigned long long head, tail, first, count;
+    size_t nbytes;
+    ssize_t written;
+    char *buf;
+
+    head = ring->head.load(std::memory_order_acquire);
+    tail = ring->tail.load(std::memory_order_relaxed);
+
+    while (tail != head) {
+      first = tail % RING_NUM_RECORDS;
+      count = std::min(head - tail, (unsigned long long) RING_NUM_RECORDS - first);
+
+      buf = (char *) &ring->records[first];
+      nbytes = count * sizeof(struct mutation_record);
+      while (nbytes > 0) {
+        written = write(fd, buf, nbytes);
+        if (written < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+          std::cout << "Failed to write mutation records: " << strerror(errno) << std::endl;
+          break;
+        }
+        buf += written;
+        nbytes -= written;
+      }
+
+      tail += count;
+      ring->tail.store(tail, std::memory_order_release);
+    }
+  }
 
-#if !defined(IVYSYN_VALIDATE) && !defined(IVYSYN_COLLECT_TYPES)
-  bool already_fuzzing = false;
-  const int TIMEOUT_SECS = 1200;
-  const int RNG_SEED = 123;
-  const int NMUT_UPPER_BOUND_MID = 1000000;
-  const int CRASHES_BOUND = 1;
-  const int TIME_THRESH_SECS = 30;
-  std::string cur_fname_glob = {};
+  static void drain_loop()
+  {
+    while (!drain_stop.load()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(RING_DRAIN_MS));
+      drain_mutation_ring(ring, ring_fd);
+    }
+    drain_mutation_ring(ring, ring_fd);
+  }
 
-  static std::fstream mutations_file;
-  static std::fstream mutations_restore;
-  static std::fstream last_timestamp_file;
-  static std::fstream timestamp_restore;
-  static std::fstream crashes_file;
-  static std::fstream num_crashes_file;
-  static std::fstream unknown_type_file;
-  static std::fstream time_file;
-  static std::fstream except_file;
-  static std::fstream start_file;
-  static std::fstream done_file;
-  static std::fstream crash_found_file;
-  static std::fstream overflow_file;
-  static std::fstream nofuzz_file;
-  static std::fstream zero_muts_file;
+  bool start_mutation_ring(const std::string& ring_filename, const std::string& time_filename)
+  {
+    ring = map_mutation_ring(ring_filename, true);
+    if (ring == nullptr) {
+      return false;
+    }
 
-  static struct timespec start_time;
-  static struct timespec end_time;
-#endif
+    ring_fd = open(time_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (ring_fd < 0) {
+      std::cout << "Failed to open " << time_filename << std::endl;
+      std::cout << "Error: " << strerror(errno) << std::endl;
+      munmap(ring, sizeof(struct mutation_ring));
+      ring = nullptr;
+      return false;
+    }
 
-#if defined(IVYSYN_COLLECT_TYPES)
-  static std::fstream types_file;
-  static std::fstream gpu_file;
-  static std::fstream cpu_file;
-#endif
+    /* Not a static std::thread, exit() would abort on it */
+    drain_stop.store(false);
+    drain_thread = new std::thread(drain_loop);
 
-  void create_file(const std::string& filename, std::fstream &file, std::ios_base::openmode fflags)
+    return true;
+  }
+
+  void stop_mutation_ring(const std::string& ring_filename)
   {
-    std::ofstream file_stream(filename);
-    if (file.is_open()) {
-      file.close();
+    if (ring == nullptr) {
+      return;
     }
-    file.clear();
-    file.open(filename, fflags);
-    if (file.fail()) {
-      std::cout << "Failed to open " << filename << std::endl;
-      std::cout << "Error: " << strerror(errno) << std::endl;
+
+    drain_stop.store(true);
+    drain_thread->join();
+    delete drain_thread;
+    drain_thread = nullptr;
+
+    close(ring_fd);
+    ring_fd = -1;
+    munmap(ring, sizeof(struct mutation_ring));
+    ring = nullptr;
+    std::remove(ring_filename.c_str());
+  }
+
+  /* Write out the records a crashed process left in its ring */
+  void recover_mutation_ring(const std::string& ring_filename, const std::string& time_filename)
+  {
+    struct mutation_ring *old_ring;
+    int fd;
+
+    old_ring = map_mutation_ring(ring_filename, false);
+    if (old_ring == nullptr) {
+      return;
+    }
+
+    fd = open(time_filename.c_str(), O_WRONLY | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd >= 0) {
+      drain_mutation_ring(old_ring, fd);
+      close(fd);
     }
+
+    munmap(old_ring, sizeof(struct mutation_ring));
+    std::remove(ring_filename.c_str());
   }
 
-#if !defined(IVYSYN_VALIDATE) && !defined(IVYSYN_COLLECT_TYPES)
-  struct timespec time_diff(struct timespec start, struct timespec end)
+  void log_mutation_record(long long mutation, long long duration, int status, int failing_arg)
   {
-    struct timespec res;
-    if ((end.tv_nsec - start.tv_nsec) < 0) {
-      res.tv_sec = end.tv_sec - start.tv_sec - 1;
-      res.tv_nsec = 1000000000 + end.tv_nsec - start.tv_nsec;
+    struct mutation_record *record;
+    unsigned long long head;
+
+    if (ring == nullptr) {
+      return;
     }
-    else {
-      res.tv_sec = end.tv_sec - start.tv_sec;
-      res.tv_nsec = end.tv_nsec - start.tv_nsec;
+
+    head = ring->head.load(std::memory_order_relaxed);
+
+    /* Full, wait for the drain thread to catch up */
+    while (head - ring->tail.load(std::memory_order_acquire) >= RING_NUM_RECORDS) {
+      std::this_thread::yield();
     }
-    return res;
+
+    record = &ring->records[head % RING_NUM_RECORDS];
+    record->mutation = mutation;
+    record->duration = duration;
+    record->status = status;
+    record->failing_arg = failing_arg;
+
+    ring->head.store(head + 1, std::memory_order_release);
   }
 
-  bool was_fuzzed(const std::string& fname) {
-    struct stat stat_buffer = {};
-    std::string stat_filename;
-    std::string unknown_filename;
-    int done_status = 0;
-    int unknown_status = 0;
+#endif
 
-    stat_filename = std::string(results_dir) + "/" + fname + ".done";
-    unknown_filename = std::string(results_dir) + "/" + fname + ".unknown";
+#if defined(IVYSYN_COLLECT_TYPES) && defined(IVYSYN_CAPTURE_SEEDS)
+  struct seed_corpus {
+    /* Of the seeds in <kernel>.seeds, up to scanned */
+    std::set<uint64_t> hashes;
+    size_t num_seeds = 0;
+    size_t bytes = 0;
+    off_t scanned = 0;
+    std::vector<std::pair<uint64_t, std::string>> pending;
+  };
+
+  static std::mutex seeds_mu;
+  /* Never freed, kernels can run until exit */
+  static std::unordered_map<std::string, struct seed_corpus> *seed_corpora = nullptr;
+  static size_t seeds_pending_bytes = 0;
 
-    done_status = stat(stat_filename.c_str(), &stat_buffer) == 0;
-    unknown_status = stat(unknown_filename.c_str(), &stat_buffer) == 0;
+  /*
+   * Straight from the input buffers, so a duplicate costs one pass over its
+   * inputs and nothing is serialized. The attrs go in through SummarizeAttrs(),
+   * which sorts them, unlike a serialized NodeDef.
+   */
+  static uint64_t hash_seed(tensorflow::OpKernelContext *ctx)
+  {
+    const tensorflow::NodeDef& def = ctx->op_kernel().def();
+    uint64_t hash = FNV_OFFSET_BASIS;
+    tensorflow::TensorProto proto;
+    tensorflow::Tensor *tensor;
+    std::string record;
+    int64_t dim;
+    int32_t dtype;
+    bool present;
+
+    record = def.op() + "(" + tensorflow::SummarizeAttrs(def) + ")";
+    hash = fnv1a(hash, record.data(), record.size());
+
+    for (int i = 0; i < ctx->num_inputs(); i++) {
+      present = ctx->has_input(i);
+      hash = fnv1a(hash, &present, sizeof(present));
+      if (!present) {
+        continue;
+      }
 
-    return done_status || unknown_status;
+      tensor = (*ctx->get_params()->inputs)[i].tensor;
+      dtype = tensor->dtype();
+      hash = fnv1a(hash, &dtype, sizeof(dtype));
+      for (int d = 0; d < tensor->dims(); d++) {
+        dim = tensor->dim_size(d);
+        hash = fnv1a(hash, &dim, sizeof(dim));
+      }
+
+      if (tensorflow::DataTypeCanUseMemcpy(tensor->dtype())) {
+        hash = fnv1a(hash, tensor->tensor_data().data(), tensor->tensor_data().size());
+      } else {
+        proto.Clear();
+        tensor->AsProtoTensorContent(&proto);
+        record.clear();
+        proto.SerializeToString(&record);
+        hash = fnv1a(hash, record.data(), record.size());
+      }
+    }
+
+    return hash;
   }
 
-  bool zero_muts_crashed(const std::string& fname) {
+  /* Picks up the seeds appended since the last scan, by us or by other processes */
+  static void scan_seeds(int fd, struct seed_corpus &corpus)
+  {
+    struct seed_header header;
     struct stat stat_buffer = {};
-    std::string zero_mut_filename;
-    int done_status = 0;
 
-    zero_mut_filename = std::string(results_dir) + "/" + fname + ".zero_muts";
+    if (fstat(fd, &stat_buffer) != 0) {
+      return;
+    }
 
-    return stat(zero_mut_filename.c_str(), &stat_buffer) == 0;
+    while (pread(fd, &header, sizeof(header), corpus.scanned) == sizeof(header) &&
+           corpus.scanned + (off_t) (sizeof(header) + header.len) <= stat_buffer.st_size) {
+      if (corpus.hashes.insert(header.hash).second) {
+        corpus.num_seeds++;
+      }
+      corpus.bytes += sizeof(header) + header.len;
+      corpus.scanned += sizeof(header) + header.len;
+    }
   }
 
-  bool was_killed(const std::string& fname)
+  static void flush_seeds(const std::string& fname, struct seed_corpus &corpus)
   {
+    std::string filename = std::string(results_dir) + "/" + fname + ".seeds";
     struct stat stat_buffer = {};
-    int killed_exists = 0, timeout_exists = 0;
+    struct seed_header header;
+    std::string batch;
+    int fd;
 
-    std::string killed_filename = std::string(results_dir) + "/" + fname + ".killed";
-    std::string timeout_filename = std::string(results_dir) + "/" + fname + ".timeout";
+    fd = open(filename.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd < 0 || flock(fd, LOCK_EX) != 0) {
+      std::cout << "Failed to lock " << filename << std::endl;
+      std::cout << "Error: " << strerror(errno) << std::endl;
+      if (fd >= 0) {
+        close(fd);
+      }
+      corpus.pending.clear();
+      return;
+    }
+
+    scan_seeds(fd, corpus);
+
+    /* Whatever is past the last whole seed was torn by a process that died appending it */
+    if (fstat(fd, &stat_buffer) == 0 && stat_buffer.st_size > corpus.scanned) {
+      if (ftruncate(fd, corpus.scanned) != 0) {
+        corpus.pending.clear();
+        close(fd);
+        return;
+      }
+    }
+
+    for (auto &seed : corpus.pending) {
+      if (corpus.num_seeds >= SEEDS_PER_KERNEL) {
+        break;
+      }
+      if (corpus.hashes.count(seed.first) != 0 ||
+          corpus.bytes + sizeof(header) + seed.second.size() > SEED_CORPUS_MAX_BYTES) {
+        continue;
+      }
+
+      header.hash = seed.first;
+      header.len = seed.second.size();
+      batch.append((const char *) &header, sizeof(header));
+      batch += seed.second;
+
+      corpus.hashes.insert(seed.first);
+      corpus.num_seeds++;
+      corpus.bytes += sizeof(header) + seed.second.size();
+    }
+    corpus.pending.clear();
 
-    killed_exists = stat(killed_filename.c_str(), &stat_buffer) == 0;
-    stat_buffer = {};
-    timeout_exists = stat(timeout_filename.c_str(), &stat_buffer) == 0;
+    /* One append per batch, under the lock */
+    if (write_all(fd, batch.data(), batch.size())) {
+      corpus.scanned += batch.size();
+    } else {
+      std::cout << "Failed to write " << filename << std::endl;
+      std::cout << "Error: " << strerror(errno) << std::endl;
+    }
 
-    return killed_exists | timeout_exists;
+    close(fd);
   }
 
-  void handle_timeout(int)
+  /* Called with seeds_mu held */
+  static void flush_all_seeds()
   {
-    struct timespec ts = {};
+    for (auto &corpus : *seed_corpora) {
+      if (!corpus.second.pending.empty()) {
+        flush_seeds(corpus.first, corpus.second);
+      }
+    }
+    seeds_pending_bytes = 0;
+  }
 
-    std::cout << "Kernel " << cur_fname_glob << " timed out, stopping fuzzing" << std::endl;
-    std::string timeout_filename = std::string(results_dir) + "/" + cur_fname_glob + ".timeout";
-    std::fstream timeout_file;
+  static void flush_seeds_at_exit()
+  {
+    std::lock_guard<std::mutex> lock(seeds_mu);
+    flush_all_seeds();
+  }
 
-    create_file(timeout_filename, timeout_file, std::ios::out);
+  /* Called with seeds_mu held */
+  static bool seed_is_new(const struct seed_corpus &corpus, uint64_t hash)
+  {
+    if (corpus.num_seeds + corpus.pending.size() >= SEEDS_PER_KERNEL || corpus.hashes.count(hash) != 0) {
+      return false;
+    }
 
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    timeout_file << ts.tv_sec << std::endl;
-    timeout_file.close();
+    for (auto &seed : corpus.pending) {
+      if (seed.first == hash) {
+        return false;
+      }
+    }
 
-    exit(-SIGALRM);
+    return true;
   }
 
+  /*
+   * Runs on every Compute() of a CPU kernel, so it has to stay cheap: kernels
+   * with a full corpus return right away, and duplicates are found by hashing
+   * the inputs before anything is serialized. New seeds are batched in memory
+   * and appended once SEED_BATCH_BYTES of them are pending, or at exit.
+   */
+  static void capture_seed(const std::string& fname, tensorflow::OpKernelContext *ctx)
+  {
+    std::string filename = std::string(results_dir) + "/" + fname + ".seeds";
+    struct seed_corpus *corpus;
+    std::string capture;
+    size_t input_bytes = 0;
+    uint64_t hash;
+    int fd;
+
+    if (ctx->device()->attributes().device_type() != tensorflow::DEVICE_CPU) {
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(seeds_mu);
+
+      if (seed_corpora == nullptr) {
+        seed_corpora = new std::unordered_map<std::string, struct seed_corpus>();
+        std::atexit(flush_seeds_at_exit);
+      }
+
+      auto found = seed_corpora->find(fname);
+      if (found == seed_corpora->end()) {
+        corpus = &(*seed_corpora)[fname];
+        fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+          if (flock(fd, LOCK_SH) == 0) {
+            scan_seeds(fd, *corpus);
+          }
+          close(fd);
+        }
+      } else {
+        corpus = &found->second;
+      }
+
+      if (corpus->num_seeds + corpus->pending.size() >= SEEDS_PER_KERNEL) {
+        return;
+      }
+    }
+
+    for (int i = 0; i < ctx->num_inputs(); i++) {
+      if (ctx->has_input(i)) {
+        input_bytes += (*ctx->get_params()->inputs)[i].tensor->TotalBytes();
+      }
+    }
+    if (input_bytes > SEED_CORPUS_MAX_BYTES) {
+      return;
+    }
+
+    hash = hash_seed(ctx);
+
+    {
+      std::lock_guard<std::mutex> lock(seeds_mu);
+
+      if (!seed_is_new(*corpus, hash)) {
+        return;
+      }
+    }
+
+    if (!serialize_kernel_capture(ctx, &capture)) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(seeds_mu);
+    /* Another thread may have taken it meanwhile */
+    if (!seed_is_new(*corpus, hash)) {
+      return;
+    }
+    seeds_pending_bytes += capture.size();
+    corpus->pending.emplace_back(hash, std::move(capture));
+    if (seeds_pending_bytes >= SEED_BATCH_BYTES) {
+      flush_all_seeds();
+    }
+  }
 #endif
 
 #if defined(IVYSYN_COLLECT_TYPES)
@@ -137,7 +1601,7 @@ namespace tffuzzing {
     struct stat stat_buffer = {};
     std::string out_str;
     std::string attrs;
-    std::string types_filename, gpu_filename, cpu_filename;
+    std::string types_filename, gpu_filename, cpu_filename, capture_filename;
     tensorflow::Tensor tensor;
     tensorflow::DataType ttype;
 
@@ -149,6 +1613,11 @@ namespace tffuzzing {
     types_filename = std::string(results_dir) + "/" + fname + ".types";
     cpu_filename = std::string(results_dir) + "/" + fname + ".cpu";
     gpu_filename = std::string(results_dir) + "/" + fname + ".gpu";
+    capture_filename = std::string(results_dir) + "/" + fname + ".capture";
+
+#if defined(IVYSYN_CAPTURE_SEEDS)
+    capture_seed(fname, ctx);
+#endif
 
     std::ios_base::openmode fflags = std::ios::out | std::ios::in | std::ios::trunc;
 
@@ -193,6 +1662,9 @@ namespace tffuzzing {
     out_str += "\n--------------------------------------\n";
     types_file << out_str << std::flush;
     types_file.close();
+
+    /* Lossless, for replay/replay.cc */
+    write_kernel_capture(capture_filename, ctx);
   }
 
 #elif defined(IVYSYN_VALIDATE)
@@ -224,346 +1696,88 @@ namespace tffuzzing {
     }
 
     exists_check = stat(check_filename.c_str(), &stat_buffer) == 0;
-
-    /* If a check file exists, it means the kernel crashed
-     * when we checked it, log it as correctly validated */
-    if (exists_check) {
-      std::fstream true_positive_file;
-      create_file(true_positive_filename, true_positive_file, std::ios::out);
-      std::remove(check_filename.c_str());
-      exists_false_pos = stat(false_positive_filename.c_str(), &stat_buffer) == 0;
-      if (exists_false_pos) {
-        std::remove(false_positive_filename.c_str());
-      }
-      _should_validate = false;
-      return;
-    } else {
-      std::fstream check_file;
-      create_file(check_filename, check_file, std::ios::out);
-    }
-
-    /* We should check if the crash for this kernel is a true positive */
-    _should_validate = true;
-
-    std::cout << "Will validate " << fname << std::endl;
-  }
-
-  bool Fuzzer::should_validate()
-  {
-    return _should_validate;
-  }
-
-
-  /* Parse the logged crash and recreate the context that caused the crash */
-  tensorflow::OpKernelContext *Fuzzer::get_validate_context()
-  {
-
-    tensorflow::DataType ttype;
-    tensorflow::OpKernelContext::Params *validate_ctx_params = original_ctx->get_params();
-    std::vector<tensorflow::TensorValue> fuzz_vec;
-    tensorflow::TensorValue *fuzz_tensval_ptr;
-    tensorflow::OpKernelContext *validate_ctx = nullptr;
-
-    tensorflow::TensorShape tensor_shape;
-
-    std::vector<tensorflow::qint8> arg_qint8_vec;
-    std::vector<tensorflow::qint16> arg_qint16_vec;
-    std::vector<tensorflow::qint32> arg_qint32_vec;
-    std::vector<tensorflow::quint8> arg_quint8_vec;
-    std::vector<tensorflow::quint16> arg_quint16_vec;
-    std::vector<tensorflow::int8> arg_int8_vec;
-    std::vector<tensorflow::int16> arg_int16_vec;
-    std::vector<tensorflow::int32> arg_int32_vec;
-    std::vector<tensorflow::int64> arg_int64_vec;
-    std::vector<tensorflow::uint8> arg_uint8_vec;
-    std::vector<tensorflow::uint16> arg_uint16_vec;
-    std::vector<tensorflow::uint32> arg_uint32_vec;
-    std::vector<tensorflow::uint64> arg_uint64_vec;
-    std::vector<float> arg_float_vec;
-    std::vector<Eigen::half> arg_half_vec;
-    std::vector<double> arg_double_vec;
-    std::vector<bool> arg_bool_vec;
-    std::vector<tensorflow::tstring> arg_string_vec;
-
-    std::string contents_str;
-    std::string shape_str;
-    std::string type_str;
-
-    std::string dim_str;
-    std::string arg_str;
-
-    int dim, dummy;
-    long ldummy;
-
-    std::string validate_filename = std::string(results_dir) + "/" + cur_fname + ".validate";
-    std::ifstream validate_file(validate_filename);
-
-    int inputs_read = 0;
-    while (std::getline(validate_file, contents_str)) {
-      inputs_read++;
-      std::stringstream contents_sstream(contents_str);
-
-      std::getline(validate_file, shape_str);
-      std::stringstream shape_sstream(shape_str);
-      tensor_shape = tensorflow::TensorShape();
-      if (shape_str.compare("") != 0) {
-        while (shape_sstream.good()) {
-          std::getline(shape_sstream, dim_str, ',');
-          dim = std::stoi(dim_str);
-          /* std::cout << "Dim str: " << dim_str << std::endl; */
-          /* std::cout << "Dim: " << dim << std::endl; */
-          tensor_shape.AddDim(dim);
-        }
-      }
-
-      std::getline(validate_file, type_str);
-      if (type_str.compare("qint8") == 0) {
-          ttype = tensorflow::DataType::DT_QINT8;
-          arg_qint8_vec = {};
-          if (contents_str.compare("[]") != 0) {
-            while (contents_sstream.good()) {
-              std::getline(contents_sstream, arg_str, ',');
-              dummy = std::stoi(arg_str);
-              arg_qint8_vec.push_back(tensorflow::qint8(dummy));
-            }
-          }
-          fuzz_tensval_ptr = get_tensor_with_shape_and_multiple_values(arg_qint8_vec, ttype, tensor_shape);
-          fuzz_vec.push_back(*fuzz_tensval_ptr);
-      }
-      else if (type_str.compare("qint16") == 0) {
-          ttype = tensorflow::DataType::DT_QINT16;
-          arg_qint16_vec = {};
-          if (contents_str.compare("[]") != 0) {
-            while (contents_sstream.good()) {
-              std::getline(contents_sstream, arg_str, ',');
-              dummy = std::stoi(arg_str);
-              arg_qint16_vec.push_back(tensorflow::qint16(dummy));
-            }
-          }
-          fuzz_tensval_ptr = get_tensor_with_shape_and_multiple_values(arg_qint16_vec, ttype, tensor_shape);
-          fuzz_vec.push_back(*fuzz_tensval_ptr);
-      }
-      else if (type_str.compare("qint32") == 0) {
-          ttype = tensorflow::DataType::DT_QINT32;
-          arg_qint32_vec = {};
-          if (contents_str.compare("[]") != 0) {
-            while (contents_sstream.good()) {
-              std::getline(contents_sstream, arg_str, ',');
-              dummy = std::stoi(arg_str);
-              arg_qint32_vec.push_back(tensorflow::qint32(dummy));
-            }
-          }
-          fuzz_tensval_ptr = get_tensor_with_shape_and_multiple_values(arg_qint32_vec, ttype, tensor_shape);
-          fuzz_vec.push_back(*fuzz_tensval_ptr);
-      }
-      else if (type_str.compare("quint8") == 0) {
-          ttype = tensorflow::DataType::DT_QUINT8;
-          arg_quint8_vec = {};
-          if (contents_str.compare("[]") != 0) {
-            while (contents_sstream.good()) {
-              std::getline(contents_sstream, arg_str, ',');
-              dummy = std::stoi(arg_str);
-              arg_quint8_vec.push_back(tensorflow::quint8(dummy));
-            }
-          }
-          fuzz_tensval_ptr = get_tensor_with_shape_and_multiple_values(arg_quint8_vec, ttype, tensor_shape);
-          fuzz_vec.push_back(*fuzz_tensval_ptr);
-      }
-      else if (type_str.compare("quint16") == 0) {
-          ttype = tensorflow::DataType::DT_QUINT16;
-          arg_quint16_vec = {};
-          if (contents_str.compare("[]") != 0) {
-            while (contents_sstream.good()) {
-              std::getline(contents_sstream, arg_str, ',');
-              dummy = std::stoi(arg_str);
-              arg_quint16_vec.push_back(tensorflow::quint16(dummy));
-            }
-          }
-          fuzz_tensval_ptr = get_tensor_with_shape_and_multiple_values(arg_quint16_vec, ttype, tensor_shape);
-          fuzz_vec.push_back(*fuzz_tensval_ptr);
-      }
-      else if (type_str.compare("int8") == 0) {
-          ttype = tensorflow::DataType::DT_INT8;
-          arg_int8_vec = {};
-          if (contents_str.compare("[]") != 0) {
-            while (contents_sstream.good()) {
-              std::getline(contents_sstream, arg_str, ',');
-              dummy = std::stoi(arg_str);
-              arg_int8_vec.push_back(tensorflow::int8(dummy));
-            }
-          }
-          fuzz_tensval_ptr = get_tensor_with_shape_and_multiple_values(arg_int8_vec, ttype, tensor_shape);
-          fuzz_vec.push_back(*fuzz_tensval_ptr);
-      }
-      else if (type_str.compare("int16") == 0) {
-          ttype = tensorflow::DataType::DT_INT16;
-          arg_int16_vec = {};
-          if (contents_str.compare("[]") != 0) {
-            while (contents_sstream.good()) {
-              std::getline(contents_sstream, arg_str, ',');
-              dummy = std::stoi(arg_str);
-              arg_int16_vec.push_back(tensorflow::int16(dummy));
-            }
-          }
-          fuzz_tensval_ptr = get_tensor_with_shape_and_multiple_values(arg_int16_vec, ttype, tensor_shape);
-          fuzz_vec.push_back(*fuzz_tensval_ptr);
-      }
-      else if (type_str.compare("int32") == 0) {
-          ttype = tensorflow::DataType::DT_INT32;
-          arg_int32_vec = {};
-          if (contents_str.compare("[]") != 0) {
-            while (contents_sstream.good()) {
-              std::getline(contents_sstream, arg_str, ',');
-              dummy = std::stoi(arg_str);
-              arg_int32_vec.push_back(tensorflow::int32(dummy));
-            }
-          }
-          fuzz_tensval_ptr = get_tensor_with_shape_and_multiple_values(arg_int32_vec, ttype, tensor_shape);
-          fuzz_vec.push_back(*fuzz_tensval_ptr);
-      }
-      else if (type_str.compare("int64") == 0) {
-          ttype = tensorflow::DataType::DT_INT64;
-          arg_int64_vec = {};
-          if (contents_str.compare("[]") != 0) {
-            while (contents_sstream.good()) {
-              std::getline(contents_sstream, arg_str, ',');
-              ldummy = std::stol(arg_str);
-              arg_int64_vec.push_back(tensorflow::int64(ldummy));
-            }
-          }
-          fuzz_tensval_ptr = get_tensor_with_shape_and_multiple_values(arg_int64_vec, ttype, tensor_shape);
-          fuzz_vec.push_back(*fuzz_tensval_ptr);
-      }
-      else if (type_str.compare("uint8") == 0) {
-          ttype = tensorflow::DataType::DT_UINT8;
-          arg_uint8_vec = {};
-          if (contents_str.compare("[]") != 0) {
-            while (contents_sstream.good()) {
-              std::getline(contents_sstream, arg_str, ',');
-              dummy = std::stoi(arg_str);
-              arg_uint8_vec.push_back(tensorflow::uint8(dummy));
-            }
-          }
-          fuzz_tensval_ptr = get_tensor_with_shape_and_multiple_values(arg_uint8_vec, ttype, tensor_shape);
-          fuzz_vec.push_back(*fuzz_tensval_ptr);
-      }
-      else if (type_str.compare("uint16") == 0) {
-          ttype = tensorflow::DataType::DT_UINT16;
-          arg_uint16_vec = {};
-          if (contents_str.compare("[]") != 0) {
-            while (contents_sstream.good()) {
-              std::getline(contents_sstream, arg_str, ',');
-              dummy = std::stoi(arg_str);
-              arg_uint16_vec.push_back(tensorflow::uint16(dummy));
-            }
-          }
-          fuzz_tensval_ptr = get_tensor_with_shape_and_multiple_values(arg_uint16_vec, ttype, tensor_shape);
-          fuzz_vec.push_back(*fuzz_tensval_ptr);
-      }
-      else if (type_str.compare("uint32") == 0) {
-          ttype = tensorflow::DataType::DT_UINT32;
-          arg_uint32_vec = {};
-          if (contents_str.compare("[]") != 0) {
-            while (contents_sstream.good()) {
-              std::getline(contents_sstream, arg_str, ',');
-              dummy = std::stoi(arg_str);
-              arg_uint32_vec.push_back(tensorflow::uint32(dummy));
-            }
-          }
-          fuzz_tensval_ptr = get_tensor_with_shape_and_multiple_values(arg_uint32_vec, ttype, tensor_shape);
-          fuzz_vec.push_back(*fuzz_tensval_ptr);
-      }
-      else if (type_str.compare("uint64") == 0) {
-          ttype = tensorflow::DataType::DT_UINT64;
-          arg_uint64_vec = {};
-          if (contents_str.compare("[]") != 0) {
-            while (contents_sstream.good()) {
-              std::getline(contents_sstream, arg_str, ',');
-              ldummy = std::stol(arg_str);
-              arg_uint64_vec.push_back(tensorflow::uint64(ldummy));
-            }
-          }
-          fuzz_tensval_ptr = get_tensor_with_shape_and_multiple_values(arg_uint64_vec, ttype, tensor_shape);
-          fuzz_vec.push_back(*fuzz_tensval_ptr);
-      }
-      else if (type_str.compare("float32") == 0) {
-          ttype = tensorflow::DataType::DT_FLOAT;
-          arg_float_vec = {};
-          if (contents_str.compare("[]") != 0) {
-            while (contents_sstream.good()) {
-              std::getline(contents_sstream, arg_str, ',');
-              arg_float_vec.push_back(std::stof(arg_str));
-            }
-          }
-          fuzz_tensval_ptr = get_tensor_with_shape_and_multiple_values(arg_float_vec, ttype, tensor_shape);
-          fuzz_vec.push_back(*fuzz_tensval_ptr);
-      }
-      else if (type_str.compare("half") == 0) {
-          ttype = tensorflow::DataType::DT_HALF;
-          arg_half_vec = {};
-          if (contents_str.compare("[]") != 0) {
-            while (contents_sstream.good()) {
-              std::getline(contents_sstream, arg_str, ',');
-              arg_half_vec.push_back(Eigen::half(std::stof(arg_str)));
-            }
-          }
-          fuzz_tensval_ptr = get_tensor_with_shape_and_multiple_values(arg_half_vec, ttype, tensor_shape);
-          fuzz_vec.push_back(*fuzz_tensval_ptr);
-      }
-      else if (type_str.compare("float64") == 0) {
-          ttype = tensorflow::DataType::DT_DOUBLE;
-          arg_double_vec = {};
-          if (contents_str.compare("[]") != 0) {
-            while (contents_sstream.good()) {
-              std::getline(contents_sstream, arg_str, ',');
-              arg_double_vec.push_back(std::stod(arg_str));
-            }
-          }
-          fuzz_tensval_ptr = get_tensor_with_shape_and_multiple_values(arg_double_vec, ttype, tensor_shape);
-          fuzz_vec.push_back(*fuzz_tensval_ptr);
-      }
-      else if (type_str.compare("bool") == 0) {
-          ttype = tensorflow::DataType::DT_BOOL;
-          arg_bool_vec = {};
-          if (contents_str.compare("[]") != 0) {
-            while (contents_sstream.good()) {
-              std::getline(contents_sstream, arg_str, ',');
-              if (arg_str.compare("True") == 0) {
-                arg_bool_vec.push_back(true);
-              } else {
-                arg_bool_vec.push_back(false);
-              }
-            }
-          }
-          fuzz_tensval_ptr = get_tensor_with_shape_and_multiple_values(arg_bool_vec, ttype, tensor_shape);
-          fuzz_vec.push_back(*fuzz_tensval_ptr);
-      }
-      else if (type_str.compare("string") == 0) {
-          ttype = tensorflow::DataType::DT_STRING;
-          arg_string_vec = {};
-          arg_string_vec.push_back(tensorflow::tstring(contents_str));
-          fuzz_tensval_ptr = get_tensor_with_shape_and_multiple_values(arg_string_vec, ttype, tensor_shape);
-          fuzz_vec.push_back(*fuzz_tensval_ptr);
+
+    /* If a check file exists, it means the kernel crashed
+     * when we checked it, log it as correctly validated */
+    if (exists_check) {
+      std::fstream true_positive_file;
+      create_file(true_positive_filename, true_positive_file, std::ios::out);
+      std::remove(check_filename.c_str());
+      exists_false_pos = stat(false_positive_filename.c_str(), &stat_buffer) == 0;
+      if (exists_false_pos) {
+        std::remove(false_positive_filename.c_str());
       }
+      _should_validate = false;
+      return;
+    } else {
+      std::fstream check_file;
+      create_file(check_filename, check_file, std::ios::out);
     }
 
-    std::cout << "Created inputs: " << std::endl;
-    for (auto tensor_val : fuzz_vec) {
-      std::cout << tensor_val.tensor->DebugString() << std::endl;
-    }
+    /* We should check if the crash for this kernel is a true positive */
+    _should_validate = true;
+
+    std::cout << "Will validate " << fname << std::endl;
+  }
+
+  bool Fuzzer::should_validate()
+  {
+    return _should_validate;
+  }
+
 
+  /*
+   * Recreate the context that caused the crash from its crash record. The
+   * inputs are the ones that crashed, byte for byte, and the memcpy'able ones
+   * are not even copied. Resources can't be carried over from the fuzzing
+   * run, those are taken from the context of the test.
+   */
+  tensorflow::OpKernelContext *Fuzzer::get_validate_context()
+  {
+    tensorflow::OpKernelContext::Params *validate_ctx_params = original_ctx->get_params();
+    tensorflow::OpKernelContext *validate_ctx = nullptr;
+    std::string validate_filename = std::string(results_dir) + "/" + cur_fname + ".validate";
+    std::string check_filename = std::string(results_dir) + "/" + cur_fname + ".check";
+    /* Outlives the context, the inputs point to its tensors */
+    struct kernel_capture *record = new struct kernel_capture();
     tensorflow::gtl::InlinedVector<tensorflow::TensorValue, 4> *fuzz_inputs = new
-      tensorflow::gtl::InlinedVector<tensorflow::TensorValue, 4>(fuzz_vec.begin(), fuzz_vec.end());
+      tensorflow::gtl::InlinedVector<tensorflow::TensorValue, 4>();
+
     /*
-     * Make sure we match the number of inputs we read. If not, remove the check
-     * filename such that false_positive() won't log this kernel. The kernel
-     * will eventually get reached by the driver having the expected number of
-     * inputs
+     * If the record can't be read or doesn't match the number of inputs,
+     * remove the check filename such that false_positive() won't log this
+     * kernel. The kernel will eventually get reached by the driver having
+     * the expected number of inputs
      */
-    if (original_ctx->num_inputs() != inputs_read) {
-      std::string check_filename = std::string(results_dir) + "/" + cur_fname + ".check";
+    if (!map_crash_record(validate_filename, record)) {
+      std::cout << "Failed to read " << validate_filename << " (text .validate files need crash_records.py)" << std::endl;
+      record->inputs.clear();
+      record->has_input.clear();
+      std::remove(check_filename.c_str());
+    } else if ((size_t) original_ctx->num_inputs() != record->inputs.size()) {
       std::remove(check_filename.c_str());
     }
+
+    for (size_t i = 0; i < record->inputs.size(); i++) {
+      if (record->has_input[i] && record->inputs[i].dtype() != tensorflow::DataType::DT_RESOURCE) {
+        fuzz_inputs->push_back(tensorflow::TensorValue(&record->inputs[i]));
+      } else if (i < original_inputs->size()) {
+        fuzz_inputs->push_back((*original_inputs)[i]);
+      } else {
+        fuzz_inputs->push_back(tensorflow::TensorValue());
+      }
+    }
+    if (record->inputs.empty()) {
+      fuzz_inputs->assign(original_inputs->begin(), original_inputs->end());
+    }
+
+    std::cout << "Created inputs: " << std::endl;
+    for (auto tensor_val : *fuzz_inputs) {
+      if (tensor_val.tensor != nullptr) {
+        std::cout << tensor_val.tensor->DebugString() << std::endl;
+      }
+    }
+
     validate_ctx_params->inputs = fuzz_inputs;
     validate_ctx = new tensorflow::OpKernelContext(validate_ctx_params);
     std::cout << "Returning validate context with " << validate_ctx->num_inputs() << " inputs"<< std::endl;
@@ -611,12 +1825,8 @@ namespace tffuzzing {
     main_pool_done = false;
 
     std::string mutfile_pattern;
-    std::string mutfile_prefix;
-    std::string proc_filename;
     std::string mut_filename;
-    std::string last_timestamp_filename;
     std::string time_filename;
-    std::string except_filename;
     std::string total_filename;
     std::string start_filename;
     std::string nofuzz_filename;
@@ -626,15 +1836,14 @@ namespace tffuzzing {
 
     bool restore = false, do_resume = false;
     long long last_mutation = -1, last_timestamp = -1;
+    unsigned long long crash_bucket = 0;
+    int crash_signal = 0;
     struct stat stat_buffer = {};
     struct timespec ts;
 
     glob_t glob_result = {0};
     int glob_ret = {};
     pid_t mypid = 0;
-    char *existing_pid;
-    bool got_last = false;
-    int tries = 0;
     bool log_crash;
 
     tensorflow::Tensor tensor;
@@ -657,64 +1866,45 @@ namespace tffuzzing {
 
     mypid = ::getpid();
 
+    if (!claim_kernel()) {
+      /* Another process is fuzzing this kernel (or all its shards) right now */
+      total_mutations = 0;
+      is_running = true;
+      return;
+    }
+
     mutfile_pattern = std::string(results_dir) + "/" + cur_fname + "_mutations.log.*";
-    mutfile_prefix = std::string(results_dir) + "/" + cur_fname + "_mutations.log";
 
     mut_filename = std::string(results_dir) + "/" + cur_fname + "_mutations.log." + std::to_string(mypid);
-    last_timestamp_filename = std::string(results_dir) + "/" + cur_fname + ".last_timestamp." + std::to_string(mypid);
     time_filename = std::string(results_dir) + "/" + cur_fname + ".time." + std::to_string(mypid);
-    except_filename = std::string(results_dir) + "/" + cur_fname + ".failed." + std::to_string(mypid);
+    ring_filename = std::string(results_dir) + "/" + cur_fname + ".ring." + std::to_string(mypid);
     start_filename = std::string(results_dir) + "/" + cur_fname + ".start";
     total_filename = std::string(results_dir) + "/totals.txt";
     nofuzz_filename = std::string(results_dir) + "/" + cur_fname + ".nofuzz";
+    snprintf(hang_filename, FILENAME_SZ, "%s/%s.hang", results_dir, cur_fname.c_str());
 
     fflags = std::ios::out | std::ios::in | std::ios::trunc;
 
     mutations_logger_filename = mut_filename;
-    timestamp_logger_filename = last_timestamp_filename;
-
-    std::mt19937_64 rng(std::random_device{}());
-    std::uniform_int_distribution<std::mt19937_64::result_type> dist(0, 2000);
-    int slp = dist(rng);
-    std::this_thread::sleep_for(std::chrono::milliseconds(slp));
 
+    /*
+     * We own the kernel, so any mutation file left for it belongs to a process
+     * that crashed or was killed. Restore from the one that got to a mutation,
+     * the rest never ran anything.
+     */
     glob_ret = glob(mutfile_pattern.c_str(), 0, NULL, &glob_result);
-    if (glob_ret != GLOB_NOMATCH && !restore) {
-
-      // A lot of empty mutation files, probably deadlock or bug, stop
-      // fuzzing this kernel
-      if (glob_result.gl_pathc > 5) {
-        mark_fuzzing_done();
-        std::cout << cur_fname << " has a lot of empty mutation files, skipping" << std::endl;
-        return;
-      }
-
-      // A mutation file for the same function exists
-      for(size_t i = 0; i < glob_result.gl_pathc && !restore; ++i) {
-
-        existing_pid = glob_result.gl_pathv[i] + mutfile_prefix.length() + 1;
-        proc_filename = "/proc/" + std::string(existing_pid);
-
-        if (stat(proc_filename.c_str(), &stat_buffer) == 0){
-          // The mutations file belongs to a running process, skip
-          /* printf("%s belongs to a running process, skipping\n", glob_result.gl_pathv[i]); */
-          total_mutations = 0;
-          is_running = true;
-          globfree(&glob_result);
-          return;
-        } else {
-          // The mutations file doesn't belong to any running process, something crashed
+    if (glob_ret == 0) {
+      for (size_t i = 0; i < glob_result.gl_pathc; ++i) {
+        recover_stale_files(glob_result.gl_pathv[i]);
+        if (!restore && read_progress_slot(glob_result.gl_pathv[i], &last_mutation, &last_timestamp,
+                                           &crash_bucket, &crash_signal)
+            && last_mutation >= 0) {
           mutations_restore_filename = glob_result.gl_pathv[i];
-          size_t mut_str_idx = mutations_restore_filename.find("_mutations.log");
-          timestamp_restore_filename = mutations_restore_filename;
-          timestamp_restore_filename.replace(mut_str_idx, std::string("_mutations.log").length(), ".last_timestamp");
-          /* std::cout << cur_fname << "crashed, will restore from " << mutations_restore_filename << std::endl; */
           restore = true;
-
-          if (was_killed(cur_fname)) {
-            do_resume = true;
-          }
-
+          /* Killed by the watchdog or timed out, no crash to log */
+          do_resume = was_killed(cur_fname);
+        } else {
+          std::remove(glob_result.gl_pathv[i]);
         }
       }
     }
@@ -724,28 +1914,25 @@ namespace tffuzzing {
       std::cout << mypid << ": " << cur_fname << " was killed, will resume from " << mutations_restore_filename << std::endl;
     } else if (restore) {
       std::cout << mypid << ": " << cur_fname << " crashed, will restore from " << mutations_restore_filename << std::endl;
-    } else {
-      create_file(time_filename, time_file, fflags);
-      time_file.rdbuf()->pubsetbuf(nullptr, 0);
-      create_file(except_filename, except_file, fflags);
-      except_file.rdbuf()->pubsetbuf(nullptr, 0);
     }
 
+    owns_ring = start_mutation_ring(ring_filename, time_filename);
+
     std::cout << mypid << ": Fuzzing function " << cur_fname << std::endl;
 
-    /* Disable buffering else program might crash before writing to logger */
-    create_file(mutations_logger_filename, mutations_file, fflags);
-    mutations_file.rdbuf()->pubsetbuf(nullptr, 0);
-    create_file(last_timestamp_filename, last_timestamp_file, fflags);
-    last_timestamp_file.rdbuf()->pubsetbuf(nullptr, 0);
+    /* Shared mapping, the progress is kept even if the program crashes */
+    unmap_progress_slot(progress);
+    progress = map_progress_slot(mutations_logger_filename, cur_fname);
+    if (restore && progress != nullptr) {
+      copy_slot_history(mutations_restore_filename, progress);
+    }
 
     if (!restore) {
 
+      /* Started before but died before its first mutation, don't retry */
       if (stat(start_filename.c_str(), &stat_buffer) == 0) {
-          std::remove(mutations_restore_filename.c_str());
-          std::remove(timestamp_restore_filename.c_str());
-          total_mutations = 0;
-          is_running = true;
+          std::cout << mypid << ": " << cur_fname << " crashed before any mutation, skipping" << std::endl;
+          mark_fuzzing_done();
           return;
       }
 
@@ -778,6 +1965,7 @@ namespace tffuzzing {
     }
 
     auto shuf_rng = std::default_random_engine(RNG_SEED);
+    arg_tensors.resize(num_args);
     initialize_tensor_pools();
     std::shuffle(std::begin(int8_mutations), std::end(int8_mutations), shuf_rng);
     std::shuffle(std::begin(uint8_mutations), std::end(uint8_mutations), shuf_rng);
@@ -790,6 +1978,12 @@ namespace tffuzzing {
     std::shuffle(std::begin(double_mutations), std::end(double_mutations), shuf_rng);
     std::shuffle(std::begin(string_mutations), std::end(string_mutations), shuf_rng);
     calculate_total_mutations();
+#if defined(IVYSYN_NUM_SHARDS)
+    set_shard_range();
+#endif
+#if defined(IVYSYN_COVERAGE)
+    init_coverage();
+#endif
 
     /* std::cout << "Calculated total mutations for " << fname << std::endl; */
 
@@ -803,38 +1997,21 @@ namespace tffuzzing {
       }
       total_file << cur_fname << ":" << all_mutations << std::endl << std::flush;
       total_file.close();
+      log_pool_bytes();
+#if defined(IVYSYN_GUARD_PAGES)
+      log_guard_slack();
+#endif
     }
 
     /* std::cout << "Will restore for:" << fname << ":" << restore << std::endl; */
 
     if (restore) {
 
-      mutations_restore.open(mutations_restore_filename, std::ios::out | std::ios::in);
-      timestamp_restore.open(timestamp_restore_filename, std::ios::out | std::ios::in);
-      std::string last_line;
-      while (!got_last && tries < 10) {
-        getline(mutations_restore, last_line);
-        if (last_line.length() > 0) {
-          last_mutation = std::stoll(last_line);
-          got_last = true;
-        } else {
-          std::cout << "Error while reading " << mutations_restore_filename << " (got " << last_line << ") ..." << std::endl;
-          tries++;
-        }
-      }
-      getline(timestamp_restore, last_line);
-      if (last_line.length() <= 0) {
-        std::cout << "Error while reading last timestamp" << std::endl;
-      } else {
-        last_timestamp = std::stoll(last_line);
-      }
-
       if (last_mutation >= 0) {
         /* std::cout << "Restoring from mutation " << last_mutation << std::endl; */
-        restore_last_mutation(last_mutation, last_timestamp, do_resume);
+        restore_last_mutation(last_mutation, last_timestamp, crash_bucket, crash_signal, do_resume);
         /* Delete the file since we already logged the crash */
         std::remove(mutations_restore_filename.c_str());
-        std::remove(timestamp_restore_filename.c_str());
       }
     } else {
       if (num_args > 0) {
@@ -842,53 +2019,52 @@ namespace tffuzzing {
       }
     }
 
-    struct sigaction timeout_sigaction = {};
-    timeout_sigaction.sa_handler = handle_timeout;
-    sigaction(SIGALRM, &timeout_sigaction, NULL);
-    alarm(TIMEOUT_SECS);
+    /* Armed around each mutation, see arm_watchdog() */
+    struct sigaction hang_sigaction = {};
+    hang_sigaction.sa_handler = handle_hang;
+    sigaction(SIGALRM, &hang_sigaction, NULL);
+
+#if defined(IVYSYN_GUARD_OUTPUTS)
+    snprintf(guard_fault_filename, FILENAME_SZ, "%s/%s.guard_fault", results_dir, cur_fname.c_str());
+    struct sigaction segv_sigaction = {};
+    segv_sigaction.sa_sigaction = handle_guard_fault;
+    segv_sigaction.sa_flags = SA_SIGINFO;
+    sigaction(SIGSEGV, &segv_sigaction, NULL);
+#endif
+
+    /* After the guard fault handler, which it chains to */
+    install_crash_handlers();
 
   }
 #endif
 
   Fuzzer::~Fuzzer()
   {
-    /* Cancel current alarm */
-    alarm(0);
-  }
-
-  template <class T>
-    tensorflow::TensorValue *Fuzzer::get_tensor_with_shape_and_multiple_values(std::vector<T> values, tensorflow::DataType ttype,
-                                                          tensorflow::TensorShape shape)
-    {
-
-      tensorflow::Tensor *tensor;
-      tensorflow::TensorValue *tensor_val;
-      int idx = 0;
-
-      tensor = new tensorflow::Tensor(ttype, shape);
-
-      /* std::cout << "Creating tensor with multiple values: " << std::endl; */
-      if (values.size() == 1) {
-          tensor->flat<T>().setConstant(values.at(0));
-      } else {
-        for (auto val: values) {
-          /* std::cout << val << std::endl; */
-          tensor->flat<T>()(idx++) = val;
-        }
-      }
-
-      tensor_val = new tensorflow::TensorValue(tensor);
-
-      return tensor_val;
 
+#if !defined(IVYSYN_VALIDATE) && !defined(IVYSYN_COLLECT_TYPES)
+    if (hang_timer_pid == ::getpid()) {
+      timer_delete(hang_timer);
     }
-
+    if (owns_ring) {
+      stop_mutation_ring(ring_filename);
+    }
+#if defined(IVYSYN_FUZZ_DEVICE)
+    if (fuzz_device != nullptr) {
+      original_ctx->get_params()->device = original_device;
+      delete fuzz_device;
+    }
+#endif
+    /* Releases the kernel */
+    if (lock_fd >= 0) {
+      close(lock_fd);
+    }
+    delete cur_fuzz_ctx;
+#endif
+  }
 
 #if !defined(IVYSYN_VALIDATE) && !defined(IVYSYN_COLLECT_TYPES)
   tensorflow::TensorValue Fuzzer::get_next_mut(tensorflow::DataType ttype, int idx) {
 
-    tensorflow::Tensor *tensor;
-
     switch (ttype) {
       default:
         mark_unknown_type(ttype);
@@ -933,9 +2109,8 @@ namespace tffuzzing {
       case tensorflow::DataType::DT_VARIANT:
         {
           /* std::cout << "Creating DT_VARIANT tensor\n" << std::flush; */
-          tensorflow::Tensor orig = original_ctx->input(idx);
-          tensor = new tensorflow::Tensor(tensorflow::tensor::DeepCopy(orig));
-          return tensorflow::TensorValue(tensor);
+          arg_tensors[idx] = tensorflow::tensor::DeepCopy(original_ctx->input(idx));
+          return tensorflow::TensorValue(&arg_tensors[idx]);
           /* return tensorflow::TensorValue(&orig); */
         }
 
@@ -944,8 +2119,8 @@ namespace tffuzzing {
       case tensorflow::DataType::DT_COMPLEX128:
       case tensorflow::DataType::DT_RESOURCE:
         {
-          tensor = new tensorflow::Tensor(original_ctx->input(idx));
-          return tensorflow::TensorValue(tensor);
+          arg_tensors[idx] = original_ctx->input(idx);
+          return tensorflow::TensorValue(&arg_tensors[idx]);
         }
     }
   }
@@ -997,7 +2172,52 @@ namespace tffuzzing {
     file << out_str << std::flush;
   }
 
-  void Fuzzer::increase_num_crashes()
+  /* The same mutation as log_current_mutation(), without losing anything */
+  void Fuzzer::log_crash_record(const std::string& filename)
+  {
+    std::vector<const tensorflow::Tensor *> inputs;
+    tensorflow::OpKernelContext *ctx;
+
+    if (!main_pool_done) {
+      for (int idx = 0; idx < num_args; idx++) {
+        inputs.push_back(get_next_mut(tensor_types.at(idx), idx).tensor);
+      }
+    } else {
+      ctx = get_fuzzed_context();
+      for (int idx = 0; idx < num_args; idx++) {
+        inputs.push_back((*ctx->get_params()->inputs)[idx].tensor);
+      }
+    }
+
+    append_crash_record(filename, total_mutations, original_ctx->op_kernel().def(),
+                        original_ctx->device()->attributes().device_type(), inputs);
+  }
+
+  /*
+   * <kernel>.buckets has a line per crash: its stack hash bucket (0 if it
+   * wasn't hashed, e.g. a SIGKILL), the mutation and the signal. Returns how
+   * many of the crashes were in a bucket seen before, and whether crash_bucket
+   * was seen.
+   */
+  static long long scan_crash_buckets(const std::string& filename, unsigned long long crash_bucket, bool *seen)
+  {
+    std::ifstream buckets_file(filename);
+    std::set<unsigned long long> buckets;
+    unsigned long long bucket;
+    long long mutation, duplicates = 0;
+    int sig;
+
+    while (buckets_file >> std::hex >> bucket >> std::dec >> mutation >> sig) {
+      if (!buckets.insert(bucket).second) {
+        duplicates++;
+      }
+    }
+
+    *seen = buckets.count(crash_bucket) > 0;
+    return duplicates;
+  }
+
+  void Fuzzer::increase_num_crashes(unsigned long long crash_bucket, int crash_signal)
   {
 
     long long num_crashes = 0; // Used to bound number of crashes
@@ -1006,7 +2226,12 @@ namespace tffuzzing {
     std::string crashes_num_filename;
     std::fstream run_file;
     std::string run_filename;
+    std::fstream buckets_file;
+    std::string buckets_filename;
     std::string last_line;
+    long long duplicates;
+    bool seen;
+    char line[BUFSZ];
     char logbuf[LOGBUFSZ];
     memset(logbuf, 0, LOGBUFSZ);
 
@@ -1032,8 +2257,21 @@ namespace tffuzzing {
     num_crashes_file.flush();
     /* num_crashes_file.close(); */
 
-    if (num_crashes >= CRASHES_BOUND) {
-      std::cout << "Function " << cur_fname << " crashed " << CRASHES_BOUND << " times, skipping rest of fuzzing" << std::endl;
+    buckets_filename = std::string(results_dir) + "/" + cur_fname + ".buckets";
+    duplicates = scan_crash_buckets(buckets_filename, crash_bucket, &seen);
+    if (seen) {
+      duplicates++;
+    }
+
+    buckets_file.open(buckets_filename, std::ios::out | std::ios::app);
+    snprintf(line, BUFSZ, "%016llx %lld %d\n", crash_bucket, total_mutations, crash_signal);
+    buckets_file << line << std::flush;
+    buckets_file.close();
+
+    /* New buckets are new bugs, keep going until they stop showing up */
+    if (duplicates >= CRASH_DUPLICATES_BOUND || num_crashes >= CRASHES_BOUND) {
+      std::cout << "Function " << cur_fname << " crashed " << num_crashes << " times, " << duplicates
+                << " in buckets seen before, skipping rest of fuzzing" << std::endl;
 
       run_filename = std::string(results_dir) + "/" + cur_fname + ".run";
       create_file(run_filename, run_file, fflags);
@@ -1048,11 +2286,321 @@ namespace tffuzzing {
     return;
   }
 
-  void Fuzzer::restore_last_mutation(long long last_mutation, long long last_timestamp, bool do_resume)
+  /*
+   * Take ownership of fname through an exclusive flock() on <fname>.lock.
+   * The lock goes away with the process that holds it, so if we get it,
+   * whoever fuzzed it before us is done, crashed or was killed. Returns false
+   * if another live process holds it.
+   */
+  bool Fuzzer::lock_kernel_file(const std::string& fname)
+  {
+    std::string lock_filename;
+    std::string pid_str;
+
+    lock_filename = std::string(results_dir) + "/" + fname + ".lock";
+
+    lock_fd = open(lock_filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (lock_fd < 0) {
+      std::cout << "Failed to open " << lock_filename << std::endl;
+      std::cout << "Error: " << strerror(errno) << std::endl;
+      return false;
+    }
+
+    if (flock(lock_fd, LOCK_EX | LOCK_NB) != 0) {
+      close(lock_fd);
+      lock_fd = -1;
+      return false;
+    }
+
+    /* Owner pid, only for whoever is looking at the results */
+    pid_str = std::to_string(::getpid()) + "\n";
+    if (ftruncate(lock_fd, 0) != 0 || pwrite(lock_fd, pid_str.c_str(), pid_str.length(), 0) < 0) {
+      std::cout << "Failed to write owner to " << lock_filename << std::endl;
+    }
+
+    return true;
+  }
+
+  /*
+   * With shards, take the first one that isn't done or owned by someone else
+   * and from then on go by its name (<kernel>.shard<i>) for everything but
+   * the merged results
+   */
+  bool Fuzzer::claim_kernel()
+  {
+#if defined(IVYSYN_NUM_SHARDS)
+    std::string shard_fname;
+
+    kernel_fname = cur_fname;
+    for (shard = 0; shard < IVYSYN_NUM_SHARDS; shard++) {
+      shard_fname = kernel_fname + ".shard" + std::to_string(shard);
+      if (!lock_kernel_file(shard_fname)) {
+        continue;
+      }
+      /* Checked under the lock, it may have finished since */
+      if (was_fuzzed(shard_fname)) {
+        close(lock_fd);
+        lock_fd = -1;
+        continue;
+      }
+      cur_fname = shard_fname;
+      cur_fname_glob.assign(cur_fname);
+      return true;
+    }
+
+    return false;
+#else
+    return lock_kernel_file(cur_fname);
+#endif
+  }
+
+#if defined(IVYSYN_NUM_SHARDS)
+  /*
+   * Only keep this shard's part of the main pool steps. The mutation numbers
+   * are still those of the whole kernel, so restoring works the same way
+   */
+  void Fuzzer::set_shard_range()
+  {
+    long long steps, first, last;
+
+    steps = all_mutations / num_mut_skip;
+    first = steps * shard / IVYSYN_NUM_SHARDS;
+    last = steps * (shard + 1) / IVYSYN_NUM_SHARDS;
+
+    total_mutations -= first * num_mut_skip;
+    /* The last shard runs to the end, like the kernel would unsharded */
+    if (shard < IVYSYN_NUM_SHARDS - 1) {
+      shard_stop = all_mutations - (last - 1) * num_mut_skip;
+    }
+
+    std::cout << "Shard " << shard << "/" << IVYSYN_NUM_SHARDS << ": steps " << first << " to " << last << std::endl;
+  }
+
+  static void append_file(const std::string& src_filename, const std::string& dst_filename,
+                          const std::string& header = "")
+  {
+    std::ifstream src_file(src_filename);
+    std::ofstream dst_file;
+
+    if (!src_file.is_open() || src_file.peek() == std::ifstream::traits_type::eof()) {
+      return;
+    }
+
+    dst_file.open(dst_filename, std::ios::out | std::ios::app);
+    dst_file << header;
+    dst_file << src_file.rdbuf();
+    dst_file.close();
+  }
+
+  /*
+   * Once all the shards are done, put their crashes and other findings
+   * together under the kernel's name and mark the kernel itself done, which is what the other
+   * processes and the synthesizer look at. The kernel's own lock keeps two
+   * shards that finish together from both doing it.
+   */
+  void Fuzzer::merge_shards()
+  {
+    std::string kernel_path = std::string(results_dir) + "/" + kernel_fname;
+    std::string shard_path;
+    std::fstream kernel_done_file;
+    struct timespec ts = {};
+    int fd;
+
+    for (int i = 0; i < IVYSYN_NUM_SHARDS; i++) {
+      if (!was_fuzzed(kernel_fname + ".shard" + std::to_string(i))) {
+        return;
+      }
+    }
+
+    fd = open((kernel_path + ".lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd < 0 || flock(fd, LOCK_EX) != 0) {
+      std::cout << "Failed to lock " << kernel_path << ".lock" << std::endl;
+      std::cout << "Error: " << strerror(errno) << std::endl;
+      if (fd >= 0) {
+        close(fd);
+      }
+      return;
+    }
+
+    if (!was_fuzzed(kernel_fname)) {
+      for (int i = 0; i < IVYSYN_NUM_SHARDS; i++) {
+        shard_path = kernel_path + ".shard" + std::to_string(i);
+        append_file(shard_path + "_crashes.log", kernel_path + "_crashes.log");
+        append_file(shard_path + "_crashes.bin", kernel_path + "_crashes.bin");
+        append_file(shard_path + "_hangs.log", kernel_path + "_hangs.log");
+        append_file(shard_path + ".crash_found", kernel_path + ".crash_found");
+        append_file(shard_path + ".buckets", kernel_path + ".buckets");
+        append_file(shard_path + ".slow", kernel_path + ".slow");
+        append_file(shard_path + ".memory", kernel_path + ".memory");
+        append_file(shard_path + ".guard_fault", kernel_path + ".guard_fault");
+        /* Each shard counted over its own edge map, keep them apart */
+        append_file(shard_path + ".cov", kernel_path + ".cov", "shard:" + std::to_string(i) + "\n");
+        /* Would otherwise show up as a kernel of its own */
+        std::remove((shard_path + "_crashes.log").c_str());
+        std::remove((shard_path + "_crashes.bin").c_str());
+        std::remove((shard_path + "_hangs.log").c_str());
+        std::remove((shard_path + ".slow").c_str());
+        std::remove((shard_path + ".memory").c_str());
+        std::remove((shard_path + ".guard_fault").c_str());
+        std::remove((shard_path + ".cov").c_str());
+      }
+
+      create_file(kernel_path + ".done", kernel_done_file, std::ios::out | std::ios::in | std::ios::trunc);
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      kernel_done_file << ts.tv_sec << std::endl;
+      kernel_done_file.close();
+
+      std::cout << kernel_fname << ": all " << IVYSYN_NUM_SHARDS << " shards finished fuzzing" << std::endl;
+    }
+
+    close(fd);
+  }
+#endif
+
+  /* Write out the timings left behind by the process that owned stale_mutfile */
+  void Fuzzer::recover_stale_files(const std::string& stale_mutfile)
+  {
+    std::string old_ring_filename;
+    std::string old_time_filename;
+
+    old_ring_filename = stale_mutfile;
+    old_ring_filename.replace(old_ring_filename.find("_mutations.log"), std::string("_mutations.log").length(), ".ring");
+    old_time_filename = stale_mutfile;
+    old_time_filename.replace(old_time_filename.find("_mutations.log"), std::string("_mutations.log").length(), ".time");
+    recover_mutation_ring(old_ring_filename, old_time_filename);
+  }
+
+#if defined(IVYSYN_FORK_SERVER)
+  /* The test's own inputs, down to their contents */
+  static uint64_t hash_inputs(const tensorflow::gtl::InlinedVector<tensorflow::TensorValue, 4> *inputs)
+  {
+    uint64_t hash = FNV_OFFSET_BASIS;
+    tensorflow::Tensor *tensor;
+
+    for (const auto& value : *inputs) {
+      tensor = value.tensor;
+      hash = fnv1a(hash, &tensor, sizeof(tensor));
+      if (tensor != nullptr && tensor->IsInitialized() && tensorflow::DataTypeCanUseMemcpy(tensor->dtype())) {
+        hash = fnv1a(hash, tensor->tensor_data().data(), tensor->tensor_data().size());
+      }
+    }
+
+    return hash;
+  }
+
+  /*
+   * Logging a crash in the parent goes through get_fuzzed_context(), which
+   * points the test's context at the mutated inputs and the fuzz device.
+   * The original kernel's output is only that of a non-fuzzed run if the
+   * context has the test's own inputs, unchanged, and device back.
+   */
+  bool Fuzzer::check_original_context()
+  {
+    bool matches;
+
+    matches = original_ctx->get_params()->inputs == original_inputs &&
+              hash_inputs(original_inputs) == original_inputs_hash;
+#if defined(IVYSYN_FUZZ_DEVICE)
+    if (original_device != nullptr) {
+      matches = matches && original_ctx->get_params()->device == original_device;
+    }
+#endif
+
+    if (!matches) {
+      std::cout << "\033[1;31mError: the original kernel would not run on the test's inputs\n\033[0m " << cur_fname << std::endl;
+    }
+
+    return matches;
+  }
+
+  /*
+   * Fork a child to run the mutations and wait for it. If the child dies on
+   * a mutation, log the crash from the progress slot and fork a new child
+   * from the next mutation, without going back to the test. Returns true in
+   * the child (or if we can't fork at all), false in the parent once the
+   * kernel is done.
+   */
+  bool Fuzzer::run_fork_server()
+  {
+
+    long long last_mutation = -1, last_timestamp = -1;
+    unsigned long long crash_bucket = 0;
+    int crash_signal = 0;
+    int status = 0;
+    bool child_finished = false;
+    pid_t pid;
+
+    original_inputs_hash = hash_inputs(original_inputs);
+
+    while (true) {
+
+      std::cout << std::flush;
+      pid = fork();
+
+      if (pid < 0) {
+        std::cout << "Fork failed, fuzzing " << cur_fname << " in process" << std::endl;
+        std::cout << "Error: " << strerror(errno) << std::endl;
+        return true;
+      }
+
+      if (pid == 0) {
+        /* Don't outlive the test if the watchdog kills it */
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        in_fork_child = true;
+        return true;
+      }
+
+      while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+
+      /* The child went through all the mutations */
+      if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        child_finished = true;
+        break;
+      }
+
+      if (!read_progress_slot(mutations_logger_filename, &last_mutation, &last_timestamp,
+                              &crash_bucket, &crash_signal)) {
+        std::cout << "Error while reading " << mutations_logger_filename << std::endl;
+        mark_fuzzing_done();
+        break;
+      }
+
+      std::cout << ::getpid() << ": " << cur_fname << " crashed in child " << pid << ", restoring" << std::endl;
+      restore_last_mutation(last_mutation, last_timestamp, crash_bucket, crash_signal, false);
+
+      if (main_pool_done && total_mutations <= 0) {
+        break;
+      }
+    }
+
+    /*
+     * Done, clean up as a child that got to the end would have. Unless it
+     * did, the last child crashed before logging the coverage
+     */
+#if defined(IVYSYN_COVERAGE)
+    if (!child_finished) {
+      log_coverage();
+    }
+#endif
+    finish_fuzzing();
+    check_original_context();
+    main_pool_done = true;
+    total_mutations = 0;
+
+    return false;
+  }
+#endif
+
+  void Fuzzer::restore_last_mutation(long long last_mutation, long long last_timestamp,
+                                     unsigned long long crash_bucket, int crash_signal, bool do_resume)
   {
 
     std::string crashes_filename;
     std::string crash_found_filename;
+    std::string hangs_filename;
+    std::fstream hangs_file;
+    int failing_arg;
+    bool hung, seen;
 
     /*
      * Handle the case where mutations were already done for this test
@@ -1063,42 +2611,296 @@ namespace tffuzzing {
       return;
     }
 
+    hung = was_hung(last_mutation);
+
     std::cout << "Resuming from mutation " << last_mutation << std::endl;
     if (!zero_muts_crashed(cur_fname)) {
-      while (total_mutations != last_mutation) {
-        if (total_mutations < last_mutation) {
-          std::cout << "\033[1;31mError: didn't match last mutation, aborting\n\033[0m " << cur_fname << std::endl << std::flush;
-          mark_fuzzing_done();
-          return;
-        }
-        next_mutations_indices(false);
+      if (!seek_mutation(last_mutation)) {
+        std::cout << "\033[1;31mError: didn't match last mutation, aborting\n\033[0m " << cur_fname << std::endl << std::flush;
+        mark_fuzzing_done();
+        return;
       }
     } else {
       main_pool_done = true;
       total_mutations = last_mutation;
     }
 
-    /* If we weren't killed, also log the crash */
-    if (!do_resume) {
+    failing_arg = find_failing_arg();
+
+    /* A hang is not a crash, log it on its own and go on with the next one */
+    if (hung) {
+      hangs_filename = std::string(results_dir) + "/" + cur_fname + "_hangs.log";
+      hangs_file.open(hangs_filename, std::ios::out | std::ios::app);
+      log_current_mutation(hangs_file);
+      hangs_file.close();
+      std::remove(hang_filename);
+
+      log_mutation_record(total_mutations, -1, MUT_STATUS_HANG, failing_arg);
+
+      next_mutations_indices(true);
+      std::cout << "Mutation hung, mutations left: " << total_mutations << std::endl;
+      return;
+    }
+
+    /* If we weren't killed, also log the crash, once per bucket */
+    scan_crash_buckets(std::string(results_dir) + "/" + cur_fname + ".buckets", crash_bucket, &seen);
+    if (!do_resume && seen) {
+      std::cout << "Crash in bucket " << std::hex << crash_bucket << std::dec << " seen before, not logged" << std::endl;
+      log_mutation_record(total_mutations, -1, MUT_STATUS_CRASHED, failing_arg);
+    } else if (!do_resume) {
       crashes_filename = std::string(results_dir) + "/" + cur_fname + "_crashes.log";
       crashes_logger_filename = crashes_filename;
       crashes_file.open(crashes_logger_filename, std::ios::out | std::ios::app);
       crashes_file.rdbuf()->pubsetbuf(nullptr, 0);
       log_current_mutation(crashes_file);
+      log_crash_record(std::string(results_dir) + "/" + cur_fname + "_crashes.bin");
 
       crash_found_filename = std::string(results_dir) + "/" + cur_fname + ".crash_found";
       create_file(crash_found_filename, crash_found_file, std::ios::out | std::ios::app);
       /* Log crash time in seconds */
       crash_found_file << last_timestamp << std::endl;
       crash_found_file.close();
+
+      log_mutation_record(total_mutations, -1, MUT_STATUS_CRASHED, failing_arg);
     }
 
-    increase_num_crashes();
+    increase_num_crashes(crash_bucket, crash_signal);
 
     next_mutations_indices(true);
     std::cout << "Mutations left: " << total_mutations << std::endl;
   }
 
+#if defined(IVYSYN_COVERING_STRENGTH)
+  /*
+   * Greedily build a covering array of the given strength over the pools:
+   * every combination of values of any strength arguments shows up in at
+   * least one row. Each row starts from the first combination not covered
+   * yet and fills in the other arguments with the value that covers the most
+   * new combinations. Only draws from a generator seeded with RNG_SEED, so
+   * a restarted process gets the same rows and can resume by row number.
+   * Rows are stored flat in rows, pool_sizes.size() entries each.
+   */
+  static long long build_covering_array(const std::vector<int>& pool_sizes, int strength, std::vector<int>& rows)
+  {
+
+    int nargs = pool_sizes.size();
+    std::vector<std::vector<int>> subsets;
+    std::vector<std::vector<int>> arg_subsets(nargs);
+    std::vector<long long> offsets;
+    std::vector<bool> covered;
+    std::vector<int> comb(strength), row(nargs), order(nargs);
+    std::vector<bool> assigned(nargs);
+    long long uncovered = 0, scan = 0, tuple, best_gain, gain;
+    int cur_subset = 0, start, val, best_val, i, j;
+    bool complete;
+    std::mt19937 rngenerator(RNG_SEED);
+
+    /* All the strength-sized sets of arguments, in lexicographic order */
+    for (i = 0; i < strength; i++) {
+      comb[i] = i;
+    }
+    while (true) {
+      for (auto arg : comb) {
+        arg_subsets[arg].push_back(subsets.size());
+      }
+      subsets.push_back(comb);
+      offsets.push_back(uncovered);
+      tuple = 1;
+      for (auto arg : comb) {
+        tuple *= pool_sizes[arg];
+      }
+      uncovered += tuple;
+
+      for (i = strength - 1; i >= 0 && comb[i] == nargs - strength + i; i--);
+      if (i < 0) {
+        break;
+      }
+      comb[i]++;
+      for (j = i + 1; j < strength; j++) {
+        comb[j] = comb[j - 1] + 1;
+      }
+    }
+    offsets.push_back(uncovered);
+    covered.assign(uncovered, false);
+
+    auto tuple_index = [&](int s) {
+      long long idx = 0;
+      for (auto arg : subsets[s]) {
+        idx = idx * pool_sizes[arg] + row[arg];
+      }
+      return offsets[s] + idx;
+    };
+
+    while (uncovered > 0) {
+
+      /* Start from the first combination that isn't covered yet */
+      while (covered[scan]) {
+        scan++;
+      }
+      while (offsets[cur_subset + 1] <= scan) {
+        cur_subset++;
+      }
+      assigned.assign(nargs, false);
+      tuple = scan - offsets[cur_subset];
+      for (i = strength - 1; i >= 0; i--) {
+        val = subsets[cur_subset][i];
+        row[val] = tuple % pool_sizes[val];
+        tuple /= pool_sizes[val];
+        assigned[val] = true;
+      }
+
+      /* Fill in the rest in a random order */
+      for (i = 0; i < nargs; i++) {
+        order[i] = i;
+      }
+      for (i = nargs - 1; i > 0; i--) {
+        std::swap(order[i], order[rngenerator() % (i + 1)]);
+      }
+
+      for (auto arg : order) {
+        if (assigned[arg]) {
+          continue;
+        }
+        best_gain = -1;
+        best_val = 0;
+        start = rngenerator() % pool_sizes[arg];
+        for (i = 0; i < pool_sizes[arg]; i++) {
+          row[arg] = (start + i) % pool_sizes[arg];
+          gain = 0;
+          for (auto s : arg_subsets[arg]) {
+            complete = true;
+            for (auto other : subsets[s]) {
+              if (other != arg && !assigned[other]) {
+                complete = false;
+                break;
+              }
+            }
+            if (complete && !covered[tuple_index(s)]) {
+              gain++;
+            }
+          }
+          if (gain > best_gain) {
+            best_gain = gain;
+            best_val = row[arg];
+          }
+        }
+        row[arg] = best_val;
+        assigned[arg] = true;
+      }
+
+      for (i = 0; i < (int) subsets.size(); i++) {
+        tuple = tuple_index(i);
+        if (!covered[tuple]) {
+          covered[tuple] = true;
+          uncovered--;
+        }
+      }
+      rows.insert(rows.end(), row.begin(), row.end());
+    }
+
+    return rows.size() / nargs;
+  }
+
+  /* A cached covering array, if it is for pool_sizes and whole */
+  static bool read_covering_array(const std::string& filename, const std::vector<int>& pool_sizes, int strength,
+                                  std::vector<int>& rows)
+  {
+    struct covering_header header = {};
+    std::vector<int> sizes(pool_sizes.size());
+    std::ifstream file(filename, std::ios::binary);
+    int nargs = pool_sizes.size();
+
+    if (!file.read((char *) &header, sizeof(header)) || header.magic != COVERING_MAGIC ||
+        header.strength != strength || header.rng_seed != RNG_SEED || header.num_args != nargs ||
+        header.num_rows <= 0) {
+      return false;
+    }
+
+    if (!file.read((char *) sizes.data(), nargs * sizeof(int)) || sizes != pool_sizes) {
+      return false;
+    }
+
+    rows.resize(header.num_rows * nargs);
+    if (!file.read((char *) rows.data(), rows.size() * sizeof(int))) {
+      rows.clear();
+      return false;
+    }
+
+    /* The rows index the pools, don't trust them */
+    for (size_t i = 0; i < rows.size(); i++) {
+      if (rows[i] < 0 || rows[i] >= pool_sizes[i % nargs]) {
+        rows.clear();
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  /* Written aside and renamed, so other processes only see it whole */
+  static void write_covering_array(const std::string& filename, const std::vector<int>& pool_sizes, int strength,
+                                   const std::vector<int>& rows)
+  {
+    std::string tmp_filename = filename + "." + std::to_string(::getpid());
+    struct covering_header header = {};
+    std::ofstream file(tmp_filename, std::ios::binary | std::ios::trunc);
+
+    header.magic = COVERING_MAGIC;
+    header.strength = strength;
+    header.rng_seed = RNG_SEED;
+    header.num_args = pool_sizes.size();
+    header.num_rows = rows.size() / pool_sizes.size();
+
+    file.write((const char *) &header, sizeof(header));
+    file.write((const char *) pool_sizes.data(), pool_sizes.size() * sizeof(int));
+    file.write((const char *) rows.data(), rows.size() * sizeof(int));
+    file.close();
+
+    if (file.fail() || rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+      std::remove(tmp_filename.c_str());
+    }
+  }
+
+  /*
+   * The covering array only depends on the pool sizes, the strength and the
+   * seed, so it is built once and cached in results_dir under a name keyed by
+   * them. Restarts and other kernels with the same pools load it instead of
+   * building it again. Each kernel's number of arguments, rows and build time
+   * in ms (0 if loaded) go to covering_arrays.txt.
+   */
+  long long Fuzzer::get_covering_array()
+  {
+    std::string filename;
+    std::fstream covering_log_file;
+    struct timespec start_ts = {}, end_ts = {}, diff_ts = {};
+    uint64_t key = FNV_OFFSET_BASIS;
+    int strength = IVYSYN_COVERING_STRENGTH;
+    long long build_ms = 0;
+    char key_hex[17];
+
+    key = fnv1a(key, pool_sizes.data(), pool_sizes.size() * sizeof(int));
+    snprintf(key_hex, sizeof(key_hex), "%016llx", (unsigned long long) key);
+    filename = std::string(results_dir) + "/covering." + std::to_string(strength) + "." + key_hex;
+
+    covering_rows.clear();
+    if (!read_covering_array(filename, pool_sizes, strength, covering_rows)) {
+      clock_gettime(CLOCK_MONOTONIC, &start_ts);
+      build_covering_array(pool_sizes, strength, covering_rows);
+      clock_gettime(CLOCK_MONOTONIC, &end_ts);
+      diff_ts = time_diff(start_ts, end_ts);
+      build_ms = diff_ts.tv_sec * 1000 + diff_ts.tv_nsec / 1000000;
+      write_covering_array(filename, pool_sizes, strength, covering_rows);
+    }
+
+    covering_log_file.open(std::string(results_dir) + "/covering_arrays.txt", std::ios::out | std::ios::app);
+    covering_log_file << cur_fname << ":" << pool_sizes.size() << ":" << covering_rows.size() / pool_sizes.size()
+                      << ":" << build_ms << std::endl;
+    covering_log_file.close();
+
+    return covering_rows.size() / pool_sizes.size();
+  }
+#endif
+
   void Fuzzer::calculate_total_mutations()
   {
 
@@ -1236,6 +3038,14 @@ namespace tffuzzing {
       create_file(overflow_filename, overflow_file, std::ios::out | std::ios::in | std::ios::trunc);
     }
 
+#if defined(IVYSYN_COVERING_STRENGTH)
+    /* Too many combinations to run them all, only run the covering rows */
+    if (total_mutations > NMUT_UPPER_BOUND_MID && (int) pool_sizes.size() > IVYSYN_COVERING_STRENGTH) {
+      total_mutations = get_covering_array();
+      std::cout << "Covering array rows (t=" << IVYSYN_COVERING_STRENGTH << "): " << total_mutations << std::endl;
+    }
+#endif
+
     nmut_fuzz = total_mutations;
     num_mut_skip = 1;
 
@@ -1264,8 +3074,8 @@ namespace tffuzzing {
       tensorflow::Tensor *tensor;
       tensorflow::TensorValue *tensor_val;
 
-      tensor = new tensorflow::Tensor(value);
-      tensor_val = new tensorflow::TensorValue(tensor);
+      tensor = arena.new_tensor(value);
+      tensor_val = arena.new_value(tensor);
       return tensor_val;
 
     }
@@ -1277,8 +3087,8 @@ namespace tffuzzing {
     tensorflow::Tensor *tensor;
     tensorflow::TensorValue *tensor_val;
 
-    tensor = new tensorflow::Tensor(ttype, shape);
-    tensor_val = new tensorflow::TensorValue(tensor);
+    tensor = arena.new_pool_tensor(ttype, shape);
+    tensor_val = arena.new_value(tensor);
 
     return tensor_val;
   }
@@ -1290,7 +3100,7 @@ namespace tffuzzing {
       tensorflow::TensorValue *tensor_val;
 
       tensor->flat<T>().setConstant(value);
-      tensor_val = new tensorflow::TensorValue(tensor);
+      tensor_val = arena.new_value(tensor);
       return tensor_val;
 
     }
@@ -1303,14 +3113,135 @@ namespace tffuzzing {
       tensorflow::Tensor *tensor;
       tensorflow::TensorValue *tensor_val;
 
-      tensor = new tensorflow::Tensor(ttype, shape);
+      /* Before fitting the shape, a large zero tensor costs next to nothing */
+      if (value == T(0)) {
+        return get_zero_tensor_with_shape(ttype, shape);
+      }
+
+      tensor = arena.new_pool_tensor(ttype, fit_shape_to_budget(ttype, shape));
       tensor->flat<T>().setConstant(value);
-      tensor_val = new tensorflow::TensorValue(tensor);
+      tensor_val = arena.new_value(tensor);
 
       return tensor_val;
 
     }
 
+  /*
+   * Large zero tensors come from the zero page allocator and are never
+   * written here, so their memory only gets used if the kernel writes them.
+   * They keep their shape, only the ones that are filled are fitted to the
+   * budget.
+   */
+  tensorflow::TensorValue *Fuzzer::get_zero_tensor_with_shape(tensorflow::DataType ttype,
+                                                             tensorflow::TensorShape shape)
+  {
+
+    tensorflow::Tensor *tensor;
+
+    if (tensorflow::DataTypeCanUseMemcpy(ttype) &&
+        shape.num_elements() * tensorflow::DataTypeSize(ttype) >= ZERO_PAGE_MIN_BYTES) {
+      tensor = arena.new_zero_page_tensor(ttype, shape);
+      if (tensor->data() != nullptr) {
+        return arena.new_value(tensor);
+      }
+      /* Couldn't map it, fill a regular one instead */
+    }
+
+    tensor = arena.new_pool_tensor(ttype, fit_shape_to_budget(ttype, shape));
+
+    if (tensor->TotalBytes() > 0) {
+      memset(tensor->data(), 0, tensor->TotalBytes());
+    }
+
+    return arena.new_value(tensor);
+  }
+
+  /* Log how much memory the mutation pools of this kernel take */
+  void Fuzzer::log_pool_bytes()
+  {
+    std::string pool_bytes_filename;
+    std::fstream pool_bytes_file;
+
+    pool_bytes_filename = std::string(results_dir) + "/pool_bytes.txt";
+    pool_bytes_file.open(pool_bytes_filename, std::ios::out | std::ios::app);
+    if (pool_bytes_file.fail()) {
+      std::cout << "Failed to open " << pool_bytes_filename << std::endl;
+      std::cout << "Error: " << strerror(errno) << std::endl;
+      return;
+    }
+
+    pool_bytes_file << cur_fname << ":" << arena.total_bytes() << std::endl;
+    pool_bytes_file.close();
+  }
+
+#if defined(IVYSYN_GUARD_PAGES)
+  /*
+   * Over-reads of a pool buffer that stay within its slack don't fault. Note
+   * how many buffers have any in <kernel>.guard_fault, so misses show.
+   */
+  void Fuzzer::log_guard_slack()
+  {
+    std::string guard_slack_filename;
+    std::fstream guard_slack_file;
+    size_t num_buffers, num_slack, max_slack;
+
+    guard_page_allocator()->take_slack_stats(&num_buffers, &num_slack, &max_slack);
+    if (num_slack == 0) {
+      return;
+    }
+
+    guard_slack_filename = std::string(results_dir) + "/" + cur_fname + ".guard_fault";
+    guard_slack_file.open(guard_slack_filename, std::ios::out | std::ios::app);
+    guard_slack_file << "pool buffers " << num_buffers << " slack " << num_slack << " max slack " << max_slack << std::endl;
+    guard_slack_file.close();
+  }
+#endif
+
+  /*
+   * Halve the largest dimension of shape until a tensor of it fits in what is
+   * left of POOL_BYTES_BUDGET. Keeps the rank and doesn't draw from the
+   * generator, so the rest of the pools come out the same.
+   */
+  tensorflow::TensorShape Fuzzer::fit_shape_to_budget(tensorflow::DataType ttype, tensorflow::TensorShape shape)
+  {
+
+    size_t left = 0;
+    int largest;
+
+    if (arena.total_bytes() < POOL_BYTES_BUDGET) {
+      left = POOL_BYTES_BUDGET - arena.total_bytes();
+    }
+
+    while (shape.dims() > 0 && (size_t) shape.num_elements() * tensorflow::DataTypeSize(ttype) > left) {
+      largest = 0;
+      for (int d = 1; d < shape.dims(); d++) {
+        if (shape.dim_size(d) > shape.dim_size(largest)) {
+          largest = d;
+        }
+      }
+      shape.set_dim(largest, shape.dim_size(largest) / 2);
+    }
+
+    return shape;
+  }
+
+  /*
+   * Adds a tensor of each of the two random shapes to the pool of ttype, if
+   * the kernel takes ttype. The values are drawn either way, in the same
+   * order, so the pools stay the same for a given seed.
+   */
+  template <class Draw>
+  void Fuzzer::add_random_rank_tensors(tensorflow::DataType ttype, std::vector<tensorflow::TensorValue> &pool,
+                                       const tensorflow::TensorShape& shape, const tensorflow::TensorShape& shape2, Draw draw)
+  {
+    for (const tensorflow::TensorShape *cur_shape : {&shape, &shape2}) {
+      auto value = draw();
+      if (tensor_types_set.count(ttype)) {
+        pool.push_back(*get_tensor_with_shape_and_value(value, ttype, *cur_shape));
+      }
+    }
+  }
+
   void Fuzzer::initialize_tensor_pools()
   {
 
@@ -1349,8 +3280,8 @@ namespace tffuzzing {
 
     /* Same arguments as the original we got as input */
     for (int i = 0; i < num_args; i++) {
-      tensor = new tensorflow::Tensor(original_ctx->input(i));
-      tensor_val = new tensorflow::TensorValue(tensor);
+      tensor = arena.new_shared_tensor(original_ctx->input(i));
+      tensor_val = arena.new_value(tensor);
       tensor_type = tensor_types.at(i);
       switch (tensor_type) {
         default:
@@ -1436,7 +3367,7 @@ namespace tffuzzing {
 
       tensor_type = tensor_types.at(idx++);
 
-      tensor = new tensorflow::Tensor(tensor_type, tshape);
+      tensor = arena.new_pool_tensor(tensor_type, tshape);
       switch (tensor_type) {
         default:
           mark_unknown_type(tensor_type);
@@ -1446,8 +3377,7 @@ namespace tffuzzing {
           tensor_val = get_tensor_with_value<tensorflow::int8>(rand_int8, tensor);
           int8_tensor_mutation_pool.push_back(*tensor_val);
 
-          tensor = new tensorflow::Tensor(tensor_type, tshape);
-          tensor_val = get_tensor_with_value<tensorflow::int8>(0, tensor);
+          tensor_val = get_zero_tensor_with_shape(tensor_type, tshape);
           int8_tensor_mutation_pool.push_back(*tensor_val);
 
           tensor_val = get_empty_tensor_with_shape(tensorflow::DataType::DT_INT8, zero_shape);
@@ -1459,8 +3389,7 @@ namespace tffuzzing {
           tensor_val = get_tensor_with_value<tensorflow::int32>(rand_int32, tensor);
           int32_tensor_mutation_pool.push_back(*tensor_val);
 
-          tensor = new tensorflow::Tensor(tensor_type, tshape);
-          tensor_val = get_tensor_with_value<tensorflow::int32>(0, tensor);
+          tensor_val = get_zero_tensor_with_shape(tensor_type, tshape);
           int32_tensor_mutation_pool.push_back(*tensor_val);
 
           tensor_val = get_empty_tensor_with_shape(tensorflow::DataType::DT_INT32, zero_shape);
@@ -1472,8 +3401,7 @@ namespace tffuzzing {
           tensor_val = get_tensor_with_value<tensorflow::int64>(rand_int64, tensor);
           int64_tensor_mutation_pool.push_back(*tensor_val);
 
-          tensor = new tensorflow::Tensor(tensor_type, tshape);
-          tensor_val = get_tensor_with_value<tensorflow::int64>(0, tensor);
+          tensor_val = get_zero_tensor_with_shape(tensor_type, tshape);
           int64_tensor_mutation_pool.push_back(*tensor_val);
 
           tensor_val = get_empty_tensor_with_shape(tensorflow::DataType::DT_INT64, zero_shape);
@@ -1485,8 +3413,7 @@ namespace tffuzzing {
           tensor_val = get_tensor_with_value<tensorflow::uint8>(rand_uint8, tensor);
           uint8_tensor_mutation_pool.push_back(*tensor_val);
 
-          tensor = new tensorflow::Tensor(tensor_type, tshape);
-          tensor_val = get_tensor_with_value<tensorflow::uint8>(0, tensor);
+          tensor_val = get_zero_tensor_with_shape(tensor_type, tshape);
           uint8_tensor_mutation_pool.push_back(*tensor_val);
 
           tensor_val = get_empty_tensor_with_shape(tensorflow::DataType::DT_UINT8, zero_shape);
@@ -1498,8 +3425,7 @@ namespace tffuzzing {
           tensor_val = get_tensor_with_value<tensorflow::uint32>(rand_uint32, tensor);
           uint32_tensor_mutation_pool.push_back(*tensor_val);
 
-          tensor = new tensorflow::Tensor(tensor_type, tshape);
-          tensor_val = get_tensor_with_value<tensorflow::uint32>(0, tensor);
+          tensor_val = get_zero_tensor_with_shape(tensor_type, tshape);
           uint32_tensor_mutation_pool.push_back(*tensor_val);
 
           tensor_val = get_empty_tensor_with_shape(tensorflow::DataType::DT_UINT32, zero_shape);
@@ -1511,8 +3437,7 @@ namespace tffuzzing {
           tensor_val = get_tensor_with_value<tensorflow::uint64>(rand_int64, tensor);
           uint64_tensor_mutation_pool.push_back(*tensor_val);
 
-          tensor = new tensorflow::Tensor(tensor_type, tshape);
-          tensor_val = get_tensor_with_value<tensorflow::uint64>(0, tensor);
+          tensor_val = get_zero_tensor_with_shape(tensor_type, tshape);
           uint64_tensor_mutation_pool.push_back(*tensor_val);
 
           tensor_val = get_empty_tensor_with_shape(tensorflow::DataType::DT_UINT64, zero_shape);
@@ -1524,8 +3449,7 @@ namespace tffuzzing {
           tensor_val = get_tensor_with_value<Eigen::half>(rand_half, tensor);
           half_tensor_mutation_pool.push_back(*tensor_val);
 
-          tensor = new tensorflow::Tensor(tensor_type, tshape);
-          tensor_val = get_tensor_with_value<Eigen::half>(Eigen::half(0.0), tensor);
+          tensor_val = get_zero_tensor_with_shape(tensor_type, tshape);
           half_tensor_mutation_pool.push_back(*tensor_val);
 
           tensor_val = get_empty_tensor_with_shape(tensorflow::DataType::DT_HALF, zero_shape);
@@ -1537,8 +3461,7 @@ namespace tffuzzing {
           tensor_val = get_tensor_with_value<float>(rand_float, tensor);
           float_tensor_mutation_pool.push_back(*tensor_val);
 
-          tensor = new tensorflow::Tensor(tensor_type, tshape);
-          tensor_val = get_tensor_with_value<float>(0, tensor);
+          tensor_val = get_zero_tensor_with_shape(tensor_type, tshape);
           float_tensor_mutation_pool.push_back(*tensor_val);
 
           tensor_val = get_empty_tensor_with_shape(tensorflow::DataType::DT_FLOAT, zero_shape);
@@ -1550,8 +3473,7 @@ namespace tffuzzing {
           tensor_val = get_tensor_with_value<double>(rand_double, tensor);
           double_tensor_mutation_pool.push_back(*tensor_val);
 
-          tensor = new tensorflow::Tensor(tensor_type, tshape);
-          tensor_val = get_tensor_with_value<double>(0, tensor);
+          tensor_val = get_zero_tensor_with_shape(tensor_type, tshape);
           double_tensor_mutation_pool.push_back(*tensor_val);
 
           tensor_val = get_empty_tensor_with_shape(tensorflow::DataType::DT_DOUBLE, zero_shape);
@@ -1737,7 +3659,9 @@ namespace tffuzzing {
      * Create tensors with increasing number of dimensions, having
      * random dimension sizes and containing values picked at
      * random from the corresponding value pool for that type. Sometimes
-     * insert a 0-sized dim instead.
+     * insert a 0-sized dim instead. Only types the kernel takes get a pool,
+     * but the values are drawn for all of them so that the pools stay the
+     * same for a given seed no matter what the input types are.
      */
     for (int cur_ndims = 1; cur_ndims <= TENSOR_MAX_NUM_DIMS_FUZZ; cur_ndims+=TENSOR_DIM_STEP_FUZZ) {
       shape = tensorflow::TensorShape();
@@ -1763,217 +3687,333 @@ namespace tffuzzing {
         }
       }
 
-      rand_int8 = int8_mutations.at(int8_distr(rngenerator));
-      tensor_val = get_tensor_with_shape_and_value(rand_int8, tensorflow::DataType::DT_INT8, shape);
-      int8_tensor_mutation_pool.push_back(*tensor_val);
+      add_random_rank_tensors(tensorflow::DataType::DT_INT8, int8_tensor_mutation_pool, shape, shape2,
+                              [&]() { return int8_mutations.at(int8_distr(rngenerator)); });
+      add_random_rank_tensors(tensorflow::DataType::DT_INT32, int32_tensor_mutation_pool, shape, shape2,
+                              [&]() { return int32_mutations.at(int32_distr(rngenerator)); });
+      add_random_rank_tensors(tensorflow::DataType::DT_INT64, int64_tensor_mutation_pool, shape, shape2,
+                              [&]() { return int64_mutations.at(int64_distr(rngenerator)); });
+      add_random_rank_tensors(tensorflow::DataType::DT_UINT8, uint8_tensor_mutation_pool, shape, shape2,
+                              [&]() { return (tensorflow::uint8) int32_mutations.at(int32_distr(rngenerator)); });
+      add_random_rank_tensors(tensorflow::DataType::DT_UINT32, uint32_tensor_mutation_pool, shape, shape2,
+                              [&]() { return (tensorflow::uint32) int32_mutations.at(int32_distr(rngenerator)); });
+      add_random_rank_tensors(tensorflow::DataType::DT_UINT64, uint64_tensor_mutation_pool, shape, shape2,
+                              [&]() { return (tensorflow::uint64) int64_mutations.at(int64_distr(rngenerator)); });
+      add_random_rank_tensors(tensorflow::DataType::DT_FLOAT, float_tensor_mutation_pool, shape, shape2,
+                              [&]() { return float_mutations.at(float_distr(rngenerator)); });
+      add_random_rank_tensors(tensorflow::DataType::DT_HALF, half_tensor_mutation_pool, shape, shape2,
+                              [&]() { return Eigen::half(half_mutations.at(half_distr(rngenerator))); });
+      add_random_rank_tensors(tensorflow::DataType::DT_DOUBLE, double_tensor_mutation_pool, shape, shape2,
+                              [&]() { return double_mutations.at(double_distr(rngenerator)); });
+    }
+
+  }
+
+  void Fuzzer::mark_unknown_type(tensorflow::DataType ttype)
+  {
+    std::string filename;
+
+    std::cout << "\033[1;31mUnknown type:\033[0m " << ttype << std::endl << std::flush;
+
+    // Indicates a type that isn't handled in the fuzzer
+    filename = std::string(results_dir) + "/" + cur_fname + ".unknown";
+
+    std::ios_base::openmode fflags = std::ios::out | std::ios::in;
+    unknown_type_file.open(filename, fflags);
+    unknown_type_file << ttype << std::flush;
+    unknown_type_file.close();
 
-      rand_int8 = int8_mutations.at(int8_distr(rngenerator));
-      tensor_val = get_tensor_with_shape_and_value(rand_int8, tensorflow::DataType::DT_INT8, shape2);
-      int8_tensor_mutation_pool.push_back(*tensor_val);
+    abort();
+  }
 
-      rand_int32 = int32_mutations.at(int32_distr(rngenerator));
-      tensor_val = get_tensor_with_shape_and_value(rand_int32, tensorflow::DataType::DT_INT32, shape);
-      int32_tensor_mutation_pool.push_back(*tensor_val);
+  void Fuzzer::mark_fuzzing_done()
+  {
+    std::string done_filename;
+    int exists = 0;
+    struct timespec ts = {};
+    struct stat stat_buffer = {};
+    std::ios_base::openmode fflags = std::ios::out | std::ios::in | std::ios::trunc;
 
-      rand_int32 = int32_mutations.at(int32_distr(rngenerator));
-      tensor_val = get_tensor_with_shape_and_value(rand_int32, tensorflow::DataType::DT_INT32, shape2);
-      int32_tensor_mutation_pool.push_back(*tensor_val);
+    main_pool_done = true;
+    /* This file indicates to the fuzzer that this function has been already fuzzed */
+    done_filename = std::string(results_dir) + "/" + cur_fname + ".done";
 
-      rand_int64 = int64_mutations.at(int64_distr(rngenerator));
-      tensor_val = get_tensor_with_shape_and_value(rand_int64, tensorflow::DataType::DT_INT64, shape);
-      int64_tensor_mutation_pool.push_back(*tensor_val);
+    exists = stat(done_filename.c_str(), &stat_buffer) == 0;
+    if (exists) {
+      return;
+    }
 
-      rand_int64 = int64_mutations.at(int64_distr(rngenerator));
-      tensor_val = get_tensor_with_shape_and_value(rand_int64, tensorflow::DataType::DT_INT64, shape2);
-      int64_tensor_mutation_pool.push_back(*tensor_val);
+    create_file(done_filename, done_file, fflags);
 
-      rand_uint8 = (tensorflow::uint8) int32_mutations.at(int32_distr(rngenerator));
-      tensor_val = get_tensor_with_shape_and_value(rand_uint8, tensorflow::DataType::DT_UINT8, shape);
-      uint8_tensor_mutation_pool.push_back(*tensor_val);
+    std::cout << cur_fname << ": finished fuzzing" << std::endl;
 
-      rand_uint8 = (tensorflow::uint8) int32_mutations.at(int32_distr(rngenerator));
-      tensor_val = get_tensor_with_shape_and_value(rand_uint8, tensorflow::DataType::DT_UINT8, shape2);
-      uint8_tensor_mutation_pool.push_back(*tensor_val);
+    /* Log end time in seconds */
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    done_file << ts.tv_sec << std::endl;
+    done_file.close();
 
-      rand_uint32 = (tensorflow::uint32) int32_mutations.at(int32_distr(rngenerator));
-      tensor_val = get_tensor_with_shape_and_value(rand_uint32, tensorflow::DataType::DT_UINT32, shape);
-      uint32_tensor_mutation_pool.push_back(*tensor_val);
+#if defined(IVYSYN_NUM_SHARDS)
+    merge_shards();
+#endif
 
-      rand_uint32 = (tensorflow::uint32) int32_mutations.at(int32_distr(rngenerator));
-      tensor_val = get_tensor_with_shape_and_value(rand_uint32, tensorflow::DataType::DT_UINT32, shape2);
-      uint32_tensor_mutation_pool.push_back(*tensor_val);
+    /* Set mutations to zero to stop fuzzing */
+    total_mutations = 0;
+  }
 
-      rand_uint64 = (tensorflow::uint64) int64_mutations.at(int64_distr(rngenerator));
-      tensor_val = get_tensor_with_shape_and_value(rand_uint64, tensorflow::DataType::DT_UINT64, shape);
-      uint64_tensor_mutation_pool.push_back(*tensor_val);
+  /*
+   * The original kernel runs on the test's context once we are done, give it
+   * back its own inputs and device, and mark the kernel done
+   */
+  void Fuzzer::finish_fuzzing()
+  {
+    original_ctx->get_params()->inputs = original_inputs;
+#if defined(IVYSYN_FUZZ_DEVICE)
+    if (fuzz_device != nullptr) {
+      original_ctx->get_params()->device = original_device;
+    }
+#endif
+    mark_fuzzing_done();
+    std::remove(mutations_logger_filename.c_str());
+    unmap_progress_slot(progress);
+    progress = nullptr;
+  }
 
-      rand_uint64 = (tensorflow::uint64) int64_mutations.at(int64_distr(rngenerator));
-      tensor_val = get_tensor_with_shape_and_value(rand_uint64, tensorflow::DataType::DT_UINT64, shape2);
-      uint64_tensor_mutation_pool.push_back(*tensor_val);
 
-      rand_float = float_mutations.at(float_distr(rngenerator));
-      tensor_val = get_tensor_with_shape_and_value(rand_float, tensorflow::DataType::DT_FLOAT, shape);
-      float_tensor_mutation_pool.push_back(*tensor_val);
+  bool Fuzzer::has_more_mutations(bool reset)
+  {
 
-      rand_float = float_mutations.at(float_distr(rngenerator));
-      tensor_val = get_tensor_with_shape_and_value(rand_float, tensorflow::DataType::DT_FLOAT, shape2);
-      float_tensor_mutation_pool.push_back(*tensor_val);
+    bool has_more;
+    /*
+     * Another thread/proc is fuzzing this right now,
+     * return false such that the current thread doesn't
+     * also try to fuzz
+     */
+    if (is_running)
+      return false;
 
-      rand_half = Eigen::half(half_mutations.at(half_distr(rngenerator)));
-      tensor_val = get_tensor_with_shape_and_value(rand_half, tensorflow::DataType::DT_HALF, shape);
-      half_tensor_mutation_pool.push_back(*tensor_val);
+#if defined(IVYSYN_FORK_SERVER)
+    if (!fork_server_started) {
+      fork_server_started = true;
+      if (!run_fork_server()) {
+        return false;
+      }
+    }
+#endif
 
-      rand_half = Eigen::half(half_mutations.at(half_distr(rngenerator)));
-      tensor_val = get_tensor_with_shape_and_value(rand_half, tensorflow::DataType::DT_HALF, shape2);
-      half_tensor_mutation_pool.push_back(*tensor_val);
+    has_more = total_mutations > (main_pool_done ? 0 : shard_stop);
 
-      rand_double = double_mutations.at(double_distr(rngenerator));
-      tensor_val = get_tensor_with_shape_and_value(rand_double, tensorflow::DataType::DT_DOUBLE, shape);
-      double_tensor_mutation_pool.push_back(*tensor_val);
+    if (has_more && reset) {
+      cur_idx = 0;
+      next_mutations_indices(true);
+#if defined(IVYSYN_COVERAGE)
+      /* Don't spend runs on argument values that keep finding nothing new */
+      while (!main_pool_done && total_mutations > shard_stop && coverage_dead_mutation()) {
+        next_mutations_indices(true);
+        cov_skipped++;
+      }
+#endif
+    }
 
-      rand_double = double_mutations.at(double_distr(rngenerator));
-      tensor_val = get_tensor_with_shape_and_value(rand_double, tensorflow::DataType::DT_DOUBLE, shape2);
-      double_tensor_mutation_pool.push_back(*tensor_val);
+    if (!has_more) {
+#if defined(IVYSYN_NUM_SHARDS)
+      /* The zero-dim pool is small, the first shard runs all of it */
+      if (shard != 0) {
+        main_pool_done = true;
+      }
+#endif
+      if (!main_pool_done) {
+        /* std::cout << "Main pool done for " << cur_fname << ", creating secondary pool" << std::endl << std::flush; */
+        std::ios_base::openmode fflags = std::ios::out | std::ios::in | std::ios::trunc;
+        std::string zero_muts_filename = std::string(results_dir) + "/" + cur_fname + ".zero_muts";
+        create_file(zero_muts_filename, zero_muts_file, fflags);
+        has_more = true;
+        total_mutations = zero_dim_mutations;
+        main_pool_done = true;
+      } else {
+#if defined(IVYSYN_COVERAGE)
+        log_coverage();
+#endif
+        finish_fuzzing();
+      }
+    }
 
+#if defined(IVYSYN_FORK_SERVER)
+    /* The parent runs the original kernel once we are gone */
+    if (!has_more && in_fork_child) {
+      std::cout << std::flush;
+      _exit(0);
     }
+#endif
+
+    return has_more;
+  }
 
+#if defined(IVYSYN_PERMUTE_MUTATIONS)
+  /* splitmix64 finalizer, used as the Feistel round function */
+  static inline unsigned long long mix64(unsigned long long x)
+  {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
   }
 
-  void Fuzzer::mark_unknown_type(tensorflow::DataType ttype)
+  /*
+   * Keyed bijection of [0, n) onto itself: a 4-round Feistel network over
+   * the smallest even number of bits that holds n, cycle-walking until the
+   * result is back in range. The network's domain is under 4n, so that takes
+   * less than 4 walks on average. Anything outside [0, n) is left alone.
+   */
+  static long long permute_mutation(long long passed, long long n)
   {
-    std::string filename;
+    unsigned long long x, left, right, tmp, mask;
+    int half_bits = 1;
 
-    std::cout << "\033[1;31mUnknown type:\033[0m " << ttype << std::endl << std::flush;
+    if (passed < 0 || passed >= n) {
+      return passed;
+    }
 
-    // Indicates a type that isn't handled in the fuzzer
-    filename = std::string(results_dir) + "/" + cur_fname + ".unknown";
+    while (half_bits < 32 && (1ULL << (2 * half_bits)) < (unsigned long long) n) {
+      half_bits++;
+    }
+    mask = (1ULL << half_bits) - 1;
+
+    x = passed;
+    do {
+      left = x >> half_bits;
+      right = x & mask;
+      for (int round = 0; round < 4; round++) {
+        tmp = right;
+        right = left ^ (mix64(right ^ mix64(RNG_SEED + round)) & mask);
+        left = tmp;
+      }
+      x = (left << half_bits) | right;
+    } while (x >= (unsigned long long) n);
 
-    std::ios_base::openmode fflags = std::ios::out | std::ios::in;
-    unknown_type_file.open(filename, fflags);
-    unknown_type_file << ttype << std::flush;
-    unknown_type_file.close();
+    return x;
+  }
+#endif
+
+  /*
+   * Mixed-radix decode of the number of mutations passed into the per-argument
+   * pool indices (first argument changes fastest). With IVYSYN_PERMUTE_MUTATIONS
+   * the number is shuffled first, so strided runs sample the whole space.
+   */
+  void Fuzzer::decode_mutation_indices(long long passed)
+  {
+
+#if defined(IVYSYN_COVERING_STRENGTH)
+    /*
+     * Mutation number is the covering array row. The last step lands one past
+     * the last row (see calculate_total_mutations()), which wraps around to
+     * the first one, as the mixed-radix decode does
+     */
+    if (!covering_rows.empty()) {
+      passed %= (long long) (covering_rows.size() / pool_sizes.size());
+      for (int i = 0; i < num_args; i++) {
+        indices[i] = covering_rows[passed * pool_sizes.size() + i];
+      }
+      return;
+    }
+#endif
+
+#if defined(IVYSYN_PERMUTE_MUTATIONS)
+    passed = permute_mutation(passed, all_mutations);
+#endif
 
-    abort();
+    for (int i = 0; i < num_args; i++) {
+      indices[i] = passed % pool_sizes[i];
+      passed = passed / pool_sizes[i];
+    }
   }
 
-  void Fuzzer::mark_fuzzing_done()
+  /*
+   * Jump straight to a logged mutation number of the main pool. Equivalent to
+   * calling next_mutations_indices(false) until total_mutations reaches
+   * mutation, without walking the (up to NMUT_UPPER_BOUND_MID) steps in between.
+   * Returns false if mutation can not be reached with the current step size.
+   */
+  bool Fuzzer::seek_mutation(long long mutation)
   {
-    std::string done_filename;
-    int exists = 0;
-    struct timespec ts = {};
-    struct stat stat_buffer = {};
-    std::ios_base::openmode fflags = std::ios::out | std::ios::in | std::ios::trunc;
 
-    main_pool_done = true;
-    /* This file indicates to the fuzzer that this function has been already fuzzed */
-    done_filename = std::string(results_dir) + "/" + cur_fname + ".done";
+    long long steps;
 
-    exists = stat(done_filename.c_str(), &stat_buffer) == 0;
-    if (exists) {
-      return;
+    steps = total_mutations - mutation;
+    if (steps < 0 || steps % num_mut_skip != 0) {
+      return false;
     }
 
-    create_file(done_filename, done_file, fflags);
-
-    std::cout << cur_fname << ": finished fuzzing" << std::endl;
+    /* Nothing was run yet, keep the indices as they are */
+    if (steps == 0) {
+      return true;
+    }
 
-    /* Log end time in seconds */
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    done_file << ts.tv_sec << std::endl;
-    done_file.close();
+    total_mutations = mutation;
+    decode_mutation_indices(all_mutations - total_mutations);
 
-    /* Set mutations to zero to stop fuzzing */
-    total_mutations = 0;
+    return true;
   }
 
-
-  bool Fuzzer::has_more_mutations(bool reset)
+  /*
+   * Of the main pool mutation the indices are at, the argument whose pool
+   * index is the only one that differs from the last mutation that returned.
+   * That one is likely what made it crash, -1 if there is no such mutation or
+   * more than one argument changed since.
+   */
+  int Fuzzer::find_failing_arg()
   {
 
-    bool has_more;
-    /*
-     * Another thread/proc is fuzzing this right now,
-     * return false such that the current thread doesn't
-     * also try to fuzz
-     */
-    if (is_running)
-      return false;
-
-    has_more = total_mutations > 0;
+    std::vector<int> failing_indices;
+    int failing_arg = -1;
 
-    if (has_more && reset) {
-      cur_idx = 0;
-      next_mutations_indices(true);
+    if (main_pool_done || progress == nullptr || progress->last_ok_mutation < 0) {
+      return -1;
     }
 
-    if (!has_more) {
-      if (!main_pool_done) {
-        /* std::cout << "Main pool done for " << cur_fname << ", creating secondary pool" << std::endl << std::flush; */
-        std::ios_base::openmode fflags = std::ios::out | std::ios::in | std::ios::trunc;
-        std::string zero_muts_filename = std::string(results_dir) + "/" + cur_fname + ".zero_muts";
-        create_file(zero_muts_filename, zero_muts_file, fflags);
-        has_more = true;
-        total_mutations = zero_dim_mutations;
-        main_pool_done = true;
-      } else {
-        original_ctx->get_params()->inputs = original_inputs;
-        mark_fuzzing_done();
-        std::remove(mutations_logger_filename.c_str());
-        std::remove(timestamp_logger_filename.c_str());
+    failing_indices = indices;
+    decode_mutation_indices(all_mutations - progress->last_ok_mutation);
+
+    for (int i = 0; i < num_args; i++) {
+      if (indices[i] == failing_indices[i]) {
+        continue;
       }
+      if (failing_arg >= 0) {
+        failing_arg = -1;
+        break;
+      }
+      failing_arg = i;
     }
 
-    return has_more;
+    indices = failing_indices;
+
+    return failing_arg;
   }
 
   /* Skips ahead num_mut_skip mutations to bound the total mutations */
   void Fuzzer::next_mutations_indices(bool log)
   {
 
-    pid_t mypid = 0;
-    std::string mut_filename;
-    std::string last_timestamp_filename;
-    std::ios_base::openmode fflags = std::ios::out | std::ios::in | std::ios::trunc;
-    char logbuf[LOGBUFSZ];
     struct timespec ts = {};
-    memset(logbuf, 0, LOGBUFSZ);
 
     if (!main_pool_done) {
       total_mutations -= num_mut_skip;
-
-      long long passed = all_mutations - total_mutations;
-      for (int i = 0; i < num_args; i++) {
-        indices[i] = passed % pool_sizes[i];
-        passed = passed / pool_sizes[i];
-      }
+      decode_mutation_indices(all_mutations - total_mutations);
     } else {
       total_mutations--;
     }
 
     if (log) {
 
-      if (!mutations_file.is_open()) {
-        mypid = ::getpid();
-        mut_filename = std::string(results_dir) + "/" + cur_fname + "_mutations.log." + std::to_string(mypid);
-        create_file(mut_filename, mutations_file, fflags);
+      if (progress == nullptr) {
+        progress = map_progress_slot(mutations_logger_filename, cur_fname);
       }
-      mutations_file.seekp(0, std::ios::beg);
-      sprintf(logbuf, "%llu", total_mutations);
-      mutations_file.write(logbuf, LOGBUFSZ);
-      mutations_file.flush();
 
-      if (!last_timestamp_file.is_open()) {
-        mypid = ::getpid();
-        last_timestamp_filename = std::string(results_dir) + "/" + cur_fname + ".last_timestamp." + std::to_string(mypid);
-        create_file(last_timestamp_filename, last_timestamp_file, fflags);
+      if (progress != nullptr) {
+        /* Seconds are enough for the crash time, the coarse clock is cheaper */
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        progress->timestamp = ts.tv_sec;
+        progress->mutation = total_mutations;
       }
-
-      last_timestamp_file.seekp(0, std::ios::beg);
-      memset(logbuf, 0, LOGBUFSZ);
-      clock_gettime(CLOCK_MONOTONIC, &ts);
-      sprintf(logbuf, "%lld", (long long) ts.tv_sec);
-      last_timestamp_file.write(logbuf, LOGBUFSZ);
-      last_timestamp_file.flush();
     }
 
     /* std::cout << "next_mutations_indices end\n" << std::flush; */
@@ -1986,28 +4026,31 @@ namespace tffuzzing {
 
     tensorflow::DataType ttype;
     tensorflow::OpKernelContext::Params *fuzz_ctx_params = original_ctx->get_params();
-    std::vector<tensorflow::TensorValue> fuzz_vec;
-    tensorflow::TensorValue fuzz_tensval;
-    tensorflow::TensorValue *fuzz_tensval_ptr;
-    tensorflow::OpKernelContext *fuzz_ctx = nullptr;
-
-    tensorflow::Tensor tensor;
     tensorflow::TensorShape shape, orig_shape;
-    long set_zero, cur_dim;
+    long cur_dim;
+
+    /*
+     * The previous mutation is done with its context by now, drop it (and
+     * its outputs) instead of leaking one context per mutation
+     */
+#if defined(IVYSYN_GUARD_OUTPUTS)
+    guarded_ctx = nullptr;
+#endif
+    delete cur_fuzz_ctx;
+    cur_fuzz_ctx = nullptr;
+    fuzz_inputs.clear();
 
     if (!main_pool_done) {
       for (int idx = 0; idx < num_args; idx++) {
         ttype = tensor_types.at(idx);
-        fuzz_tensval = get_next_mut(ttype, idx);
-        fuzz_vec.push_back(fuzz_tensval);
+        fuzz_inputs.push_back(get_next_mut(ttype, idx));
       }
     } else {
+      /* Assigning over the previous mutation's tensors releases their buffers */
       cur_dim = 1;
       for (int idx = 0; idx < num_args; idx++) {
         if (tensor_types.at(idx) == tensorflow::DataType::DT_VARIANT) {
-          tensorflow::Tensor orig = original_ctx->input(idx);
-          tensorflow::Tensor *tensor = new tensorflow::Tensor(tensorflow::tensor::DeepCopy(orig));
-          fuzz_tensval = tensorflow::TensorValue(tensor);
+          arg_tensors[idx] = tensorflow::tensor::DeepCopy(original_ctx->input(idx));
         } else {
           shape = tensorflow::TensorShape();
           orig_shape = tensor_shapes.at(idx);
@@ -2018,33 +4061,410 @@ namespace tffuzzing {
               shape.AddDim(orig_shape.dim_size(d));
             }
           }
-          fuzz_tensval_ptr = get_empty_tensor_with_shape(tensor_types.at(idx), shape);
-          if (fuzz_tensval_ptr == nullptr) {
-            fuzz_tensval_ptr = new tensorflow::TensorValue(new tensorflow::Tensor(original_ctx->input(idx)));
-          }
-          fuzz_tensval = *fuzz_tensval_ptr;
+          arg_tensors[idx] = tensorflow::Tensor(tensor_types.at(idx), shape);
         }
-        fuzz_vec.push_back(fuzz_tensval);
+        fuzz_inputs.push_back(tensorflow::TensorValue(&arg_tensors[idx]));
       }
     }
 
-    tensorflow::gtl::InlinedVector<tensorflow::TensorValue, 4> *fuzz_inputs = new
-      tensorflow::gtl::InlinedVector<tensorflow::TensorValue, 4>(fuzz_vec.begin(), fuzz_vec.end());
-    fuzz_ctx_params->inputs = fuzz_inputs;
-    fuzz_ctx = new tensorflow::OpKernelContext(fuzz_ctx_params);
+#if defined(IVYSYN_FUZZ_DEVICE)
+    /* Only CPU devices are wrapped */
+    if (original_device == nullptr) {
+      original_device = fuzz_ctx_params->device;
+      if (original_device->attributes().device_type() == tensorflow::DEVICE_CPU) {
+        fuzz_device = new FuzzDevice(original_device);
+      }
+    }
+    if (fuzz_device != nullptr) {
+#if defined(IVYSYN_FORK_SERVER)
+      if (in_fork_child) {
+        fuzz_device->use_child_workers();
+      }
+#endif
+      fuzz_ctx_params->device = fuzz_device;
+    }
+#endif
+
+    fuzz_ctx_params->inputs = &fuzz_inputs;
+    cur_fuzz_ctx = new tensorflow::OpKernelContext(fuzz_ctx_params);
+#if defined(IVYSYN_GUARD_OUTPUTS)
+    guarded_ctx = cur_fuzz_ctx;
+#endif
+
+    return cur_fuzz_ctx;
+
+  }
+
+#if defined(IVYSYN_COVERAGE)
+  /*
+   * Start this kernel from an empty edge map. The first time around, also
+   * time the guard callback, to report how much of the run it took
+   */
+  void Fuzzer::init_coverage()
+  {
+
+    struct timespec start_ts = {}, end_ts = {}, diff_ts = {};
+    uint32_t guard = 0;
+
+    cov_active = false;
+#if defined(IVYSYN_FORK_SERVER)
+    /* Shared, so the edges of children that crashed still count */
+    if (cov_seen != nullptr) {
+      munmap(cov_seen, cov_seen_size);
+    }
+    cov_seen_size = cov_num_guards + 1;
+    cov_seen = (unsigned char *) mmap(NULL, cov_seen_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (cov_seen == MAP_FAILED) {
+      cov_seen = nullptr;
+      cov_seen_size = 0;
+    }
+#else
+    delete[] cov_seen;
+    cov_seen_size = cov_num_guards + 1;
+    cov_seen = new unsigned char[cov_seen_size]();
+#endif
+
+    cov_stats.clear();
+    for (auto pool_size : pool_sizes) {
+      cov_stats.push_back(std::vector<struct cov_value_stats>(pool_size, {0, 0}));
+    }
+
+    if (cov_ns_per_call == 0) {
+      cov_active = true;
+      clock_gettime(CLOCK_MONOTONIC, &start_ts);
+      for (int i = 0; i < COV_CALIBRATION_CALLS; i++) {
+        __sanitizer_cov_trace_pc_guard(&guard);
+      }
+      clock_gettime(CLOCK_MONOTONIC, &end_ts);
+      cov_active = false;
+      diff_ts = time_diff(start_ts, end_ts);
+      cov_ns_per_call = (double) (diff_ts.tv_sec * NS_PER_SEC + diff_ts.tv_nsec) / COV_CALIBRATION_CALLS;
+    }
+    cov_calls = 0;
+  }
+
+  /*
+   * Every argument value of the current mutation already ran COV_MIN_RUNS
+   * times without reaching a new edge. A value that found an edge once is
+   * never skipped.
+   */
+  bool Fuzzer::coverage_dead_mutation()
+  {
+
+    if (cov_stats.size() < (size_t) num_args) {
+      return false;
+    }
+
+    for (int i = 0; i < num_args; i++) {
+      if (indices[i] < 0 || indices[i] >= (int) cov_stats[i].size()) {
+        return false;
+      }
+      auto &stats = cov_stats[i][indices[i]];
+      if (stats.runs < COV_MIN_RUNS || stats.new_edges > 0) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  /* Credit the new edges of the mutation that just ran to its argument values */
+  void Fuzzer::update_coverage(long long duration)
+  {
+
+    unsigned long long new_edges;
+
+    cov_active = false;
+    if (main_pool_done) {
+      return;
+    }
 
-    return fuzz_ctx;
+    new_edges = cov_new_edges.load(std::memory_order_relaxed);
+    for (int i = 0; i < num_args && i < (int) cov_stats.size(); i++) {
+      if (indices[i] < 0 || indices[i] >= (int) cov_stats[i].size()) {
+        continue;
+      }
+      cov_stats[i][indices[i]].runs++;
+      cov_stats[i][indices[i]].new_edges += new_edges;
+    }
+
+    cov_runs++;
+    cov_mut_ns += duration;
+  }
+
+  /* Edges reached, runs, skips and an estimate of what the callback cost */
+  void Fuzzer::log_coverage()
+  {
+
+    std::string cov_filename;
+    std::fstream cov_file;
+    unsigned long long edges = 0;
+    double callback_ns;
+
+    for (uint32_t i = 1; i < cov_seen_size; i++) {
+      edges += cov_seen[i];
+    }
+    callback_ns = cov_calls * cov_ns_per_call;
+
+    cov_filename = std::string(results_dir) + "/" + cur_fname + ".cov";
+    create_file(cov_filename, cov_file, std::ios::out | std::ios::trunc);
+    cov_file << "edges:" << edges << "/" << cov_num_guards << std::endl;
+    cov_file << "pcs:" << cov_num_pcs << std::endl;
+    cov_file << "runs:" << cov_runs << std::endl;
+    cov_file << "skipped:" << cov_skipped << std::endl;
+    cov_file << "callbacks:" << cov_calls << std::endl;
+    cov_file << "ns_per_callback:" << cov_ns_per_call << std::endl;
+    cov_file << "callback_ns:" << (unsigned long long) callback_ns << std::endl;
+    cov_file << "mutation_ns:" << cov_mut_ns << std::endl;
+    cov_file << "overhead:" << (cov_mut_ns > 0 ? 100.0 * callback_ns / cov_mut_ns : 0.0) << "%" << std::endl;
+    cov_file.close();
+  }
+#endif
+
+  /*
+   * HANG_P99_FACTOR times the p99 of the mutations timed so far, read off the
+   * top of its bucket, never more than TIMEOUT_SECS. Until there are enough
+   * of them to go by, HANG_COLD_SECS. The times are kept in the progress
+   * slot, so fork server children and restarts go on from them.
+   */
+  long long Fuzzer::hang_deadline_ns()
+  {
+    unsigned long long seen = 0, rank;
+    double deadline;
+    int bucket;
+
+    if (progress == nullptr || progress->hang_samples < HANG_MIN_SAMPLES) {
+      return (long long) HANG_COLD_SECS * NS_PER_SEC;
+    }
+
+    rank = progress->hang_samples - progress->hang_samples / 100;
+    for (bucket = 0; bucket < HANG_NUM_BUCKETS - 1; bucket++) {
+      seen += progress->hang_buckets[bucket];
+      if (seen >= rank) {
+        break;
+      }
+    }
+
+    deadline = HANG_P99_FACTOR * std::ldexp(1.0, bucket + 1);
+    deadline = std::max(deadline, (double) HANG_MIN_SECS * NS_PER_SEC);
+    deadline = std::min(deadline, (double) TIMEOUT_SECS * NS_PER_SEC);
+
+    return (long long) deadline;
+  }
+
+  /*
+   * One shot timer on the fuzzing thread, so SIGALRM interrupts the mutation
+   * itself. Timers don't survive a fork, each fork server child makes its own.
+   */
+  void Fuzzer::arm_watchdog()
+  {
+    struct sigevent sev = {};
+    struct itimerspec its = {};
+    long long deadline;
+
+    if (hang_timer_pid != ::getpid()) {
+      sev.sigev_notify = SIGEV_THREAD_ID;
+      sev.sigev_signo = SIGALRM;
+      sev.sigev_notify_thread_id = syscall(SYS_gettid);
+      if (timer_create(CLOCK_MONOTONIC, &sev, &hang_timer) != 0) {
+        std::cout << "Failed to create the watchdog for " << cur_fname << std::endl;
+        std::cout << "Error: " << strerror(errno) << std::endl;
+        return;
+      }
+      hang_timer_pid = ::getpid();
+    }
+
+    deadline = hang_deadline_ns();
+    its.it_value.tv_sec = deadline / NS_PER_SEC;
+    its.it_value.tv_nsec = deadline % NS_PER_SEC;
+    timer_settime(hang_timer, 0, &its, NULL);
+  }
+
+  void Fuzzer::disarm_watchdog()
+  {
+    struct itimerspec its = {};
+
+    if (hang_timer_pid == ::getpid()) {
+      timer_settime(hang_timer, 0, &its, NULL);
+    }
+  }
+
+  /* Whether the watchdog stopped the process on last_mutation */
+  bool Fuzzer::was_hung(long long last_mutation)
+  {
+    std::ifstream hang_file(hang_filename);
+    long long mutation;
+
+    if (!(hang_file >> mutation)) {
+      return false;
+    }
+
+    return mutation == last_mutation;
+  }
+
+#if defined(IVYSYN_SLOW_INPUTS)
+  /* Four buckets per power of two, the first few nanoseconds get one each */
+  static inline int slow_time_bucket(long long duration)
+  {
+    int exp;
+
+    if (duration < 4) {
+      return duration > 0 ? duration : 0;
+    }
+
+    exp = 63 - __builtin_clzll(duration);
+    return exp * 4 + ((duration >> (exp - 2)) & 3);
+  }
+
+  /* Middle of a bucket */
+  static inline double slow_bucket_ns(int bucket)
+  {
+    int exp = bucket / 4;
+
+    if (bucket < 4) {
+      return bucket;
+    }
+
+    return std::ldexp(4 + bucket % 4 + 0.5, exp - 2);
+  }
+
+  /*
+   * Median of the durations in hist, and their MAD: the deviations grow
+   * going out from the median bucket on either side, so walk out from it
+   * until half of the samples are covered.
+   */
+  static void slow_median_mad(const uint32_t *hist, unsigned long long samples, double *median, double *mad)
+  {
+    unsigned long long seen = 0;
+    double lo_dev, hi_dev, dev = 0;
+    int bucket, lo, hi;
+
+    for (bucket = 0; bucket < SLOW_TIME_BUCKETS - 1; bucket++) {
+      seen += hist[bucket];
+      if (2 * seen >= samples) {
+        break;
+      }
+    }
+    *median = slow_bucket_ns(bucket);
+
+    seen = 0;
+    lo = bucket;
+    hi = bucket + 1;
+    while (2 * seen < samples && (lo >= 0 || hi < SLOW_TIME_BUCKETS)) {
+      lo_dev = lo >= 0 ? *median - slow_bucket_ns(lo) : HUGE_VAL;
+      hi_dev = hi < SLOW_TIME_BUCKETS ? slow_bucket_ns(hi) - *median : HUGE_VAL;
+      if (lo_dev <= hi_dev) {
+        seen += hist[lo--];
+        dev = lo_dev;
+      } else {
+        seen += hist[hi++];
+        dev = hi_dev;
+      }
+    }
+    *mad = dev;
+  }
+
+  /*
+   * Compare the mutation that just ran with the ones before it with about as
+   * many input elements, log it to <kernel>.slow if it is an outlier, and add
+   * it to the model
+   */
+  void Fuzzer::check_slow_input(long long duration)
+  {
+    unsigned long long elements = 0;
+    std::string slow_filename;
+    std::fstream slow_file;
+    double median, mad;
+    uint32_t *hist;
+    int size_bucket;
+
+    if (slow_hist.empty()) {
+      slow_hist.assign(SLOW_SIZE_BUCKETS * SLOW_TIME_BUCKETS, 0);
+      slow_samples.assign(SLOW_SIZE_BUCKETS, 0);
+    }
+
+    for (auto &input : fuzz_inputs) {
+      if (input.tensor != nullptr) {
+        elements += input.tensor->NumElements();
+      }
+    }
+
+    size_bucket = elements > 0 ? std::min(64 - __builtin_clzll(elements), SLOW_SIZE_BUCKETS - 1) : 0;
+    hist = &slow_hist[size_bucket * SLOW_TIME_BUCKETS];
+
+    if (duration >= SLOW_MIN_NS && slow_samples[size_bucket] >= SLOW_MIN_SAMPLES) {
+      slow_median_mad(hist, slow_samples[size_bucket], &median, &mad);
+      /* 1.4826 scales the MAD to a standard deviation */
+      if (duration > median + SLOW_MAD_FACTOR * 1.4826 * mad && duration > SLOW_MIN_RATIO * median) {
+        slow_filename = std::string(results_dir) + "/" + cur_fname + ".slow";
+        slow_file.open(slow_filename, std::ios::out | std::ios::app);
+        slow_file << "mutation:" << total_mutations << " elements:" << elements << " duration_ns:" << duration
+                  << " median_ns:" << (long long) median << " mad_ns:" << (long long) mad << std::endl;
+        log_current_mutation(slow_file);
+        slow_file.close();
+      }
+    }
+
+    hist[slow_time_bucket(duration)]++;
+    slow_samples[size_bucket]++;
+  }
+#endif
+
+#if defined(IVYSYN_MEMORY_CEILING)
+  /*
+   * Log the mutation that just ran to <kernel>.memory if it hit the ceiling,
+   * or asked for MEMORY_AMPLIFICATION_RATIO times the bytes of its inputs
+   */
+  void Fuzzer::check_memory()
+  {
+    unsigned long long input_bytes = 0, requested, peak, refused;
+    std::string memory_filename;
+    std::fstream memory_file;
+    double amplification;
+
+    if (fuzz_device == nullptr) {
+      return;
+    }
 
+    CountingAllocator::stats(&requested, &peak, &refused);
+
+    for (auto &input : fuzz_inputs) {
+      if (input.tensor != nullptr) {
+        input_bytes += input.tensor->TotalBytes();
+      }
+    }
+
+    amplification = (double) requested / std::max(input_bytes, 1ULL);
+    if (refused == 0 && (requested < MEMORY_AMPLIFICATION_MIN_BYTES || amplification < MEMORY_AMPLIFICATION_RATIO)) {
+      return;
+    }
+
+    memory_filename = std::string(results_dir) + "/" + cur_fname + ".memory";
+    memory_file.open(memory_filename, std::ios::out | std::ios::app);
+    memory_file << "mutation:" << total_mutations << " input_bytes:" << input_bytes << " requested:" << requested
+                << " peak:" << peak << " refused:" << refused << " amplification:" << amplification << std::endl;
+    log_current_mutation(memory_file);
+    memory_file.close();
   }
+#endif
 
   void Fuzzer::mut_start_time()
   {
 
+    arm_watchdog();
+#if defined(IVYSYN_MEMORY_CEILING)
+    CountingAllocator::reset();
+#endif
+
     if (main_pool_done) {
       return;
     }
 
     clock_gettime(CLOCK_MONOTONIC, &start_time);
+#if defined(IVYSYN_COVERAGE)
+    cov_new_edges.store(0, std::memory_order_relaxed);
+    cov_active = true;
+#endif
   }
 
   void Fuzzer::mut_end_time(tensorflow::OpKernelContext *fuzz_ctx)
@@ -2055,61 +4475,85 @@ namespace tffuzzing {
     /* } */
 
     struct timespec duration_ts = {};
-    struct stat stat_buffer = {};
-    std::ios_base::openmode fflags = std::ios::out | std::ios::in;
-    /* std::string duration_filename; */
-    /* std::fstream duration_file; */
     /* char logbuf[LOGBUFSZ]; */
     /* memset(logbuf, 0, LOGBUFSZ); */
 
     clock_gettime(CLOCK_MONOTONIC, &end_time);
 
+    disarm_watchdog();
+
     duration_ts = time_diff(start_time, end_time);
     int64_t duration = duration_ts.tv_sec * NS_PER_SEC + duration_ts.tv_nsec;
 
+    /* The zero-dim pool isn't timed */
+    if (!main_pool_done) {
+      if (progress != nullptr) {
+        progress->hang_buckets[duration > 0 ? 63 - __builtin_clzll(duration) : 0]++;
+        progress->hang_samples++;
+        progress->last_ok_mutation = total_mutations;
+      }
+#if defined(IVYSYN_SLOW_INPUTS)
+      check_slow_input(duration);
+#endif
+#if defined(IVYSYN_MEMORY_CEILING)
+      check_memory();
+#endif
+    }
+
+#if defined(IVYSYN_COVERAGE)
+    update_coverage(duration);
+#endif
+
     /* sprintf(logbuf, "%llu:%lu", total_mutations, duration); */
     if (fuzz_ctx->status() == tensorflow::Status::OK()) {
-      /* time_file.write(logbuf, LOGBUFSZ); */
-      time_file << total_mutations << ":" << duration << std::endl << std::flush;
+      log_mutation_record(total_mutations, duration, MUT_STATUS_OK, -1);
     } else {
-      /* except_file.write(logbuf, LOGBUFSZ); */
-      except_file << total_mutations << ":" << duration << std::endl << std::flush;
-    }
-
-
-    // Log mutations that took more than THRESH seconds to finish
-    /* if (duration_secs > TIME_THRESH_SECS) { */
-      /* We want to log the mutation that just run, so this will achieve it:
-       * 1. Move to the mutation BEFORE the mutation that just run
-       * 2. Call next_mutations_indices to set up the indices array correctly
-       * for the mutation after that, which is the mutation that just run
-       * 3. Call log_current_mutation to log it
-       * 4. When the fuzzed function calls has_more_mutations,
-       * next_mutations_indices will be called again and will move to the next
-       * mutation
-       */
-      /* total_mutations += (num_mut_skip * 2); */
-      /* next_mutations_indices(false); */
-
-      /* duration_filename = std::string(results_dir) + "/" + cur_fname + ".duration"; */
-      /* if (stat(duration_filename.c_str(), &stat_buffer) != 0) { */
-      /*   fflags |= std::ios::trunc; */
-      /*   create_file(duration_filename, duration_file, fflags); */
-      /* } else { */
-      /*   duration_file.open(duration_filename, std::ios::app); */
-      /*   if (duration_file.fail()) { */
-      /*     std::cout << "Failed to open " << duration_filename << std::endl; */
-      /*     std::cout << "Error: " << strerror(errno) << std::endl; */
-      /*   } */
-      /* } */
-
-      /* duration_file << "Duration (secs): " << duration_secs << std::endl; */
-      /* log_current_mutation(duration_file); */
-      /* duration_file << std::flush; */
-      /* duration_file.close(); */
-    /* } */
+      log_mutation_record(total_mutations, duration, MUT_STATUS_FAILED, -1);
+    }
   }
 
 #endif
 
 }
+
+#if defined(IVYSYN_COVERAGE)
+/*
+ * SanitizerCoverage callbacks for the kernels built with
+ * -fsanitize-coverage=trace-pc-guard,pc-table. Each module numbers its guards
+ * as it is loaded, and edges only count while a mutation is running, so they
+ * are the ones of the kernel being fuzzed
+ */
+extern "C" void __sanitizer_cov_trace_pc_guard_init(uint32_t *start, uint32_t *stop)
+{
+  /* Can be called more than once for the same module */
+  if (start == stop || *start != 0) {
+    return;
+  }
+
+  for (uint32_t *guard = start; guard < stop; guard++) {
+    *guard = ++tffuzzing::cov_num_guards;
+  }
+}
+
+extern "C" void __sanitizer_cov_pcs_init(const uintptr_t *pcs_beg, const uintptr_t *pcs_end)
+{
+  /* A PC and its flags for every edge */
+  tffuzzing::cov_num_pcs += (pcs_end - pcs_beg) / 2;
+}
+
+extern "C" __attribute__((noinline)) void __sanitizer_cov_trace_pc_guard(uint32_t *guard)
+{
+  uint32_t id = *guard;
+
+  if (!tffuzzing::cov_active) {
+    return;
+  }
+
+  /* Not atomic, only used to estimate the overhead */
+  tffuzzing::cov_calls++;
+  if (id < tffuzzing::cov_seen_size && !tffuzzing::cov_seen[id]) {
+    tffuzzing::cov_seen[id] = 1;
+    tffuzzing::cov_new_edges.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+#endif
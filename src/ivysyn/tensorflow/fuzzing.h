@@ -5,30 +5,91 @@
 #pragma once
 
 //#define IVYSYN_VALIDATE
+/* Run the mutations in a forked child, restarted in-process after a crash */
+//#define IVYSYN_FORK_SERVER
+/*
+ * Run a covering array of this strength (2 or 3) over the argument pools
+ * instead of striding through all their combinations when there are too many
+ */
+//#define IVYSYN_COVERING_STRENGTH 2
+/* Visit the mutations in a seeded pseudo-random order instead of in sequence */
+//#define IVYSYN_PERMUTE_MUTATIONS
+/*
+ * Split the mutations of each kernel into this many shards, fuzzed at the
+ * same time by different processes (or hosts sharing results_dir)
+ */
+//#define IVYSYN_NUM_SHARDS 8
+/* Put the pool tensors right before a PROT_NONE page, so over-reads fault */
+//#define IVYSYN_GUARD_PAGES
+/* Same for the outputs and temporaries the kernel allocates, see FuzzDevice */
+//#define IVYSYN_GUARD_OUTPUTS
+/*
+ * Use SanitizerCoverage feedback from the instrumented kernels to skip
+ * mutations whose argument values never reached a new edge. The kernels need
+ * to be built with -fsanitize-coverage=trace-pc-guard,pc-table (see README)
+ */
+//#define IVYSYN_COVERAGE
+/*
+ * Log the mutations that run far slower than the others with about as many
+ * input elements to <kernel>.slow, to find quadratic paths and huge loops
+ */
+//#define IVYSYN_SLOW_INPUTS
+/*
+ * Count what each mutation allocates and fail the allocations that would
+ * take it over this many live bytes, see CountingAllocator
+ */
+//#define IVYSYN_MEMORY_CEILING (4ULL << 30)
+/*
+ * With IVYSYN_COLLECT_TYPES, also keep up to SEEDS_PER_KERNEL distinct
+ * inputs of every CPU kernel the tests run in <kernel>.seeds
+ */
+//#define IVYSYN_CAPTURE_SEEDS
 
+/* The modes that run the fuzzed contexts on a FuzzDevice */
+#if defined(IVYSYN_GUARD_OUTPUTS) || defined(IVYSYN_MEMORY_CEILING) || defined(IVYSYN_FORK_SERVER)
+#define IVYSYN_FUZZ_DEVICE
+#endif
+
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>
+#include <cmath>
 #include <cstdarg>
 #include <cstdio>
+#include <deque>
 #include <execinfo.h>
 #include <filesystem>
 #include <fstream>
 #include <glob.h>
 #include <initializer_list>
 #include <iostream>
+#include <link.h>
+#include <mutex>
 #include <random>
 #include <set>
 #include <signal.h>
+#include <sstream>
 #include <stdio.h>
 #include <string>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
 #include <thread>
+#include <time.h>
 #include <unistd.h>
 #include <unordered_map>
 #include <vector>
 
 #include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
 #include "tensorflow/core/framework/tensor_util.h"
+#include "tensorflow/core/framework/allocation_description.pb.h"
+#include "tensorflow/core/framework/device_attributes.pb.h"
+#include "tensorflow/core/framework/device_base.h"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/node_def_util.h"
 #include "tensorflow/core/framework/register_types.h"
@@ -36,6 +97,7 @@
 #include "tensorflow/core/framework/tensor_shape.h"
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/threadpool.h"
 
 #define NS_PER_SEC (1000 * 1000 * 1000)
 
@@ -59,11 +121,76 @@
 #define TENSOR_MAX_NUM_DIMS_FUZZ 10
 #define TENSOR_DIM_STEP_FUZZ 1
 #define MAX_DIM_SIZE 10
+/* Upper bound on the memory of a kernel's mutation pools */
+#define POOL_BYTES_BUDGET (512UL * 1024 * 1024)
+/* Zero tensors at least this big are mapped from the zero page instead of filled */
+#define ZERO_PAGE_MIN_BYTES (64 * 1024)
+/* Freed guarded buffers kept for reuse, per size in pages */
+#define GUARD_FREE_LIST_MAX 64
+/* Runs without a new edge before an argument value is no longer worth running */
+#define COV_MIN_RUNS 8
+#define COV_CALIBRATION_CALLS 1000000
+/* A mutation hangs after HANG_P99_FACTOR times the p99 of the kernel's mutations */
+#define HANG_P99_FACTOR 10
+#define HANG_MIN_SAMPLES 32
+#define HANG_MIN_SECS 1
+/* Deadline until there are HANG_MIN_SAMPLES mutations to go by */
+#define HANG_COLD_SECS 60
+#define HANG_NUM_BUCKETS 64
+/*
+ * Slow inputs: durations are kept per power of two of input elements, in
+ * buckets of a quarter of a power of two. A mutation is slow when it takes
+ * SLOW_MAD_FACTOR MADs over the median, and at least SLOW_MIN_RATIO times it.
+ */
+#define SLOW_SIZE_BUCKETS 64
+#define SLOW_TIME_BUCKETS (64 * 4)
+#define SLOW_MIN_SAMPLES 16
+#define SLOW_MAD_FACTOR 10
+#define SLOW_MIN_RATIO 4
+#define SLOW_MIN_NS (10 * 1000 * 1000)
+/* Mutations that allocate this many times the bytes of their inputs are logged */
+#define MEMORY_AMPLIFICATION_RATIO 1000
+#define MEMORY_AMPLIFICATION_MIN_BYTES (64 * 1024 * 1024)
+/* Seed corpus: capped per kernel, appended in batches of SEED_BATCH_BYTES */
+#define SEEDS_PER_KERNEL 32
+#define SEED_CORPUS_MAX_BYTES (64 * 1024 * 1024)
+#define SEED_BATCH_BYTES (4 * 1024 * 1024)
 
 #define FILENAME_SZ 0x100
 #define LOGBUFSZ 0x20
 #define BUFSZ 0x100
 
+#define PROGRESS_MAGIC 0x49565953
+#define RING_MAGIC 0x49565952
+#define CAPTURE_MAGIC 0x49565943
+#define CRASH_MAGIC 0x49565958
+#define COVERING_MAGIC 0x49565941
+/* Of the records and raw buffers in _crashes.bin, enough for any tensor */
+#define CRASH_ALIGN 64
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+/*
+ * A crash is bucketed by the hash of the top CRASH_HASH_FRAMES frames of its
+ * stack. Fuzzing a kernel stops after CRASH_DUPLICATES_BOUND crashes in
+ * buckets seen before, or after CRASHES_BOUND crashes in all
+ */
+#define CRASH_MAX_FRAMES 64
+#define CRASH_HASH_FRAMES 8
+#define CRASH_MAX_MODULES 512
+#define CRASH_DUPLICATES_BOUND 3
+#define CRASHES_BOUND 32
+#define RING_NUM_RECORDS 0x1000
+#define RING_DRAIN_MS 50
+#define MAX_KERNEL_IDS 0x10000
+
+/* Only spelled out by newer glibc */
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+#if defined(IVYSYN_COVERAGE)
+/* Defined at the end of fuzzing.cc */
+extern "C" void __sanitizer_cov_trace_pc_guard(uint32_t *guard);
+#endif
 
 namespace tffuzzing {
 
@@ -71,10 +198,408 @@ namespace tffuzzing {
     extern const char *results_dir;
 
     bool was_fuzzed(const std::string& fname);
+    bool was_fuzzed(int kernel_id, const char *fname);
     bool was_killed(const std::string& fname);
     void create_file(const std::string& filename, std::fstream &file, std::ios_base::openmode fflags);
     struct timespec time_diff(struct timespec start, struct timespec end);
-    void handle_timeout(int);
+    void handle_hang(int);
+
+#if defined(IVYSYN_COVERING_STRENGTH)
+    /*
+     * Header of results_dir/covering.<strength>.<key>, the covering array of
+     * every kernel with the same pool sizes. Followed by the pool sizes and
+     * the rows, as ints.
+     */
+    struct covering_header {
+        uint32_t magic;
+        int32_t strength;
+        int32_t rng_seed;
+        int32_t num_args;
+        int64_t num_rows;
+    };
+#endif
+
+    /*
+     * Progress of the kernel currently being fuzzed by this process. Mapped
+     * shared from <kernel>_mutations.log.<pid> in results_dir and updated with
+     * plain stores on every mutation, so the last mutation survives a crash or
+     * a SIGKILL of the process and can be read back by the next restart.
+     */
+    struct progress_slot {
+        volatile long long mutation;
+        volatile long long timestamp;
+        volatile unsigned int magic;
+        char kernel[FILENAME_SZ];
+        /* Set by the crash handler, only good if crash_mutation is mutation */
+        volatile long long crash_mutation;
+        volatile unsigned long long crash_bucket;
+        volatile int crash_signal;
+        /* The kernel's mutation times, carried over by restarts, see hang_deadline_ns() */
+        volatile unsigned long long hang_buckets[HANG_NUM_BUCKETS];
+        volatile unsigned long long hang_samples;
+        /* Last main pool mutation that returned, -1 if none. Also carried over */
+        volatile long long last_ok_mutation;
+    };
+
+    /*
+     * Cached state of every instrumented kernel, indexed by the id the injection
+     * pass assigned to it (kernel_ids.txt). Mapped shared from
+     * results_dir/kernel_states, so a kernel one process has seen done is done
+     * for all of them. A kernel is done if its entry is generation + 1 (0 is
+     * never seen), so bumping generation (tools/reset_kernel_states.cc)
+     * forgets them all at once, in every process that has the table mapped.
+     */
+    struct kernel_state_table {
+        std::atomic<unsigned int> generation;
+        std::atomic<unsigned int> done[MAX_KERNEL_IDS];
+    };
+
+    struct progress_slot *map_progress_slot(const std::string& filename, const std::string& fname);
+    void unmap_progress_slot(struct progress_slot *slot);
+    bool read_progress_slot(const std::string& filename, long long *mutation, long long *timestamp,
+                            unsigned long long *crash_bucket, int *crash_signal);
+
+    enum mutation_status {
+        MUT_STATUS_OK = 0,
+        MUT_STATUS_FAILED,
+        MUT_STATUS_CRASHED,
+        MUT_STATUS_HANG,
+    };
+
+    /*
+     * Timing record of a single mutation. The <kernel>.time.<pid> files are
+     * plain arrays of these, tools/timings_to_csv.cc converts them to CSV.
+     * failing_arg is only set for crashes and hangs: the one argument whose
+     * pool index differs from the last mutation that returned, see
+     * find_failing_arg(). It is -1 otherwise, or when that is not a single one.
+     */
+    struct mutation_record {
+        long long mutation;
+        long long duration;
+        int status;
+        int failing_arg;
+    };
+
+    /*
+     * Single producer/single consumer ring of mutation records, mapped shared
+     * from <kernel>.ring.<pid> in results_dir. The fuzzing thread moves head
+     * and a drain thread moves tail once the records are written out in
+     * batches, so whatever was not written yet is still in the file if the
+     * process crashes and is recovered by the next restart.
+     */
+    struct mutation_ring {
+        unsigned int magic;
+        std::atomic<unsigned long long> head;
+        std::atomic<unsigned long long> tail;
+        struct mutation_record records[RING_NUM_RECORDS];
+    };
+
+    bool start_mutation_ring(const std::string& ring_filename, const std::string& time_filename);
+    void stop_mutation_ring(const std::string& ring_filename);
+    void recover_mutation_ring(const std::string& ring_filename, const std::string& time_filename);
+    void log_mutation_record(long long mutation, long long duration, int status, int failing_arg);
+
+    /*
+     * Everything needed to run a kernel again outside of the test that ran
+     * it, see replay/replay.cc. A <kernel>.capture file starts with
+     * CAPTURE_MAGIC and the number of inputs, followed by the serialized
+     * NodeDef, the device type and a TensorProto per input (empty if the
+     * input is missing), each preceded by its length as a uint32.
+     */
+    struct kernel_capture {
+        tensorflow::NodeDef node_def;
+        std::string device_type;
+        std::vector<tensorflow::Tensor> inputs;
+        std::vector<bool> has_input;
+    };
+
+    bool write_kernel_capture(const std::string& filename, tensorflow::OpKernelContext *ctx);
+    bool read_kernel_capture(const std::string& filename, struct kernel_capture *capture);
+
+    /*
+     * <kernel>.seeds is append-only: each seed is a seed_header followed by
+     * a capture as above. hash covers the NodeDef and the input contents and
+     * is what duplicates are told apart by.
+     */
+    struct seed_header {
+        uint64_t hash;
+        uint64_t len;
+    };
+
+    bool read_kernel_seeds(const std::string& filename, std::vector<struct kernel_capture> *seeds);
+
+    /*
+     * <kernel>_crashes.bin has the crashing mutations as they were, where
+     * _crashes.log only has their DebugString(). Each record starts at a
+     * multiple of CRASH_ALIGN with a crash_record_header, then the NodeDef
+     * and the device type as in a capture, then for each input a TensorProto
+     * (empty if the input is missing) and the length of its raw buffer as a
+     * uint64. Types that can be memcpy'd have their contents in the raw
+     * buffer instead of the proto, at the next multiple of CRASH_ALIGN, so
+     * the tensors can point straight into a mapping of the file. A .validate
+     * file is a single record, see scripts/crash_records.py.
+     */
+    struct crash_record_header {
+        uint32_t magic;
+        uint32_t num_inputs;
+        int64_t mutation;
+        /* Of the whole record, header and padding included */
+        uint64_t len;
+    };
+
+    bool append_crash_record(const std::string& filename, long long mutation, const tensorflow::NodeDef& node_def,
+                             const std::string& device_type, const std::vector<const tensorflow::Tensor *>& inputs);
+    bool map_crash_record(const std::string& filename, struct kernel_capture *record);
+
+    /*
+     * Hands out private anonymous mappings, which read as zeros without any
+     * memory behind them until a page is written. Zero filled pool tensors
+     * come from here and are never touched, so only the pages a kernel
+     * actually writes get materialised.
+     */
+    class ZeroPageAllocator : public tensorflow::Allocator {
+    public:
+        std::string Name() override { return "ivysyn_zero_page"; }
+        void *AllocateRaw(size_t alignment, size_t num_bytes) override;
+        void DeallocateRaw(void *ptr) override;
+    };
+
+    ZeroPageAllocator *zero_page_allocator();
+
+    /*
+     * Electric fence style allocator. Every buffer ends (as close as the
+     * alignment allows) at a PROT_NONE page, so reading past it faults right
+     * away and shows up as a crash of the mutation. Freed mappings go on a
+     * free list per number of pages instead of back to the kernel.
+     */
+    class GuardPageAllocator : public tensorflow::Allocator {
+    public:
+        std::string Name() override { return "ivysyn_guard_page"; }
+        void *AllocateRaw(size_t alignment, size_t num_bytes) override;
+        void DeallocateRaw(void *ptr) override;
+        bool find_guard_page(void *addr, void **buffer, size_t *slack);
+        /* Of the buffers handed out since the last call, how many don't end right at their guard page */
+        void take_slack_stats(size_t *num_buffers, size_t *num_slack, size_t *max_slack);
+
+    private:
+        struct guard_mapping {
+            char *base;
+            size_t data_pages;
+            /* Bytes between the end of the buffer and the guard page */
+            size_t slack;
+        };
+
+        std::mutex mu;
+        /* Returned pointer to its mapping */
+        std::unordered_map<void *, struct guard_mapping> mappings;
+        std::unordered_map<size_t, std::vector<char *>> free_lists;
+        size_t num_buffers = 0;
+        size_t num_slack = 0;
+        size_t max_slack = 0;
+    };
+
+    GuardPageAllocator *guard_page_allocator();
+
+#if defined(IVYSYN_MEMORY_CEILING)
+    /*
+     * Wraps the allocator of the fuzzed contexts. Counts the bytes the
+     * current mutation asked for and the most it had live at once, for all
+     * the wrapped allocators together. An allocation that would take the live
+     * bytes over IVYSYN_MEMORY_CEILING fails as if memory ran out, so the
+     * kernel returns an error instead of the OOM killer taking the test down.
+     */
+    class CountingAllocator : public tensorflow::Allocator {
+    public:
+        explicit CountingAllocator(tensorflow::Allocator *wrapped) : wrapped(wrapped) {}
+
+        std::string Name() override { return "ivysyn_counting"; }
+        void *AllocateRaw(size_t alignment, size_t num_bytes) override;
+        void DeallocateRaw(void *ptr) override;
+
+        /* Start counting for a new mutation, and read the counts back */
+        static void reset();
+        static void stats(unsigned long long *requested, unsigned long long *peak, unsigned long long *refused);
+
+    private:
+        tensorflow::Allocator *wrapped;
+    };
+
+    CountingAllocator *counting_allocator(tensorflow::Allocator *wrapped);
+#endif
+
+    /*
+     * Stands in for the kernel's (CPU) device in the fuzzed contexts. All of
+     * it is forwarded to the real device, except for the allocator, so the
+     * outputs and temporaries of a mutation end at a guard page too, or are
+     * counted. In a fork server child, the worker threads are swapped too.
+     */
+    class FuzzDevice : public tensorflow::DeviceBase {
+    public:
+        explicit FuzzDevice(tensorflow::DeviceBase *device)
+          : tensorflow::DeviceBase(device->env()), device(device) {}
+
+        ~FuzzDevice() override
+        {
+          delete child_eigen_device;
+          delete child_pool;
+        }
+
+        /*
+         * The device's worker threads stay in the parent after a fork, so
+         * Shard() and the Eigen device would wait on them forever. Give the
+         * child a pool of its own, with a single thread.
+         */
+        void use_child_workers()
+        {
+          if (child_pool != nullptr) {
+            return;
+          }
+          child_pool = new tensorflow::thread::ThreadPool(env(), "ivysyn_fork_child", 1);
+          child_workers.num_threads = 1;
+          child_workers.workers = child_pool;
+          child_eigen_device = new Eigen::ThreadPoolDevice(child_pool->AsEigenThreadPool(), 1);
+        }
+
+        tensorflow::Allocator *GetAllocator(tensorflow::AllocatorAttributes attr) override
+        {
+          tensorflow::Allocator *allocator;
+
+#if defined(IVYSYN_GUARD_OUTPUTS)
+          allocator = guard_page_allocator();
+#else
+          allocator = device->GetAllocator(attr);
+#endif
+#if defined(IVYSYN_MEMORY_CEILING)
+          allocator = counting_allocator(allocator);
+#endif
+          return allocator;
+        }
+
+        const CpuWorkerThreads *tensorflow_cpu_worker_threads() const override
+        {
+          if (child_pool != nullptr) {
+            return &child_workers;
+          }
+          return device->tensorflow_cpu_worker_threads();
+        }
+        const GpuDeviceInfo *tensorflow_gpu_device_info() const override
+        {
+          return device->tensorflow_gpu_device_info();
+        }
+        bool has_eigen_cpu_device() const override
+        {
+          return device->has_eigen_cpu_device();
+        }
+        const Eigen::ThreadPoolDevice *eigen_cpu_device() override
+        {
+          if (child_eigen_device != nullptr) {
+            return child_eigen_device;
+          }
+          return device->eigen_cpu_device();
+        }
+        tensorflow::Allocator *GetScopedAllocator(tensorflow::AllocatorAttributes attr, tensorflow::int64 step_id) override
+        {
+          return device->GetScopedAllocator(attr, step_id);
+        }
+        tensorflow::ScopedAllocatorMgr *GetScopedAllocatorMgr() const override
+        {
+          return device->GetScopedAllocatorMgr();
+        }
+        tensorflow::ResourceMgr *resource_manager() override
+        {
+          return device->resource_manager();
+        }
+        const tensorflow::DeviceAttributes& attributes() const override
+        {
+          return device->attributes();
+        }
+        const std::string& name() const override
+        {
+          return device->name();
+        }
+        tensorflow::DeviceBase *UnderlyingDevice() override
+        {
+          return device->UnderlyingDevice();
+        }
+        const tensorflow::DeviceBase *UnderlyingDevice() const override
+        {
+          return device->UnderlyingDevice();
+        }
+        tensorflow::Status MakeTensorFromProto(const tensorflow::TensorProto& tensor_proto,
+                                               const tensorflow::AllocatorAttributes alloc_attrs,
+                                               tensorflow::Tensor *tensor) override
+        {
+          return device->MakeTensorFromProto(tensor_proto, alloc_attrs, tensor);
+        }
+
+    private:
+        tensorflow::DeviceBase *device;
+        tensorflow::thread::ThreadPool *child_pool = nullptr;
+        CpuWorkerThreads child_workers;
+        Eigen::ThreadPoolDevice *child_eigen_device = nullptr;
+    };
+
+    /*
+     * Owns the tensors of the mutation pools and their TensorValue wrappers.
+     * Deques don't move their elements, so the pools can keep pointers into
+     * them, and everything is released at once with the Fuzzer. Only counts
+     * the bytes that have memory behind them once the pools are filled.
+     */
+    class TensorArena {
+    public:
+        template <class... Args> tensorflow::Tensor *new_tensor(Args&&... args)
+        {
+          tensors.emplace_back(std::forward<Args>(args)...);
+          bytes += tensors.back().TotalBytes();
+          return &tensors.back();
+        }
+
+        /* Shares the buffer of tensor, which is the test's */
+        tensorflow::Tensor *new_shared_tensor(const tensorflow::Tensor& tensor)
+        {
+          tensors.emplace_back(tensor);
+          return &tensors.back();
+        }
+
+        /* Only pages the kernel writes get memory, see ZeroPageAllocator */
+        tensorflow::Tensor *new_zero_page_tensor(tensorflow::DataType ttype, const tensorflow::TensorShape& shape)
+        {
+          tensors.emplace_back(zero_page_allocator(), ttype, shape);
+          return &tensors.back();
+        }
+
+        /* A tensor for the mutation pools, guarded with IVYSYN_GUARD_PAGES */
+        tensorflow::Tensor *new_pool_tensor(tensorflow::DataType ttype, const tensorflow::TensorShape& shape)
+        {
+#if defined(IVYSYN_GUARD_PAGES)
+          size_t page_size = sysconf(_SC_PAGESIZE);
+
+          /* Filling it touches whole pages */
+          if (tensorflow::DataTypeCanUseMemcpy(ttype)) {
+            tensors.emplace_back(guard_page_allocator(), ttype, shape);
+            bytes += ((tensors.back().TotalBytes() + page_size - 1) / page_size) * page_size;
+            return &tensors.back();
+          }
+#endif
+          return new_tensor(ttype, shape);
+        }
+
+        tensorflow::TensorValue *new_value(tensorflow::Tensor *tensor)
+        {
+          values.emplace_back(tensor);
+          return &values.back();
+        }
+
+        size_t total_bytes() const
+        {
+          return bytes;
+        }
+
+    private:
+        size_t bytes = 0;
+        std::deque<tensorflow::Tensor> tensors;
+        std::deque<tensorflow::TensorValue> values;
+    };
 
     class Fuzzer {
     private:
@@ -86,7 +611,7 @@ namespace tffuzzing {
         const tensorflow::gtl::InlinedVector<tensorflow::TensorValue, 4>* original_inputs;
         std::string cur_fname;
         int num_args;
-        template <class T> tensorflow::TensorValue *get_tensor_with_shape_and_multiple_values(std::vector<T> values, tensorflow::DataType ttype, tensorflow::TensorShape shape);
+        TensorArena arena;
 
 #if !defined(IVYSYN_VALIDATE) && !defined(IVYSYN_COLLECT_TYPES)
         bool main_pool_done = false;
@@ -98,9 +623,43 @@ namespace tffuzzing {
         int cur_idx = 0;
         int cur_idx_zero_dims = 0;
         std::string mutations_logger_filename;
-        std::string timestamp_logger_filename;
+        std::string ring_filename;
+        bool owns_ring = false;
+        int lock_fd = -1;
+        long long shard_stop = 0;
+        /* Per-mutation watchdog, power of two buckets of mutation durations */
+        timer_t hang_timer;
+        pid_t hang_timer_pid = 0;
+#if defined(IVYSYN_NUM_SHARDS)
+        int shard = 0;
+        std::string kernel_fname;
+#endif
+#if defined(IVYSYN_COVERING_STRENGTH)
+        std::vector<int> covering_rows;
+#endif
+#if defined(IVYSYN_FORK_SERVER)
+        bool fork_server_started = false;
+        bool in_fork_child = false;
+        /* Of the test's own inputs, see check_original_context() */
+        uint64_t original_inputs_hash = 0;
+#endif
+#if defined(IVYSYN_COVERAGE)
+        /* Per argument and pool value: how often it ran and the new edges it found */
+        struct cov_value_stats {
+            unsigned long long runs;
+            unsigned long long new_edges;
+        };
+        std::vector<std::vector<struct cov_value_stats>> cov_stats;
+        long long cov_runs = 0;
+        long long cov_skipped = 0;
+        unsigned long long cov_mut_ns = 0;
+#endif
+#if defined(IVYSYN_SLOW_INPUTS)
+        /* SLOW_TIME_BUCKETS duration buckets for each size bucket */
+        std::vector<uint32_t> slow_hist;
+        std::vector<unsigned long long> slow_samples;
+#endif
         std::string mutations_restore_filename;
-        std::string timestamp_restore_filename;
         std::string crashes_logger_filename;
         std::vector<int> indices;
         std::vector<tensorflow::TensorShape> tensor_shapes;
@@ -144,19 +703,72 @@ namespace tffuzzing {
 
         std::vector<int> pool_sizes = {};
 
+        /* Reused across mutations, see get_fuzzed_context() */
+        tensorflow::gtl::InlinedVector<tensorflow::TensorValue, 4> fuzz_inputs;
+        tensorflow::OpKernelContext *cur_fuzz_ctx = nullptr;
+        std::vector<tensorflow::Tensor> arg_tensors;
+#if defined(IVYSYN_FUZZ_DEVICE)
+        tensorflow::DeviceBase *original_device = nullptr;
+        FuzzDevice *fuzz_device = nullptr;
+#endif
+
         void initialize_tensor_pools();
+        void log_pool_bytes();
+#if defined(IVYSYN_GUARD_PAGES)
+        void log_guard_slack();
+#endif
+        tensorflow::TensorShape fit_shape_to_budget(tensorflow::DataType ttype, tensorflow::TensorShape shape);
         void calculate_total_mutations();
         void next_mutations_indices(bool log);
-        void increase_num_crashes();
+        void decode_mutation_indices(long long passed);
+        int find_failing_arg();
+        bool seek_mutation(long long mutation);
+        bool lock_kernel_file(const std::string& fname);
+        bool claim_kernel();
+#if defined(IVYSYN_NUM_SHARDS)
+        void set_shard_range();
+        void merge_shards();
+#endif
+#if defined(IVYSYN_COVERING_STRENGTH)
+        long long get_covering_array();
+#endif
+#if defined(IVYSYN_FORK_SERVER)
+        bool run_fork_server();
+        bool check_original_context();
+#endif
+        void recover_stale_files(const std::string& stale_mutfile);
+#if defined(IVYSYN_COVERAGE)
+        void init_coverage();
+        bool coverage_dead_mutation();
+        void update_coverage(long long duration);
+        void log_coverage();
+#endif
+#if defined(IVYSYN_SLOW_INPUTS)
+        void check_slow_input(long long duration);
+#endif
+#if defined(IVYSYN_MEMORY_CEILING)
+        void check_memory();
+#endif
+        long long hang_deadline_ns();
+        void arm_watchdog();
+        void disarm_watchdog();
+        bool was_hung(long long last_mutation);
+        void increase_num_crashes(unsigned long long crash_bucket, int crash_signal);
         inline void inc_mutations_indices(bool log);
-        void restore_last_mutation(long long last_mutation, long long last_timestamp, bool do_resume);
+        void restore_last_mutation(long long last_mutation, long long last_timestamp,
+                                   unsigned long long crash_bucket, int crash_signal, bool do_resume);
         void log_current_mutation(std::fstream &file);
+        void log_crash_record(const std::string& filename);
         void mark_fuzzing_done();
+        void finish_fuzzing();
         void mark_unknown_type(tensorflow::DataType ttype);
         tensorflow::TensorValue *get_empty_tensor_with_shape(tensorflow::DataType ttype, tensorflow::TensorShape shape);
+        tensorflow::TensorValue *get_zero_tensor_with_shape(tensorflow::DataType ttype, tensorflow::TensorShape shape);
         template <class T> tensorflow::TensorValue *get_constant_tensor(T value);
         template <class T> tensorflow::TensorValue *get_tensor_with_value(T value, tensorflow::Tensor *tensor);
         template <class T> tensorflow::TensorValue *get_tensor_with_shape_and_value(T value, tensorflow::DataType ttype, tensorflow::TensorShape shape);
+        template <class Draw> void add_random_rank_tensors(tensorflow::DataType ttype, std::vector<tensorflow::TensorValue> &pool,
+                                                           const tensorflow::TensorShape& shape, const tensorflow::TensorShape& shape2, Draw draw);
 #endif
 
     public:
@@ -173,6 +785,10 @@ namespace tffuzzing {
         tensorflow::OpKernelContext *get_validate_context();
 #endif
 
+        /* Owns the mutated contexts, construct it in place */
+        Fuzzer(const Fuzzer&) = delete;
+        Fuzzer& operator=(const Fuzzer&) = delete;
+
         ~Fuzzer();
 
 #if !defined(IVYSYN_VALIDATE) && !defined(IVYSYN_COLLECT_TYPES)
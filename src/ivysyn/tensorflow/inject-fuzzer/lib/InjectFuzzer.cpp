@@ -11,6 +11,7 @@ const std::string TENSORFLOW_PATH = "/home/ivyusr/ivysyn/src/frameworks/tensorfl
 const std::string KERNEL_DIR = TENSORFLOW_PATH + "tensorflow/core/kernels/";
 const std::string TF_IVYSYN_PATH = "/home/ivyusr/ivysyn/src/ivysyn/tensorflow/";
 const std::string ONE_TO_ONE_FILE = TF_IVYSYN_PATH + "one_to_one_kernels.txt";
+const std::string KERNEL_IDS_FILE = TF_IVYSYN_PATH + "kernel_ids.txt";
 
 using namespace clang;
 using namespace ast_matchers;
@@ -38,6 +39,32 @@ std::string get_source_text(SourceRange range, const SourceManager& SrcMgr)
   return get_source_text_raw(printable_range, SrcMgr);
 }
 
+/*
+ * Id of a kernel is its (1-based) line in KERNEL_IDS_FILE, new kernels are
+ * appended so ids stay the same across runs of the pass. The fuzzer uses it to
+ * index the per-kernel state it caches for was_fuzzed()
+ */
+int get_kernel_id(const std::string &KName)
+{
+  std::ifstream in(KERNEL_IDS_FILE);
+  std::string Line;
+  int KernelId = 0;
+
+  while (std::getline(in, Line)) {
+    KernelId++;
+    if (Line == KName) {
+      return KernelId;
+    }
+  }
+  in.close();
+
+  std::ofstream out(KERNEL_IDS_FILE, std::ios::app);
+  out << KName << "\n";
+  out.close();
+
+  return KernelId + 1;
+}
+
 //-----------------------------------------------------------------------------
 // InjectFuzzer - implementation
 //-----------------------------------------------------------------------------
@@ -48,11 +75,11 @@ void ComputeDeclMatcher::run(const MatchFinder::MatchResult &Result) {
 
   const char *FuzzBodyTemplate = R""""({
 
-    if (!tffuzzing::already_fuzzing && !tffuzzing::was_fuzzed("%1$s")) {
+    if (!tffuzzing::already_fuzzing && !tffuzzing::was_fuzzed(%3$d, "%1$s")) {
 
         tffuzzing::already_fuzzing = true;
 
-        tffuzzing::Fuzzer fuzzer = tffuzzing::Fuzzer("%1$s", %2$s);
+        tffuzzing::Fuzzer fuzzer("%1$s", %2$s);
         OpKernelContext *fuzz_ctx;
 
         while (fuzzer.has_more_mutations(true)) {
@@ -325,7 +352,7 @@ void ComputeDeclMatcher::run(const MatchFinder::MatchResult &Result) {
   }
 
   memset(FilledBody, 0, 0x1000);
-  sprintf(FilledBody, FuzzBodyTemplate, OpName.str().c_str(), CtxParamName.str().c_str());
+  sprintf(FilledBody, FuzzBodyTemplate, OpName.str().c_str(), CtxParamName.str().c_str(), get_kernel_id(OpName.str()));
   std::string FilledBodyStr(FilledBody);
 
   InjectFuzzerRewriter.InsertText(ComputeStartLoc, (Twine(NewFname) + ComputeText + "\n\n").str());
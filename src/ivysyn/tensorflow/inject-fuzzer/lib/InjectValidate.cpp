@@ -46,7 +46,7 @@ void ComputeDeclMatcher::run(const MatchFinder::MatchResult &Result) {
 
   const char *FuzzBodyTemplate = R""""({
 
-        tffuzzing::Fuzzer fuzzer = tffuzzing::Fuzzer("%1$s", %2$s);
+        tffuzzing::Fuzzer fuzzer("%1$s", %2$s);
         if (fuzzer.should_validate()) {
           OpKernelContext *fuzz_ctx = fuzzer.get_validate_context();
           do_%1$s(fuzz_ctx);
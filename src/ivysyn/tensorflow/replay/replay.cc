@@ -0,0 +1,198 @@
+/*
+ * Fuzzes kernels straight from their <kernel>.capture files (written by the
+ * IVYSYN_COLLECT_TYPES run), without going through the Python tests. Built
+ * inside the instrumented TensorFlow tree, see BUILD.
+ *
+ * Each capture is replayed in a forked child: the kernel is created through
+ * the kernel registry and its instrumented Compute() runs the Fuzzer, as the
+ * test would. A child that dies (a crash, or the hang watchdog) is started
+ * again on the same capture, and the Fuzzer restores past the mutation that
+ * killed it as usual. Kernels the Fuzzer is done with only run once.
+ *
+ * A <kernel>.seeds corpus (IVYSYN_CAPTURE_SEEDS) can be given instead of a
+ * capture, its first seed is replayed.
+ *
+ * Usage: replay [-j jobs] <kernel>.capture [...]
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/core/common_runtime/device.h"
+#include "tensorflow/core/common_runtime/device_factory.h"
+#include "tensorflow/core/framework/fuzzing.h"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/lib/core/notification.h"
+#include "tensorflow/core/public/session_options.h"
+#include "tensorflow/core/public/version.h"
+
+/* Hangs restart the child as well, without counting towards the crash bounds */
+#define REPLAY_MAX_HANGS 32
+/*
+ * Enough for every crash the Fuzzer logs before it is done with the kernel
+ * (see increase_num_crashes()) and some hangs, guards against a loop
+ */
+#define REPLAY_MAX_RUNS (1 + CRASHES_BOUND + CRASH_DUPLICATES_BOUND + REPLAY_MAX_HANGS)
+/* The capture itself is unusable, running it again won't help */
+#define REPLAY_BAD_CAPTURE 3
+
+static int replay_capture(const std::string& filename)
+{
+  std::vector<tffuzzing::kernel_capture> seeds;
+  tffuzzing::kernel_capture capture;
+  std::unique_ptr<tensorflow::Device> device;
+  std::unique_ptr<tensorflow::OpKernel> kernel;
+  tensorflow::OpKernel *raw_kernel = nullptr;
+  tensorflow::gtl::InlinedVector<tensorflow::TensorValue, 4> inputs;
+  tensorflow::gtl::InlinedVector<tensorflow::AllocatorAttributes, 4> output_attrs;
+  std::function<void(std::function<void()>)> runner = [](std::function<void()> fn) { fn(); };
+  tensorflow::OpKernelContext::Params params;
+  tensorflow::Status status;
+
+  /* The first seed of a corpus is the one the tests ran first */
+  if (filename.size() > 6 && filename.compare(filename.size() - 6, 6, ".seeds") == 0) {
+    if (!tffuzzing::read_kernel_seeds(filename, &seeds)) {
+      std::cerr << "Failed to read " << filename << std::endl;
+      return REPLAY_BAD_CAPTURE;
+    }
+    capture = std::move(seeds.front());
+  } else if (!tffuzzing::read_kernel_capture(filename, &capture)) {
+    std::cerr << "Failed to read " << filename << std::endl;
+    return REPLAY_BAD_CAPTURE;
+  }
+
+  status = tensorflow::DeviceFactory::NewDevice(capture.device_type, tensorflow::SessionOptions(),
+                                                "/job:localhost/replica:0/task:0", &device);
+  if (!status.ok()) {
+    std::cerr << filename << ": " << status.ToString() << std::endl;
+    return REPLAY_BAD_CAPTURE;
+  }
+
+  status = tensorflow::CreateOpKernel(tensorflow::DeviceType(capture.device_type), device.get(),
+                                      device->GetAllocator(tensorflow::AllocatorAttributes()),
+                                      capture.node_def, TF_GRAPH_DEF_VERSION, &raw_kernel);
+  if (!status.ok()) {
+    std::cerr << filename << ": " << status.ToString() << std::endl;
+    return REPLAY_BAD_CAPTURE;
+  }
+  kernel.reset(raw_kernel);
+
+  for (size_t i = 0; i < capture.inputs.size(); i++) {
+    if (capture.has_input[i]) {
+      inputs.push_back(tensorflow::TensorValue(&capture.inputs[i]));
+    } else {
+      inputs.push_back(tensorflow::TensorValue());
+    }
+  }
+  output_attrs.resize(kernel->num_outputs());
+
+  params.device = device.get();
+  params.op_kernel = kernel.get();
+  params.inputs = &inputs;
+  params.output_attr_array = output_attrs.data();
+  params.resource_manager = device->resource_manager();
+  params.runner = &runner;
+  params.step_id = 1;
+
+  tensorflow::OpKernelContext ctx(&params, kernel->num_outputs());
+
+  if (kernel->AsAsync() != nullptr) {
+    tensorflow::Notification done;
+    device->ComputeAsync(kernel->AsAsync(), &ctx, [&done]() { done.Notify(); });
+    done.WaitForNotification();
+  } else {
+    device->Compute(kernel.get(), &ctx);
+  }
+
+  std::cout << capture.node_def.op() << ": " << ctx.status().ToString() << std::endl;
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  std::deque<std::pair<std::string, int>> queue;
+  std::unordered_map<pid_t, std::pair<std::string, int>> children;
+  std::pair<std::string, int> capture;
+  int jobs = 1, opt, status;
+  bool died;
+  pid_t pid;
+
+  while ((opt = getopt(argc, argv, "j:")) != -1) {
+    switch (opt) {
+      case 'j':
+        jobs = std::max(atoi(optarg), 1);
+        break;
+      default:
+        std::cerr << "Usage: " << argv[0] << " [-j jobs] <kernel>.capture [...]" << std::endl;
+        return 1;
+    }
+  }
+
+  if (optind >= argc) {
+    std::cerr << "Usage: " << argv[0] << " [-j jobs] <kernel>.capture [...]" << std::endl;
+    return 1;
+  }
+
+  for (int i = optind; i < argc; i++) {
+    queue.push_back(std::make_pair(std::string(argv[i]), 0));
+  }
+
+  /* Nothing of TensorFlow runs in here, so forking is safe */
+  while (!queue.empty() || !children.empty()) {
+
+    while ((int) children.size() < jobs && !queue.empty()) {
+      capture = queue.front();
+      queue.pop_front();
+
+      std::cout << std::flush;
+      pid = fork();
+      if (pid < 0) {
+        std::cerr << "Fork failed: " << strerror(errno) << std::endl;
+        return 1;
+      }
+      if (pid == 0) {
+        _exit(replay_capture(capture.first));
+      }
+      capture.second++;
+      children[pid] = capture;
+    }
+
+    pid = wait(&status);
+    if (pid < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+
+    capture = children[pid];
+    children.erase(pid);
+
+    died = WIFSIGNALED(status) || (WIFEXITED(status) && WEXITSTATUS(status) != 0 &&
+                                   WEXITSTATUS(status) != REPLAY_BAD_CAPTURE);
+    if (!died) {
+      continue;
+    }
+
+    if (capture.second < REPLAY_MAX_RUNS) {
+      std::cout << capture.first << " died, restarting" << std::endl;
+      queue.push_back(capture);
+    } else {
+      std::cerr << capture.first << " died " << REPLAY_MAX_RUNS << " times, giving up" << std::endl;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,185 @@
+import argparse
+import glob
+import os
+import struct
+
+import numpy as np
+import tensorflow as tf
+
+from synthesizer import (CRASH_DELIM, CRASHFILES_PATH_BASE, KERNEL_REGS_FILE,
+                         REPRODUCE_PATH_BASE, get_kernel_name, get_tf_type,
+                         handle_value_edge_cases, parse_crash_argument)
+
+# Has to match crash_record_header and CRASH_ALIGN in fuzzing.h
+CRASH_MAGIC = 0x49565958
+CRASH_ALIGN = 64
+CRASH_HEADER = struct.Struct("<IIqQ")
+
+
+def pad(record):
+    record += b"\0" * ((CRASH_ALIGN - len(record) % CRASH_ALIGN) % CRASH_ALIGN)
+
+
+def crash_record(mutation, node_def, device_type, protos):
+    """Same layout as append_crash_record(), with all contents in the protos"""
+
+    record = bytearray(CRASH_HEADER.size)
+    for field in (node_def, device_type):
+        record += struct.pack("<I", len(field)) + field
+    for proto in protos:
+        data = proto.SerializeToString() if proto is not None else b""
+        record += struct.pack("<I", len(data)) + data + struct.pack("<Q", 0)
+    pad(record)
+
+    CRASH_HEADER.pack_into(record, 0, CRASH_MAGIC,
+                           len(protos), mutation, len(record))
+    return bytes(record)
+
+
+def read_crash_records(filename):
+
+    with open(filename, "rb") as f:
+        data = f.read()
+
+    records = []
+    off = 0
+    while off + CRASH_HEADER.size <= len(data):
+        magic, _, _, length = CRASH_HEADER.unpack_from(data, off)
+        # Torn by a crash while appending
+        if magic != CRASH_MAGIC or off + length > len(data):
+            break
+        records.append(data[off:off + length])
+        off += length
+
+    return records
+
+
+def parse_value(value, dtype):
+
+    if dtype == tf.string:
+        return value.encode()
+    value = handle_value_edge_cases(value)
+    if dtype == tf.bool:
+        return value not in ("0", "false")
+    if dtype.is_floating or dtype.is_complex:
+        return float(value)
+    return int(float(value))
+
+
+def convert_argument(arg):
+    """
+    DebugString() only keeps the first few values. Those are kept, and the
+    last one fills the rest of the tensor, as Tensor::FromProto() does.
+    """
+
+    parsed = parse_crash_argument(arg)
+    if parsed is None:
+        return None
+
+    tensor_type, tensor_shape, tensor_values = parsed
+    try:
+        dtype = tf.as_dtype(get_tf_type(tensor_type))
+    except TypeError:
+        return None
+
+    shape = [int(x) for x in tensor_shape.strip("[]").split(",") if x]
+    num_elements = int(np.prod(shape))
+
+    try:
+        values = [parse_value(x, dtype) for x in tensor_values if x]
+    except ValueError:
+        return None
+    values = values[:num_elements]
+    if num_elements > 0 and len(values) == 0:
+        values = [parse_value("0", dtype)]
+
+    if num_elements == 0:
+        return tf.make_tensor_proto(np.zeros(shape, dtype.as_numpy_dtype), dtype=dtype)
+    return tf.make_tensor_proto(values, dtype=dtype, shape=shape, verify_shape=False)
+
+
+def convert_crash(crash):
+    """
+    The old text logs only have SummarizeAttrs(), so no NodeDef is written.
+    Arguments that couldn't be logged (resources, variants) are missing, the
+    validation takes those from the test.
+    """
+
+    lines = crash.rstrip().split("\n")[1:]
+    protos = [convert_argument(arg) for arg in lines]
+    return crash_record(-1, b"", b"CPU", protos)
+
+
+def convert_log(log_filename):
+
+    bin_filename = log_filename.replace("_crashes.log", "_crashes.bin")
+
+    with open(log_filename, "r", errors="replace") as f:
+        crashes = [x for x in f.read().split(CRASH_DELIM) if x.strip()]
+
+    with open(bin_filename, "wb") as f:
+        for crash in crashes:
+            f.write(convert_crash(crash))
+
+    return bin_filename
+
+
+def save_validate_files(crashes_path, validate_path):
+    """Replaces synthesizer.py --validate, with the first crash of each kernel"""
+
+    kernels_to_ops = {}
+    with open(KERNEL_REGS_FILE, "r") as f:
+        for reg in f.read().strip().split("\n"):
+            kernel_name, ops = reg.split(" ")
+            kernels_to_ops[kernel_name] = ops.split(',')
+
+    os.makedirs(validate_path, exist_ok=True)
+
+    for log_filename in glob.glob(crashes_path + "*_crashes.log"):
+
+        kernel_name = get_kernel_name(log_filename, crashes_path, "_crashes.log")
+        b_kernel_name = kernel_name
+        if kernel_name.endswith("Base") or kernel_name.endswith("BaseOp"):
+            b_kernel_name = kernel_name.replace("Base", "")
+        if b_kernel_name not in kernels_to_ops:
+            continue
+
+        # Results from before _crashes.bin was written
+        bin_filename = log_filename.replace("_crashes.log", "_crashes.bin")
+        if not os.path.isfile(bin_filename):
+            bin_filename = convert_log(log_filename)
+
+        records = read_crash_records(bin_filename)
+        if len(records) == 0:
+            continue
+
+        out_filename = validate_path + kernel_name + ".validate"
+        # No duplicates
+        if not os.path.isfile(out_filename):
+            with open(out_filename, "wb") as f:
+                f.write(records[0])
+
+
+def main():
+
+    args_parser = argparse.ArgumentParser()
+
+    arg_group = args_parser.add_mutually_exclusive_group(required=True)
+    arg_group.add_argument("--dir", dest="dir")
+    arg_group.add_argument("--convert", dest="convert", nargs="+",
+                           metavar="CRASHES_LOG")
+
+    args = args_parser.parse_args()
+
+    if args.convert:
+        for log_filename in args.convert:
+            print(convert_log(log_filename))
+        return
+
+    crashes_path = CRASHFILES_PATH_BASE + args.dir + "/"
+    validate_path = REPRODUCE_PATH_BASE + args.dir + "/validate/"
+    save_validate_files(crashes_path, validate_path)
+
+
+if __name__ == "__main__":
+    main()
@@ -6,6 +6,8 @@ PASS_BIN_PATH="/home/ivyusr/ivysyn/src/ivysyn/tensorflow/inject-fuzzer/bin/"
 TF_KERNELS_PATH=$TF_PATH"/tensorflow/core/kernels"
 INCLUDE_OP_STRING="#include \"tensorflow/core/framework/op_kernel.h\""
 INCLUDE_EIGEN_STRING="#define EIGEN_USE"
+COVERAGE_BAZELRC=$TF_PATH"/ivysyn_coverage.bazelrc"
+COVERAGE_FLAGS="-fsanitize-coverage=trace-pc-guard,pc-table"
 
 filenames=$(/usr/bin/fdfind -t f '.*\.cc$|.*\.h' $TF_KERNELS_PATH)
 filenames+=('reshape_op.h')
@@ -29,11 +31,24 @@ inject_header() {
     fi
 }
 
+# With IVYSYN_COVERAGE=1, also build the instrumented files with SanitizerCoverage
+# (bazel --bazelrc=ivysyn_coverage.bazelrc build --config=ivysyn_coverage ...)
+add_coverage_copt() {
+    filename=$1
+    if [[ $IVYSYN_COVERAGE == 1 ]]; then
+        echo "build:ivysyn_coverage --per_file_copt=${filename#$TF_PATH/}@$COVERAGE_FLAGS" >> $COVERAGE_BAZELRC
+    fi
+}
+
 main()
 {
+    if [[ $IVYSYN_COVERAGE == 1 ]]; then
+        > $COVERAGE_BAZELRC
+    fi
+
     for filename in $filenames; do
         echo $filename 1>&2
-        ${PASS_BIN_PATH}inject-fuzzer --extra-arg-before="-I$TF_PATH" --extra-arg-before="-xc++" $filename -- 2> /dev/null | grep 'INFO' && inject_header $filename
+        ${PASS_BIN_PATH}inject-fuzzer --extra-arg-before="-I$TF_PATH" --extra-arg-before="-xc++" $filename -- 2> /dev/null | grep 'INFO' && inject_header $filename && add_coverage_copt $filename
         # ${PASS_BIN_PATH}/inject-fuzzer --extra-arg-before="-DTENSORFLOW_USE_ROCM" --extra-arg-before="-I/opt/rocm-4.3.0" --extra-arg-before="-I$TF_PATH" --extra-arg-before="-xc++" $filename -- 2> /dev/null | grep 'INFO' && inject_header $filename
         # ${PASS_BIN_PATH}/inject-fuzzer --extra-arg-before="-DGOOGLE_CUDA" --extra-arg-before="-I$TF_PATH" --extra-arg-before="-xc++" $filename -- 2> /dev/null | grep 'INFO' && inject_header $filename
     done
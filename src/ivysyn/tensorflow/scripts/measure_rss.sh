@@ -0,0 +1,99 @@
+#!/bin/bash
+
+# Runs one kernel test under the fuzzer and samples the resident set size of
+# the test process, to check that it stays flat across the mutations of a
+# long-running kernel. Writes "seconds,rss_kb" lines to the CSV, and prints
+# the growth between the end of the warmup and the last sample.
+
+INTERVAL=5
+WARMUP=60
+IVYSYN_PATH="/home/ivyusr/ivysyn/"
+TF_ENV="${IVYSYN_PATH}venv/tensorflow-2.6-ivysyn/bin/activate"
+
+do_usage()
+{
+    echo "Usage: ./`basename $0` --test <test.py> [--out <rss.csv>] [--interval <secs>] [--warmup <secs>]"
+}
+
+# Resident set size of a process in kB, empty once it has exited
+get_rss_kb()
+{
+    awk '/^VmRSS:/ { print $2 }' /proc/$1/status 2>/dev/null
+}
+
+do_measure()
+{
+    test_path=$1
+    out_csv=$2
+
+    echo "seconds,rss_kb" > "$out_csv"
+
+    python3 "$test_path" > /dev/null 2>&1 &
+    test_pid=$!
+    start=$SECONDS
+
+    while kill -0 $test_pid 2>/dev/null; do
+        rss=$(get_rss_kb $test_pid)
+        [[ -n $rss ]] && echo "$((SECONDS - start)),$rss" >> "$out_csv"
+        sleep $INTERVAL
+    done
+
+    wait $test_pid
+    echo "Test exited with $?"
+
+    awk -F, -v warmup=$WARMUP '
+        NR == 1 { next }
+        $1 >= warmup && base == "" { base = $2 }
+        { last = $2; if ($2 > max) max = $2 }
+        END {
+            if (base == "") { print "Test ran shorter than the warmup"; exit }
+            printf "RSS after warmup %d kB, last %d kB, max %d kB, growth %+d kB\n",
+                base, last, max, last - base
+        }' "$out_csv"
+}
+
+main()
+{
+    out_csv="rss.csv"
+
+    while [[ $# -gt 0 ]]; do
+        key="$1"
+        case $key in
+        --test)
+            shift
+            test_path=$1
+            shift
+            ;;
+        --out)
+            shift
+            out_csv=$1
+            shift
+            ;;
+        --interval)
+            shift
+            INTERVAL=$1
+            shift
+            ;;
+        --warmup)
+            shift
+            WARMUP=$1
+            shift
+            ;;
+        *)
+            do_usage
+            exit 1
+            ;;
+        esac
+    done
+
+    if [[ -z $test_path ]]; then
+        do_usage
+        exit 1
+    fi
+
+    source "${TF_ENV}"
+    do_measure "$test_path" "$out_csv"
+    deactivate
+}
+
+main $@
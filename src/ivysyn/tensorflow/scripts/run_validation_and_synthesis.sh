@@ -11,11 +11,12 @@ VALIDATION_DRIVERS="${IVYSYN_PATH}/src/ivysyn/tensorflow/validation_drivers/"
 RESULTS_DIR="/mnt/tensorflow-ivysyn/"
 VALIDATION_ENV="${IVYSYN_PATH}venv/tensorflow-2.6-ivysyn-validate/bin/activate"
 ORIG_ENV="${IVYSYN_PATH}venv/tensorflow-2.6-orig/bin/activate"
+VALIDATOR="${IVYSYN_PATH}src/frameworks/tensorflow-2.6-ivysyn/bazel-bin/tensorflow/tools/ivysyn_validator/validator"
 subdirs=("segfault" "fpe" "abort" "other")
 
 do_usage()
 {
-    echo "Usage: ./`basename $0` --dir <synth_folder> [--clean]"
+    echo "Usage: ./`basename $0` --dir <synth_folder> [--clean] [--batch]"
 }
 
 do_clean()
@@ -35,6 +36,15 @@ do_clean()
     rm -v $crash_type_dir/other/* || true
 }
 
+# Validates every record it can in one process, the drivers get the rest
+do_validate_batch()
+{
+    asan_out=$1
+    crash_type_out_all=$2
+    crash_type_out_run=$3
+    TF_CPP_MIN_LOG_LEVEL=2 ASAN_OPTIONS=detect_leaks=0:symbolize=1:detect_odr_violation=0:allocator_may_return_null=1 "${VALIDATOR}" -j $(nproc) -a "${asan_out}" -c "${crash_type_out_all}" -c "${crash_type_out_run}" ${validation_files_path}/*.validate
+}
+
 do_validate()
 {
 
@@ -45,6 +55,7 @@ do_validate()
     for line in $(cat validation_list.txt); do
         op=$(echo $line | cut -d ':' -f 1)
         kernel=$(echo $line | cut -d ':' -f 2)
+        [[ -f "${RESULTS_DIR}/${kernel}.true_positive" || -f "${RESULTS_DIR}/${kernel}.false_positive" ]] && continue
         echo $op
         echo $kernel
         cp ${validation_files_path}/${kernel}.validate ${RESULTS_DIR}
@@ -63,6 +74,7 @@ main()
 {
 
     clean=0
+    batch=0
 
     while [[ $# -gt 0 ]]; do
         key="$1"
@@ -76,6 +88,10 @@ main()
             clean=1
             shift
             ;;
+        --batch)
+            batch=1
+            shift
+            ;;
         *)
             do_usage
             exit 1
@@ -101,13 +117,18 @@ main()
 
     echo "Producing validation files..."
     source "${ORIG_ENV}"
-    python3 synthesizer.py --dir "${dir_to_check}" --validate
+    python3 crash_records.py --dir "${dir_to_check}"
 
     echo "Generating validation list and patching attributes..."
     python3 prep_validation.py --dir "${dir_to_check}" > validation_list.txt
     # Deactivate orig env here
     deactivate
 
+    if [[ $batch -eq 1 ]]; then
+        echo "Validating crash records..."
+        do_validate_batch "${asan_out_path}" "${crash_type_path_all}" "${crash_type_path_run}"
+    fi
+
     echo "Validating crashes with drivers..."
     do_validate "${asan_out_path}" "${crash_type_path_all}" "${crash_type_path_run}"
 
@@ -0,0 +1,309 @@
+/*
+ * Validates crashes from their .validate crash records in one process,
+ * instead of a Python interpreter and a validation driver per crash (see
+ * run_validation_and_synthesis.sh). Built inside the TensorFlow tree that
+ * was instrumented with inject_validate_code.sh, see BUILD.
+ *
+ * The parent copies <kernel>.validate into results_dir and forks a child per
+ * record. The child creates the kernel from the record's NodeDef and runs it
+ * on the record's inputs, so its instrumented Compute() takes the validation
+ * path: the Fuzzer leaves <kernel>.check and runs the kernel on
+ * get_validate_context(), then calls false_positive() if it returns. The
+ * parent turns what is left into the same results as the script:
+ *
+ *   - killed by a signal with <kernel>.check left: <kernel>.true_positive,
+ *     and the crash type from the signal under <crash_types>/<type>/<kernel>
+ *   - exited with an error with <kernel>.check left (an ASan report):
+ *     <kernel>.true_positive, crash type "other"
+ *   - ran out of time: <kernel>.false_positive
+ *
+ * Records that don't have a NodeDef (converted from an old _crashes.log by
+ * crash_records.py) or whose kernel can't be created are skipped, the
+ * validation drivers still cover those.
+ *
+ * Usage: validator [-j jobs] [-t timeout_secs] [-a asan_dir] [-c crash_types_dir ...] <kernel>.validate [...]
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "tensorflow/core/common_runtime/device.h"
+#include "tensorflow/core/common_runtime/device_factory.h"
+#include "tensorflow/core/framework/fuzzing.h"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/lib/core/notification.h"
+#include "tensorflow/core/public/session_options.h"
+#include "tensorflow/core/public/version.h"
+
+/* Same as the timeout the script runs the drivers with */
+#define VALIDATE_TIMEOUT_SECS 60
+/* The record can't be run here, leave it to the drivers */
+#define VALIDATE_SKIPPED 3
+
+/* Set when the binary runs under ASan, one report file per kernel like the script */
+extern "C" void __sanitizer_set_report_path(const char *path) __attribute__((weak));
+
+static const char *crash_type(int sig)
+{
+  switch (sig) {
+    case SIGSEGV:
+    case SIGBUS:
+      return "segfault";
+    case SIGFPE:
+      return "fpe";
+    case SIGABRT:
+      return "abort";
+    default:
+      return "other";
+  }
+}
+
+static bool file_exists(const std::string& filename)
+{
+  struct stat stat_buffer = {};
+
+  return stat(filename.c_str(), &stat_buffer) == 0;
+}
+
+static void touch(const std::string& filename)
+{
+  std::ofstream file(filename, std::ios::out | std::ios::app);
+}
+
+static bool copy_file(const std::string& src_filename, const std::string& dst_filename)
+{
+  std::error_code ec;
+
+  /* Already in results_dir, opening it for writing would truncate it */
+  if (std::filesystem::equivalent(src_filename, dst_filename, ec)) {
+    return true;
+  }
+
+  std::ifstream src_file(src_filename, std::ios::in | std::ios::binary);
+  std::ofstream dst_file(dst_filename, std::ios::out | std::ios::binary | std::ios::trunc);
+
+  if (!src_file.is_open() || !dst_file.is_open()) {
+    return false;
+  }
+
+  dst_file << src_file.rdbuf();
+  return dst_file.good();
+}
+
+/* <dir>/<kernel>.validate -> <kernel> */
+static std::string kernel_name(const std::string& filename)
+{
+  std::string name = filename.substr(filename.find_last_of('/') + 1);
+
+  return name.substr(0, name.rfind(".validate"));
+}
+
+static int validate_record(const std::string& filename, const std::string& asan_dir, int timeout_secs)
+{
+  tffuzzing::kernel_capture record;
+  std::unique_ptr<tensorflow::Device> device;
+  std::unique_ptr<tensorflow::OpKernel> kernel;
+  tensorflow::OpKernel *raw_kernel = nullptr;
+  tensorflow::gtl::InlinedVector<tensorflow::TensorValue, 4> inputs;
+  tensorflow::gtl::InlinedVector<tensorflow::AllocatorAttributes, 4> output_attrs;
+  std::function<void(std::function<void()>)> runner = [](std::function<void()> fn) { fn(); };
+  tensorflow::OpKernelContext::Params params;
+  tensorflow::Status status;
+  std::string asan_path;
+
+  if (!tffuzzing::map_crash_record(filename, &record) || record.node_def.op().empty()) {
+    std::cerr << filename << ": no NodeDef in the record, skipping" << std::endl;
+    return VALIDATE_SKIPPED;
+  }
+
+  if (!asan_dir.empty() && __sanitizer_set_report_path != nullptr) {
+    asan_path = asan_dir + "/" + kernel_name(filename);
+    __sanitizer_set_report_path(asan_path.c_str());
+  }
+
+  status = tensorflow::DeviceFactory::NewDevice(record.device_type, tensorflow::SessionOptions(),
+                                                "/job:localhost/replica:0/task:0", &device);
+  if (!status.ok()) {
+    std::cerr << filename << ": " << status.ToString() << std::endl;
+    return VALIDATE_SKIPPED;
+  }
+
+  status = tensorflow::CreateOpKernel(tensorflow::DeviceType(record.device_type), device.get(),
+                                      device->GetAllocator(tensorflow::AllocatorAttributes()),
+                                      record.node_def, TF_GRAPH_DEF_VERSION, &raw_kernel);
+  if (!status.ok()) {
+    std::cerr << filename << ": " << status.ToString() << std::endl;
+    return VALIDATE_SKIPPED;
+  }
+  kernel.reset(raw_kernel);
+
+  /* The Fuzzer swaps these for get_validate_context(), resources are taken from here */
+  for (size_t i = 0; i < record.inputs.size(); i++) {
+    if (record.has_input[i]) {
+      inputs.push_back(tensorflow::TensorValue(&record.inputs[i]));
+    } else {
+      inputs.push_back(tensorflow::TensorValue());
+    }
+  }
+  output_attrs.resize(kernel->num_outputs());
+
+  params.device = device.get();
+  params.op_kernel = kernel.get();
+  params.inputs = &inputs;
+  params.output_attr_array = output_attrs.data();
+  params.resource_manager = device->resource_manager();
+  params.runner = &runner;
+  params.step_id = 1;
+
+  tensorflow::OpKernelContext ctx(&params, kernel->num_outputs());
+
+  /* Nothing handles SIGALRM in validation builds, it kills us */
+  alarm(timeout_secs);
+
+  if (kernel->AsAsync() != nullptr) {
+    tensorflow::Notification done;
+    device->ComputeAsync(kernel->AsAsync(), &ctx, [&done]() { done.Notify(); });
+    done.WaitForNotification();
+  } else {
+    device->Compute(kernel.get(), &ctx);
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  std::string results_dir = tffuzzing::results_dir;
+  std::deque<std::string> queue;
+  std::unordered_map<pid_t, std::string> children;
+  std::vector<std::string> crash_types_dirs;
+  std::string asan_dir, kernel, kernel_path, validate_filename;
+  int jobs = 1, timeout_secs = VALIDATE_TIMEOUT_SECS, opt, status;
+  int num_true = 0, num_false = 0, num_skipped = 0;
+  bool checked;
+  pid_t pid;
+
+  while ((opt = getopt(argc, argv, "j:t:a:c:")) != -1) {
+    switch (opt) {
+      case 'j':
+        jobs = std::max(atoi(optarg), 1);
+        break;
+      case 't':
+        timeout_secs = std::max(atoi(optarg), 1);
+        break;
+      case 'a':
+        asan_dir = optarg;
+        break;
+      case 'c':
+        crash_types_dirs.push_back(optarg);
+        break;
+      default:
+        std::cerr << "Usage: " << argv[0] << " [-j jobs] [-t timeout_secs] [-a asan_dir] [-c crash_types_dir ...] <kernel>.validate [...]" << std::endl;
+        return 1;
+    }
+  }
+
+  if (optind >= argc) {
+    std::cerr << "Usage: " << argv[0] << " [-j jobs] [-t timeout_secs] [-a asan_dir] [-c crash_types_dir ...] <kernel>.validate [...]" << std::endl;
+    return 1;
+  }
+
+  for (int i = optind; i < argc; i++) {
+    queue.push_back(argv[i]);
+  }
+
+  /*
+   * Nothing of TensorFlow runs in here, so forking is safe. Every file the
+   * Fuzzer uses is named after the kernel, so kernels don't get in each
+   * other's way in results_dir.
+   */
+  while (!queue.empty() || !children.empty()) {
+
+    while ((int) children.size() < jobs && !queue.empty()) {
+      kernel = kernel_name(queue.front());
+      validate_filename = results_dir + "/" + kernel + ".validate";
+
+      if (!copy_file(queue.front(), validate_filename)) {
+        std::cerr << "Failed to copy " << queue.front() << " to " << validate_filename << std::endl;
+        queue.pop_front();
+        continue;
+      }
+
+      std::cout << std::flush;
+      pid = fork();
+      if (pid < 0) {
+        std::cerr << "Fork failed: " << strerror(errno) << std::endl;
+        return 1;
+      }
+      if (pid == 0) {
+        _exit(validate_record(validate_filename, asan_dir, timeout_secs));
+      }
+      children[pid] = kernel;
+      queue.pop_front();
+    }
+
+    pid = wait(&status);
+    if (pid < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+
+    kernel = children[pid];
+    children.erase(pid);
+    kernel_path = results_dir + "/" + kernel;
+    checked = file_exists(kernel_path + ".check");
+
+    if (WIFEXITED(status) && WEXITSTATUS(status) == VALIDATE_SKIPPED) {
+      num_skipped++;
+    } else if (WIFSIGNALED(status) && (WTERMSIG(status) == SIGALRM || WTERMSIG(status) == SIGKILL)) {
+      /* Timed out, as the script does on a timeout */
+      touch(kernel_path + ".false_positive");
+      std::remove((kernel_path + ".check").c_str());
+      num_false++;
+      std::cout << kernel << ": timed out, false positive" << std::endl;
+    } else if (checked && (WIFSIGNALED(status) || WEXITSTATUS(status) != 0)) {
+      /* What the Fuzzer of the next run would do on finding .check */
+      touch(kernel_path + ".true_positive");
+      std::remove((kernel_path + ".check").c_str());
+      std::remove((kernel_path + ".false_positive").c_str());
+      for (auto &dir : crash_types_dirs) {
+        touch(dir + "/" + (WIFSIGNALED(status) ? crash_type(WTERMSIG(status)) : "other") + "/" + kernel);
+      }
+      num_true++;
+      std::cout << kernel << ": " << (WIFSIGNALED(status) ? strsignal(WTERMSIG(status)) : "exited with an error")
+                << ", true positive" << std::endl;
+    } else if (file_exists(kernel_path + ".false_positive")) {
+      num_false++;
+      std::cout << kernel << ": false positive" << std::endl;
+    } else {
+      /* Crashed before the Fuzzer got to it, or the inputs didn't match */
+      std::remove((kernel_path + ".check").c_str());
+      num_skipped++;
+      std::cout << kernel << ": not validated" << std::endl;
+    }
+
+    std::remove((kernel_path + ".validate").c_str());
+  }
+
+  std::cout << num_true << " true positives, " << num_false << " false positives, "
+            << num_skipped << " not validated" << std::endl;
+  return 0;
+}
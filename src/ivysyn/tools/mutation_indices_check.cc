@@ -0,0 +1,211 @@
+/*
+ * Checks that restoring a mutation by decoding its number (seek_mutation())
+ * gives the same pool indices as stepping to it with next_mutations_indices(),
+ * for random pool sizes, with the strided, permuted and covering array
+ * schedules. Also checks that every index decoded while stepping is in range
+ * of its pool, and that the covering rows are never read past their end.
+ *
+ * Usage: mutation-indices-check [num_cases] [seed]
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+/*
+ * Must match RNG_SEED, NMUT_UPPER_BOUND_MID, calculate_total_mutations(),
+ * permute_mutation(), decode_mutation_indices(), seek_mutation() and the
+ * main pool part of next_mutations_indices() in tensorflow/fuzzing.cc and
+ * pytorch/fuzzing.cpp
+ */
+static const int RNG_SEED = 123;
+static const long long NMUT_UPPER_BOUND_MID = 1000000;
+
+static inline unsigned long long mix64(unsigned long long x)
+{
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+static long long permute_mutation(long long passed, long long n)
+{
+  unsigned long long x, left, right, tmp, mask;
+  int half_bits = 1;
+
+  if (passed < 0 || passed >= n) {
+    return passed;
+  }
+
+  while (half_bits < 32 && (1ULL << (2 * half_bits)) < (unsigned long long) n) {
+    half_bits++;
+  }
+  mask = (1ULL << half_bits) - 1;
+
+  x = passed;
+  do {
+    left = x >> half_bits;
+    right = x & mask;
+    for (int round = 0; round < 4; round++) {
+      tmp = right;
+      right = left ^ (mix64(right ^ mix64(RNG_SEED + round)) & mask);
+      left = tmp;
+    }
+    x = (left << half_bits) | right;
+  } while (x >= (unsigned long long) n);
+
+  return x;
+}
+
+struct schedule {
+  std::vector<int> pool_sizes;
+  std::vector<int> covering_rows;
+  std::vector<int> indices;
+  long long all_mutations;
+  long long total_mutations;
+  long long num_mut_skip;
+  bool permute;
+
+  schedule(const std::vector<int>& sizes, const std::vector<int>& rows, bool permute)
+    : pool_sizes(sizes), covering_rows(rows), indices(sizes.size(), 0), permute(permute)
+  {
+    if (!covering_rows.empty()) {
+      total_mutations = covering_rows.size() / pool_sizes.size();
+    } else {
+      total_mutations = 1;
+      for (int size : pool_sizes) {
+        total_mutations *= size;
+      }
+    }
+
+    num_mut_skip = 1;
+    if (total_mutations > NMUT_UPPER_BOUND_MID) {
+      num_mut_skip = total_mutations / NMUT_UPPER_BOUND_MID;
+    }
+    all_mutations = total_mutations;
+    total_mutations += num_mut_skip;
+    if (!indices.empty()) {
+      indices[0] = -1;
+    }
+  }
+
+  void decode_mutation_indices(long long passed)
+  {
+    if (!covering_rows.empty()) {
+      passed %= (long long) (covering_rows.size() / pool_sizes.size());
+      for (size_t i = 0; i < pool_sizes.size(); i++) {
+        /* Throws where the fuzzer would read out of bounds */
+        indices[i] = covering_rows.at(passed * pool_sizes.size() + i);
+      }
+      return;
+    }
+
+    if (permute) {
+      passed = permute_mutation(passed, all_mutations);
+    }
+
+    for (size_t i = 0; i < pool_sizes.size(); i++) {
+      indices[i] = passed % pool_sizes[i];
+      passed = passed / pool_sizes[i];
+    }
+  }
+
+  bool seek_mutation(long long mutation)
+  {
+    long long steps;
+
+    steps = total_mutations - mutation;
+    if (steps < 0 || steps % num_mut_skip != 0) {
+      return false;
+    }
+    if (steps == 0) {
+      return true;
+    }
+
+    total_mutations = mutation;
+    decode_mutation_indices(all_mutations - total_mutations);
+    return true;
+  }
+
+  void next_mutations_indices()
+  {
+    total_mutations -= num_mut_skip;
+    decode_mutation_indices(all_mutations - total_mutations);
+  }
+};
+
+static bool check_case(const std::vector<int>& sizes, const std::vector<int>& rows, bool permute, long long *num_steps)
+{
+  schedule stepped(sizes, rows, permute);
+
+  while (stepped.total_mutations > 0) {
+    stepped.next_mutations_indices();
+    (*num_steps)++;
+
+    for (size_t i = 0; i < sizes.size(); i++) {
+      if (stepped.indices[i] < 0 || stepped.indices[i] >= sizes[i]) {
+        std::cerr << "Index " << i << " out of range at mutation " << stepped.total_mutations << std::endl;
+        return false;
+      }
+    }
+
+    schedule restored(sizes, rows, permute);
+    if (!restored.seek_mutation(stepped.total_mutations) || restored.indices != stepped.indices) {
+      std::cerr << "Seek to mutation " << stepped.total_mutations << " doesn't match stepping" << std::endl;
+      return false;
+    }
+
+    /* Between two steps, not reachable */
+    if (stepped.num_mut_skip > 1) {
+      schedule unreachable(sizes, rows, permute);
+      if (unreachable.seek_mutation(stepped.total_mutations + 1)) {
+        std::cerr << "Seek to mutation " << stepped.total_mutations + 1 << " should have failed" << std::endl;
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  int num_cases = argc > 1 ? atoi(argv[1]) : 20;
+  std::mt19937_64 rng(argc > 2 ? strtoull(argv[2], NULL, 10) : RNG_SEED);
+  std::uniform_int_distribution<int> num_args_distr(1, 8);
+  std::uniform_int_distribution<int> size_distr(1, 40);
+  std::uniform_int_distribution<int> rows_distr(1, 5000);
+  std::vector<int> sizes, rows;
+  long long num_steps = 0;
+  int failed = 0;
+
+  for (int c = 0; c < num_cases; c++) {
+    sizes.clear();
+    for (int i = num_args_distr(rng); i > 0; i--) {
+      sizes.push_back(size_distr(rng));
+    }
+
+    rows.clear();
+    try {
+      failed += !check_case(sizes, rows, false, &num_steps);
+      failed += !check_case(sizes, rows, true, &num_steps);
+
+      /* Any rows of valid indices do, only the lookup is checked */
+      for (int r = rows_distr(rng); r > 0; r--) {
+        for (int size : sizes) {
+          rows.push_back(std::uniform_int_distribution<int>(0, size - 1)(rng));
+        }
+      }
+      failed += !check_case(sizes, rows, false, &num_steps);
+    } catch (const std::out_of_range& e) {
+      std::cerr << "Covering row read out of bounds" << std::endl;
+      failed++;
+    }
+  }
+
+  std::cout << num_cases << " cases, " << num_steps << " mutations, " << failed << " failed" << std::endl;
+  return failed != 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * Forgets which kernels the fuzzers have seen done, by bumping the generation
+ * of results_dir/kernel_states in place. Processes that already have the table
+ * mapped see it on their next Compute() and go back to the marker files, so
+ * a kernel whose .done was removed gets fuzzed again.
+ *
+ * A table of the wrong size (from a build before the generation was added) is
+ * replaced by a new, empty one through rename(), never shrunk: processes that
+ * have the old one mapped would fault on it. They keep using the old table
+ * until they restart.
+ *
+ * Usage: reset-kernel-states <results_dir>/kernel_states
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Must match MAX_KERNEL_IDS and struct kernel_state_table in tensorflow/fuzzing.h and pytorch/fuzzing.h */
+#define MAX_KERNEL_IDS 0x10000
+
+struct kernel_state_table {
+    std::atomic<unsigned int> generation;
+    std::atomic<unsigned int> done[MAX_KERNEL_IDS];
+};
+
+/* Write an empty table next to filename and move it over filename */
+static bool replace_table(const std::string& filename)
+{
+  std::string new_filename = filename + ".new";
+  int fd;
+
+  fd = open(new_filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (fd < 0) {
+    return false;
+  }
+
+  if (ftruncate(fd, sizeof(struct kernel_state_table)) != 0) {
+    close(fd);
+    std::remove(new_filename.c_str());
+    return false;
+  }
+  close(fd);
+
+  if (rename(new_filename.c_str(), filename.c_str()) != 0) {
+    std::remove(new_filename.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  struct kernel_state_table *table;
+  struct stat stat_buffer = {};
+  unsigned int generation, next;
+  int fd;
+
+  if (argc != 2) {
+    std::cerr << "Usage: " << argv[0] << " <results_dir>/kernel_states" << std::endl;
+    return 1;
+  }
+
+  fd = open(argv[1], O_RDWR);
+  if (fd < 0) {
+    std::cerr << "Failed to open " << argv[1] << ": " << strerror(errno) << std::endl;
+    return 1;
+  }
+
+  /* Written by an older fuzzer, or not grown yet. Empty is reset as well */
+  if (fstat(fd, &stat_buffer) != 0 || stat_buffer.st_size != (off_t) sizeof(struct kernel_state_table)) {
+    close(fd);
+    if (!replace_table(argv[1])) {
+      std::cerr << "Failed to reset " << argv[1] << ": " << strerror(errno) << std::endl;
+      return 1;
+    }
+    std::cout << argv[1] << ": reset" << std::endl;
+    return 0;
+  }
+
+  table = (struct kernel_state_table *) mmap(NULL, sizeof(struct kernel_state_table), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (table == MAP_FAILED) {
+    std::cerr << "Failed to map " << argv[1] << ": " << strerror(errno) << std::endl;
+    return 1;
+  }
+
+  /*
+   * Entries of a done kernel are generation + 1, which must not wrap around
+   * to 0, the entry of a kernel never seen. Entries left from 2^32 - 1 bumps
+   * ago would look done again, which doesn't happen in practice.
+   */
+  generation = table->generation.load(std::memory_order_relaxed);
+  do {
+    next = generation + 1;
+    if (next + 1 == 0) {
+      next++;
+    }
+  } while (!table->generation.compare_exchange_weak(generation, next, std::memory_order_relaxed));
+  munmap(table, sizeof(struct kernel_state_table));
+
+  std::cout << argv[1] << ": generation " << next << std::endl;
+  return 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * Converts the binary <kernel>.time.<pid> files written by the fuzzers in
+ * results_dir to CSV on stdout, one line per mutation.
+ *
+ * Usage: timings-to-csv <kernel>.time.<pid> [...]
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+/*
+ * Must match struct mutation_record and enum mutation_status in
+ * tensorflow/fuzzing.h and pytorch/fuzzing.h
+ */
+struct mutation_record {
+    long long mutation;
+    long long duration;
+    int status;
+    int failing_arg;
+};
+
+static const char *status_names[] = {"ok", "failed", "crashed", "hang"};
+
+static const char *status_name(int status)
+{
+  if (status < 0 || status >= (int) (sizeof(status_names) / sizeof(status_names[0]))) {
+    return "unknown";
+  }
+  return status_names[status];
+}
+
+static bool convert_file(const std::string& filename)
+{
+  struct mutation_record records[0x1000];
+  std::string basename, kernel, pid;
+  size_t time_idx, nread;
+  FILE *file;
+
+  basename = filename.substr(filename.find_last_of('/') + 1);
+  time_idx = basename.rfind(".time.");
+  if (time_idx == std::string::npos) {
+    std::cerr << "Not a timings file: " << filename << std::endl;
+    return false;
+  }
+  kernel = basename.substr(0, time_idx);
+  pid = basename.substr(time_idx + strlen(".time."));
+
+  file = fopen(filename.c_str(), "rb");
+  if (file == nullptr) {
+    std::cerr << "Failed to open " << filename << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  while ((nread = fread(records, sizeof(struct mutation_record), sizeof(records) / sizeof(records[0]), file)) > 0) {
+    for (size_t i = 0; i < nread; i++) {
+      printf("%s,%s,%lld,%lld,%s,%d\n", kernel.c_str(), pid.c_str(), records[i].mutation,
+          records[i].duration, status_name(records[i].status), records[i].failing_arg);
+    }
+  }
+
+  fclose(file);
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  int ret = 0;
+
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <kernel>.time.<pid> [...]" << std::endl;
+    return 1;
+  }
+
+  printf("kernel,pid,mutation,duration_ns,status,failing_arg\n");
+  for (int i = 1; i < argc; i++) {
+    if (!convert_file(argv[i])) {
+      ret = 1;
+    }
+  }
+
+  return ret;
+}